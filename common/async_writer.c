@@ -0,0 +1,533 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE
+#endif
+
+#include "async_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    if defined(__NR_io_uring_setup) && defined(__has_include)
+#        if __has_include(<linux/io_uring.h>)
+#            include <linux/io_uring.h>
+#            define ASYNC_WRITER_HAVE_URING 1
+#        endif
+#    endif
+#endif
+
+#define ASYNC_WRITER_DEFAULT_BATCH 32
+#define ASYNC_WRITER_DEFAULT_PENDING (256u << 20)
+// 单个 write 请求的最大长度(sqe.len 是 32 位), 超出部分由写线程同步补写
+#define ASYNC_WRITER_MAX_CHUNK (1u << 30)
+
+typedef struct WriteJob
+{
+    struct WriteJob*   next;
+    char*              path;
+    const uint8_t*     data;
+    size_t             size;
+    size_t             written;
+    int                fd;
+    int                error;    // errno, 0 表示成功
+    int                closed;   // fd 已由 io_uring 关闭
+    AsyncWriterRelease release;
+    void*              ctx;
+} WriteJob;
+
+#ifdef ASYNC_WRITER_HAVE_URING
+// 最小的 io_uring 封装, 只有写线程使用, 不需要对提交侧加锁
+typedef struct
+{
+    int                  fd;
+    unsigned             entries;
+    unsigned*            sq_head;
+    unsigned*            sq_tail;
+    unsigned*            sq_mask;
+    unsigned*            sq_array;
+    struct io_uring_sqe* sqes;
+    unsigned*            cq_head;
+    unsigned*            cq_tail;
+    unsigned*            cq_mask;
+    struct io_uring_cqe* cqes;
+    void*                sq_ring;
+    size_t               sq_ring_size;
+    void*                cq_ring;
+    size_t               cq_ring_size;
+    size_t               sqes_size;
+} Uring;
+#endif
+
+struct AsyncWriter
+{
+    int       batch;
+    size_t    max_pending_bytes;
+    int       use_uring;
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work;    // 有新文件入队或需要退出
+    pthread_cond_t  space;   // 一批写完, 排队字节数下降
+    WriteJob*       head;
+    WriteJob*       tail;
+    int             stop;
+
+    // 以下统计由 lock 保护
+    int      queue_depth;
+    int      max_queue_depth;
+    size_t   pending_bytes;
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t batches;
+    uint64_t start_ns;
+
+#ifdef ASYNC_WRITER_HAVE_URING
+    Uring ring;
+#endif
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef ASYNC_WRITER_HAVE_URING
+static void uring_exit(Uring* r)
+{
+    if (r->sqes) munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring) munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static int uring_init(Uring* r, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+    r->entries = p.sq_entries;
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    r->sq_ring = mmap(NULL,
+                      r->sq_ring_size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      r->fd,
+                      IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        r->sq_ring = NULL;
+        uring_exit(r);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    }
+    else {
+        r->cq_ring = mmap(NULL,
+                          r->cq_ring_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          r->fd,
+                          IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            r->cq_ring = NULL;
+            uring_exit(r);
+            return -1;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes      = mmap(NULL,
+                   r->sqes_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   r->fd,
+                   IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        uring_exit(r);
+        return -1;
+    }
+
+    uint8_t* sq = (uint8_t*)r->sq_ring;
+    uint8_t* cq = (uint8_t*)r->cq_ring;
+    r->sq_head  = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+static void uring_push(Uring* r, unsigned* tail, uint8_t opcode, int fd, const void* addr,
+                       unsigned len, uint8_t flags, uint64_t user_data)
+{
+    unsigned             index = *tail & *r->sq_mask;
+    struct io_uring_sqe* sqe   = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = opcode;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)addr;
+    sqe->len       = len;
+    sqe->off       = 0;
+    sqe->flags     = flags;
+    sqe->user_data = user_data;
+    r->sq_array[index] = index;
+    (*tail)++;
+}
+
+// 一批文件的 write + close 一次提交, 等全部完成. 返回 -1 表示 io_uring 不可用, 整批未提交
+static int uring_write_batch(Uring* r, WriteJob** jobs, int count)
+{
+    unsigned start = *r->sq_tail;
+    unsigned tail  = start;
+    int      total = 0;
+    for (int i = 0; i < count; i++) {
+        WriteJob* job = jobs[i];
+        if (job->fd < 0) continue;
+        unsigned len = job->size > ASYNC_WRITER_MAX_CHUNK ? ASYNC_WRITER_MAX_CHUNK
+                                                          : (unsigned)job->size;
+        // 链接请求: write 失败或写不完整时 close 被取消(-ECANCELED), 由调用方补做
+        uring_push(r, &tail, IORING_OP_WRITE, job->fd, job->data, len, IOSQE_IO_LINK, i * 2);
+        uring_push(r, &tail, IORING_OP_CLOSE, job->fd, NULL, 0, 0, i * 2 + 1);
+        total += 2;
+    }
+    if (total == 0) return 0;
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int submitted = 0;
+    int completed = 0;
+    while (completed < total) {
+        int ret = (int)syscall(__NR_io_uring_enter,
+                               r->fd,
+                               total - submitted,
+                               1,
+                               IORING_ENTER_GETEVENTS,
+                               NULL,
+                               0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            if (submitted == 0) {
+                // 一个都没交给内核, 撤回后由调用方同步写
+                __atomic_store_n(r->sq_tail, start, __ATOMIC_RELEASE);
+                return -1;
+            }
+            // 部分已提交后出错: 剩余请求的结果无法得知, 按失败处理
+            for (int i = 0; i < count; i++) {
+                if (jobs[i]->fd >= 0 && !jobs[i]->error && !jobs[i]->closed) {
+                    jobs[i]->error  = errno;
+                    jobs[i]->closed = 1;
+                }
+            }
+            return 0;
+        }
+        submitted += ret;
+
+        unsigned head = *r->cq_head;
+        unsigned end  = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != end; head++) {
+            const struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+            WriteJob*                  job = jobs[cqe->user_data >> 1];
+            if ((cqe->user_data & 1) == 0) {
+                if (cqe->res < 0) job->error = -cqe->res;
+                else job->written = (size_t)cqe->res;
+            }
+            else if (cqe->res != -ECANCELED) {
+                job->closed = 1;
+                if (cqe->res < 0 && !job->error) job->error = -cqe->res;
+            }
+            completed++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+#endif
+
+static void write_remaining(WriteJob* job)
+{
+    while (!job->error && job->written < job->size) {
+        ssize_t n = pwrite(job->fd,
+                           job->data + job->written,
+                           job->size - job->written,
+                           (off_t)job->written);
+        if (n < 0) {
+            if (errno != EINTR) job->error = errno;
+            continue;
+        }
+        job->written += (size_t)n;
+    }
+}
+
+static void write_batch(AsyncWriter* writer, WriteJob** jobs, int count)
+{
+    for (int i = 0; i < count; i++) {
+        WriteJob* job = jobs[i];
+        job->fd       = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (job->fd < 0) job->error = errno;
+    }
+
+#ifdef ASYNC_WRITER_HAVE_URING
+    if (writer->use_uring && uring_write_batch(&writer->ring, jobs, count) < 0) {
+        writer->use_uring = 0;
+    }
+#endif
+
+    for (int i = 0; i < count; i++) {
+        WriteJob* job = jobs[i];
+        if (job->fd < 0) continue;
+        // 5.6 之前的内核没有 IORING_OP_WRITE, 改用写线程同步写
+        if ((job->error == EINVAL || job->error == EOPNOTSUPP) && job->written == 0) {
+            writer->use_uring = 0;
+            job->error        = 0;
+        }
+        // 超过 ASYNC_WRITER_MAX_CHUNK 的文件: 第一段写完后 close 已经执行, 重新打开补写
+        if (job->closed && !job->error && job->written < job->size) {
+            job->fd     = open(job->path, O_WRONLY | O_CLOEXEC);
+            job->closed = job->fd < 0;
+            if (job->fd < 0) {
+                job->error = errno;
+                continue;
+            }
+        }
+        write_remaining(job);
+        if (!job->closed && close(job->fd) != 0 && !job->error) job->error = errno;
+    }
+}
+
+static void* writer_main(void* arg)
+{
+    AsyncWriter* writer = (AsyncWriter*)arg;
+    WriteJob**   jobs   = (WriteJob**)malloc(sizeof(WriteJob*) * writer->batch);
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->head && !writer->stop) pthread_cond_wait(&writer->work, &writer->lock);
+        if (!writer->head) break;
+
+        int count = 0;
+        while (writer->head && count < writer->batch) {
+            jobs[count++] = writer->head;
+            writer->head  = writer->head->next;
+        }
+        if (!writer->head) writer->tail = NULL;
+        pthread_mutex_unlock(&writer->lock);
+
+        write_batch(writer, jobs, count);
+
+        size_t   done_bytes = 0;
+        uint64_t bytes      = 0;
+        uint64_t errors     = 0;
+        for (int i = 0; i < count; i++) {
+            WriteJob* job = jobs[i];
+            done_bytes += job->size;
+            if (job->error) {
+                printf("async writer: write %s failed: %s\n", job->path, strerror(job->error));
+                errors++;
+            }
+            else {
+                bytes += job->written;
+            }
+            if (job->release) job->release((void*)job->data, job->ctx);
+            free(job->path);
+            free(job);
+        }
+
+        pthread_mutex_lock(&writer->lock);
+        writer->queue_depth -= count;
+        writer->pending_bytes -= done_bytes;
+        writer->files += count - errors;
+        writer->bytes += bytes;
+        writer->errors += errors;
+        writer->batches++;
+        pthread_cond_broadcast(&writer->space);
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    free(jobs);
+    return NULL;
+}
+
+AsyncWriter* async_writer_create(int batch, size_t max_pending_bytes)
+{
+    AsyncWriter* writer = (AsyncWriter*)calloc(1, sizeof(AsyncWriter));
+    if (!writer) return NULL;
+    writer->batch             = batch > 0 ? batch : ASYNC_WRITER_DEFAULT_BATCH;
+    writer->max_pending_bytes = max_pending_bytes ? max_pending_bytes
+                                                  : ASYNC_WRITER_DEFAULT_PENDING;
+    writer->start_ns          = now_ns();
+
+#ifdef ASYNC_WRITER_HAVE_URING
+    const char* env = getenv("ASYNC_WRITER_BACKEND");
+    if (!(env && strcmp(env, "thread") == 0)) {
+        // 每个文件占两个 SQE(write + close)
+        writer->use_uring = uring_init(&writer->ring, (unsigned)writer->batch * 2) == 0;
+        if (writer->use_uring && writer->ring.entries < (unsigned)writer->batch * 2) {
+            writer->batch = (int)writer->ring.entries / 2;
+        }
+    }
+    else {
+        writer->ring.fd = -1;
+    }
+#endif
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->work, NULL);
+    pthread_cond_init(&writer->space, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+#ifdef ASYNC_WRITER_HAVE_URING
+        if (writer->use_uring) uring_exit(&writer->ring);
+#endif
+        pthread_cond_destroy(&writer->space);
+        pthread_cond_destroy(&writer->work);
+        pthread_mutex_destroy(&writer->lock);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+void async_writer_destroy(AsyncWriter* writer)
+{
+    if (!writer) return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 1;
+    pthread_cond_signal(&writer->work);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    async_writer_print_stats(writer);
+
+#ifdef ASYNC_WRITER_HAVE_URING
+    if (writer->ring.fd >= 0 && writer->ring.sq_ring) uring_exit(&writer->ring);
+#endif
+    pthread_cond_destroy(&writer->space);
+    pthread_cond_destroy(&writer->work);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer);
+}
+
+int async_writer_submit(AsyncWriter* writer, const char* path, const void* data, size_t size,
+                        AsyncWriterRelease release, void* ctx)
+{
+    WriteJob* job = (WriteJob*)calloc(1, sizeof(WriteJob));
+    if (!job) return -1;
+    job->path = strdup(path);
+    if (!job->path) {
+        free(job);
+        return -1;
+    }
+    job->data    = (const uint8_t*)data;
+    job->size    = size;
+    job->fd      = -1;
+    job->release = release;
+    job->ctx     = ctx;
+
+    pthread_mutex_lock(&writer->lock);
+    // 反压: 队列为空时总是允许入队, 保证超过上限的单个大文件也能写
+    while (writer->pending_bytes > 0 && writer->pending_bytes + size > writer->max_pending_bytes) {
+        pthread_cond_wait(&writer->space, &writer->lock);
+    }
+    if (writer->tail) writer->tail->next = job;
+    else writer->head = job;
+    writer->tail = job;
+    writer->queue_depth++;
+    writer->pending_bytes += size;
+    if (writer->queue_depth > writer->max_queue_depth) writer->max_queue_depth = writer->queue_depth;
+    pthread_cond_signal(&writer->work);
+    pthread_mutex_unlock(&writer->lock);
+    return 0;
+}
+
+static void free_copy(void* data, void* ctx)
+{
+    (void)ctx;
+    free(data);
+}
+
+int async_writer_submit_copy(AsyncWriter* writer, const char* path, const void* data, size_t size)
+{
+    return async_writer_submit_copy2(writer, path, data, size, NULL, 0);
+}
+
+int async_writer_submit_copy2(AsyncWriter* writer, const char* path, const void* data0,
+                              size_t size0, const void* data1, size_t size1)
+{
+    uint8_t* copy = (uint8_t*)malloc(size0 + size1 ? size0 + size1 : 1);
+    if (!copy) return -1;
+    if (size0) memcpy(copy, data0, size0);
+    if (size1) memcpy(copy + size0, data1, size1);
+    if (async_writer_submit(writer, path, copy, size0 + size1, free_copy, NULL) != 0) {
+        free(copy);
+        return -1;
+    }
+    return 0;
+}
+
+void async_writer_flush(AsyncWriter* writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue_depth > 0) pthread_cond_wait(&writer->space, &writer->lock);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void async_writer_stats(AsyncWriter* writer, AsyncWriterStats* stats)
+{
+    pthread_mutex_lock(&writer->lock);
+    stats->files           = writer->files;
+    stats->bytes           = writer->bytes;
+    stats->errors          = writer->errors;
+    stats->batches         = writer->batches;
+    stats->queue_depth     = writer->queue_depth;
+    stats->max_queue_depth = writer->max_queue_depth;
+    stats->pending_bytes   = writer->pending_bytes;
+    pthread_mutex_unlock(&writer->lock);
+    stats->seconds = (now_ns() - writer->start_ns) / 1e9;
+}
+
+void async_writer_print_stats(AsyncWriter* writer)
+{
+    AsyncWriterStats s;
+    async_writer_stats(writer, &s);
+    printf("async writer (%s): %llu file(s), %.2f MB, %.1f MB/s, %llu batch(es) "
+           "(%.1f files/batch), queue depth %d max %d, errors %llu\n",
+           async_writer_backend(writer),
+           (unsigned long long)s.files,
+           s.bytes / 1048576.0,
+           s.seconds > 0 ? s.bytes / 1048576.0 / s.seconds : 0.0,
+           (unsigned long long)s.batches,
+           s.batches ? (double)(s.files + s.errors) / s.batches : 0.0,
+           s.queue_depth,
+           s.max_queue_depth,
+           (unsigned long long)s.errors);
+}
+
+const char* async_writer_backend(const AsyncWriter* writer)
+{
+    return writer->use_uring ? "io_uring" : "thread";
+}
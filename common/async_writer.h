@@ -0,0 +1,63 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+// 异步批量写文件: 调用方把整块输出缓冲交给写线程后立即返回, 计算线程不等磁盘.
+//
+// 写线程每次从队列取最多 batch 个文件, 同步 open 后把每个文件的 write + close 作为一对
+// 链接(IOSQE_IO_LINK)请求放进 io_uring, 整批只用一次 io_uring_enter 提交并等待完成.
+// 内核不支持 io_uring(或 ASYNC_WRITER_BACKEND=thread)时, 写线程改为逐个 write/close,
+// 接口和语义不变. 不依赖 liburing, 直接使用系统调用.
+//
+// 排队的字节数超过 max_pending_bytes 时 submit 才会阻塞(磁盘持续跟不上时的反压).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AsyncWriter AsyncWriter;
+
+// 写完(或失败)后在写线程上调用, 用于释放 submit 交出的缓冲
+typedef void (*AsyncWriterRelease)(void* data, void* ctx);
+
+typedef struct
+{
+    uint64_t files;            // 已完成的文件数
+    uint64_t bytes;            // 已写入的字节数
+    uint64_t errors;           // 打开或写入失败的文件数
+    uint64_t batches;          // 提交批次数
+    int      queue_depth;      // 当前排队 + 正在写的文件数
+    int      max_queue_depth;  // 队列深度峰值
+    size_t   pending_bytes;    // 当前排队 + 正在写的字节数
+    double   seconds;          // 从创建到现在的时间
+} AsyncWriterStats;
+
+// batch: 每次提交的最大文件数, <= 0 取 32; max_pending_bytes: 0 取 256MB. 失败返回 NULL
+AsyncWriter* async_writer_create(int batch, size_t max_pending_bytes);
+// 等待所有文件写完, 打印统计后销毁
+void async_writer_destroy(AsyncWriter* writer);
+
+// 入队写 path, data 在 release 被调用之前必须保持有效. release 可以为 NULL. 返回 0 成功
+int async_writer_submit(AsyncWriter* writer, const char* path, const void* data, size_t size,
+                        AsyncWriterRelease release, void* ctx);
+// 把 data 拷贝一份后入队, 返回后调用方可以立即复用 data
+int async_writer_submit_copy(AsyncWriter* writer, const char* path, const void* data, size_t size);
+// 拷贝两段数据拼成一个文件(如 NV21 的 Y 和 VU 平面)
+int async_writer_submit_copy2(AsyncWriter* writer, const char* path, const void* data0,
+                              size_t size0, const void* data1, size_t size1);
+
+// 等待已入队的文件全部写完(之后可以安全读取这些文件)
+void async_writer_flush(AsyncWriter* writer);
+
+void        async_writer_stats(AsyncWriter* writer, AsyncWriterStats* stats);
+void        async_writer_print_stats(AsyncWriter* writer);
+// "io_uring" 或 "thread"
+const char* async_writer_backend(const AsyncWriter* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // ASYNC_WRITER_H
@@ -0,0 +1,301 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE
+#endif
+
+#include "nv21_container.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NV21_CONTAINER_MAGIC   "NV21CTNR"
+#define NV21_CONTAINER_VERSION 1
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t fourcc;         // 默认格式
+    uint32_t width;          // 默认尺寸, 没有索引时用它推算帧位置
+    uint32_t height;
+    uint32_t alignment;
+    uint64_t frame_count;    // finish 时回填
+    uint64_t index_offset;   // finish 时回填, 0 表示写入方没有正常结束
+    uint32_t index_entry_size;
+    uint32_t reserved;
+} ContainerHeader;
+
+struct Nv21ContainerWriter
+{
+    int                 fd;
+    char*               path;
+    ContainerHeader     hdr;
+    uint64_t            end;   // 下一帧的写入偏移(已对齐)
+    Nv21ContainerFrame* index;
+    int64_t             count;
+    int64_t             capacity;
+};
+
+struct Nv21Container
+{
+    const uint8_t*            base;
+    size_t                    size;
+    const ContainerHeader*    hdr;
+    const Nv21ContainerFrame* index;   // 没有索引时为 NULL
+    int64_t                   count;
+    uint64_t                  stride;  // 没有索引时的帧间距
+};
+
+static uint64_t align_up(uint64_t v)
+{
+    return (v + NV21_CONTAINER_ALIGN - 1) / NV21_CONTAINER_ALIGN * NV21_CONTAINER_ALIGN;
+}
+
+// 条目落在文件内; NV21 条目还要求尺寸为非零偶数, 数据量足够一帧.
+// 读取方都按条目里的宽高访问 Y/VU 平面, 截断或损坏的文件必须在这里挡住
+static int frame_valid(const Nv21ContainerFrame* entry, size_t file_size)
+{
+    if (entry->offset > file_size || entry->size > file_size - entry->offset) return 0;
+    if (entry->fourcc != NV21_CONTAINER_FOURCC_NV21) return 1;
+    if (entry->width == 0 || entry->height == 0 || entry->width % 2 || entry->height % 2) return 0;
+    return entry->size >= (uint64_t)entry->width * entry->height * 3 / 2;
+}
+
+static int write_full(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+Nv21ContainerWriter* nv21_container_create(const char* path, int width, int height)
+{
+    if (width <= 0 || height <= 0 || width % 2 || height % 2) return NULL;
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        printf("open %s failed: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    Nv21ContainerWriter* writer = (Nv21ContainerWriter*)calloc(1, sizeof(Nv21ContainerWriter));
+    writer->fd                  = fd;
+    writer->path                = strdup(path);
+    writer->end                 = NV21_CONTAINER_HEADER_SIZE;
+    memcpy(writer->hdr.magic, NV21_CONTAINER_MAGIC, 8);
+    writer->hdr.version          = NV21_CONTAINER_VERSION;
+    writer->hdr.header_size      = NV21_CONTAINER_HEADER_SIZE;
+    writer->hdr.fourcc           = NV21_CONTAINER_FOURCC_NV21;
+    writer->hdr.width            = (uint32_t)width;
+    writer->hdr.height           = (uint32_t)height;
+    writer->hdr.alignment        = NV21_CONTAINER_ALIGN;
+    writer->hdr.index_entry_size = sizeof(Nv21ContainerFrame);
+
+    // 先写一个没有索引的头部, 中途退出的文件也能按默认尺寸读回
+    uint8_t page[NV21_CONTAINER_HEADER_SIZE] = {0};
+    memcpy(page, &writer->hdr, sizeof(writer->hdr));
+    if (write_full(fd, page, sizeof(page), 0) != 0) {
+        printf("write %s failed: %s\n", path, strerror(errno));
+        close(fd);
+        free(writer->path);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int64_t nv21_container_append(Nv21ContainerWriter* writer, const uint8_t* y, const uint8_t* vu,
+                              int width, int height, uint64_t timestamp_ns)
+{
+    if (width <= 0 || height <= 0 || width % 2 || height % 2) return -1;
+
+    if (writer->count == writer->capacity) {
+        int64_t             capacity = writer->capacity ? writer->capacity * 2 : 64;
+        Nv21ContainerFrame* index    = (Nv21ContainerFrame*)realloc(
+            writer->index, sizeof(Nv21ContainerFrame) * (size_t)capacity);
+        if (!index) return -1;
+        writer->index    = index;
+        writer->capacity = capacity;
+    }
+
+    size_t   y_size = (size_t)width * height;
+    uint64_t offset = writer->end;
+    if (write_full(writer->fd, y, y_size, offset) != 0 ||
+        write_full(writer->fd, vu, y_size / 2, offset + y_size) != 0) {
+        printf("write %s failed: %s\n", writer->path, strerror(errno));
+        return -1;
+    }
+
+    Nv21ContainerFrame* frame = &writer->index[writer->count];
+    memset(frame, 0, sizeof(*frame));
+    frame->offset       = offset;
+    frame->size         = y_size * 3 / 2;
+    frame->timestamp_ns = timestamp_ns;
+    frame->fourcc       = NV21_CONTAINER_FOURCC_NV21;
+    frame->width        = (uint32_t)width;
+    frame->height       = (uint32_t)height;
+    writer->end         = align_up(offset + frame->size);
+    return writer->count++;
+}
+
+int nv21_container_finish(Nv21ContainerWriter* writer)
+{
+    if (!writer) return -1;
+
+    // 索引紧跟最后一帧(已对齐), 头部最后回填, 回填之前文件仍按无索引处理
+    int ret = 0;
+    writer->hdr.frame_count  = (uint64_t)writer->count;
+    writer->hdr.index_offset = writer->end;
+    if (write_full(writer->fd,
+                   writer->index,
+                   sizeof(Nv21ContainerFrame) * (size_t)writer->count,
+                   writer->end) != 0 ||
+        write_full(writer->fd, &writer->hdr, sizeof(writer->hdr), 0) != 0) {
+        printf("write %s index failed: %s\n", writer->path, strerror(errno));
+        ret = -1;
+    }
+    if (close(writer->fd) != 0) ret = -1;
+
+    free(writer->index);
+    free(writer->path);
+    free(writer);
+    return ret;
+}
+
+int nv21_container_probe(const char* path)
+{
+    char  magic[8];
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    int ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+             memcmp(magic, NV21_CONTAINER_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return ok;
+}
+
+Nv21Container* nv21_container_open(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < NV21_CONTAINER_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void*  mem  = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return NULL;
+
+    const ContainerHeader* hdr = (const ContainerHeader*)mem;
+    if (memcmp(hdr->magic, NV21_CONTAINER_MAGIC, 8) != 0 ||
+        hdr->version != NV21_CONTAINER_VERSION ||
+        hdr->header_size != NV21_CONTAINER_HEADER_SIZE ||
+        hdr->index_entry_size != sizeof(Nv21ContainerFrame) || hdr->width == 0 ||
+        hdr->height == 0 || hdr->width % 2 || hdr->height % 2) {
+        munmap(mem, size);
+        return NULL;
+    }
+
+    Nv21Container* container = (Nv21Container*)calloc(1, sizeof(Nv21Container));
+    container->base          = (const uint8_t*)mem;
+    container->size          = size;
+    container->hdr           = hdr;
+
+    if (hdr->index_offset != 0) {
+        if (hdr->index_offset > size ||
+            hdr->frame_count > (size - hdr->index_offset) / sizeof(Nv21ContainerFrame)) {
+            nv21_container_close(container);
+            return NULL;
+        }
+        container->index = (const Nv21ContainerFrame*)(container->base + hdr->index_offset);
+        container->count = (int64_t)hdr->frame_count;
+        for (int64_t i = 0; i < container->count; i++) {
+            if (!frame_valid(&container->index[i], size)) {
+                printf("%s: frame %d has an invalid index entry\n", path, (int)i);
+                nv21_container_close(container);
+                return NULL;
+            }
+        }
+    }
+    else {
+        // 写入方没有正常结束: 按默认尺寸推算, 只认完整写入的帧
+        uint64_t frame_size = (uint64_t)hdr->width * hdr->height * 3 / 2;
+        container->stride   = align_up(frame_size);
+        container->count    = size >= NV21_CONTAINER_HEADER_SIZE + frame_size
+                                  ? (int64_t)((size - NV21_CONTAINER_HEADER_SIZE - frame_size) /
+                                                  container->stride +
+                                              1)
+                                  : 0;
+        printf("%s has no frame index, assuming %d frame(s) of %ux%u\n",
+               path,
+               (int)container->count,
+               hdr->width,
+               hdr->height);
+    }
+
+    // 回放多数是顺序读, 提示内核预读; 随机访问时缺页也只涉及被访问的帧
+    madvise(mem, size, MADV_SEQUENTIAL);
+    return container;
+}
+
+void nv21_container_close(Nv21Container* container)
+{
+    if (!container) return;
+    munmap((void*)container->base, container->size);
+    free(container);
+}
+
+int64_t nv21_container_frame_count(const Nv21Container* container)
+{
+    return container->count;
+}
+
+int nv21_container_width(const Nv21Container* container)
+{
+    return (int)container->hdr->width;
+}
+
+int nv21_container_height(const Nv21Container* container)
+{
+    return (int)container->hdr->height;
+}
+
+const uint8_t* nv21_container_frame(const Nv21Container* container, int64_t index,
+                                    Nv21ContainerFrame* frame)
+{
+    if (index < 0 || index >= container->count) return NULL;
+
+    Nv21ContainerFrame entry;
+    if (container->index) {
+        entry = container->index[index];
+    }
+    else {
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = NV21_CONTAINER_HEADER_SIZE + (uint64_t)index * container->stride;
+        entry.fourcc = container->hdr->fourcc;
+        entry.width  = container->hdr->width;
+        entry.height = container->hdr->height;
+        entry.size   = (uint64_t)entry.width * entry.height * 3 / 2;
+    }
+    if (!frame_valid(&entry, container->size)) return NULL;
+
+    if (frame) *frame = entry;
+    return container->base + entry.offset;
+}
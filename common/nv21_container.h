@@ -0,0 +1,69 @@
+#ifndef NV21_CONTAINER_H
+#define NV21_CONTAINER_H
+
+// 多帧 NV21 容器文件(.nv21c), 尺寸和格式记录在文件里, 不再依赖文件名中的 _WxH 后缀.
+//
+// 文件布局(小端):
+//   [0, 4096)      头部: magic、版本、默认格式和尺寸、帧数、索引偏移
+//   帧数据         每帧起始偏移按 4096 对齐, Y 平面紧跟 VU 平面, 帧之间尺寸可以不同
+//   帧索引         文件末尾, 每帧一个定长条目(偏移、大小、格式、尺寸、时间戳)
+//
+// 读取时整个文件只读 mmap, 第 i 帧的位置直接查索引, 随机访问不需要从头扫描.
+// 写入方没有正常结束(没有索引)时, 按默认尺寸等间隔推算帧位置, 能读回已写完的帧.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NV21_CONTAINER_EXT         ".nv21c"
+#define NV21_CONTAINER_HEADER_SIZE 4096
+#define NV21_CONTAINER_ALIGN       4096
+#define NV21_CONTAINER_FOURCC(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define NV21_CONTAINER_FOURCC_NV21 NV21_CONTAINER_FOURCC('N', 'V', '2', '1')
+
+typedef struct
+{
+    uint64_t offset;         // 帧数据在文件中的偏移, 按 NV21_CONTAINER_ALIGN 对齐
+    uint64_t size;           // 帧数据字节数
+    uint64_t timestamp_ns;   // 由写入方填写, 0 表示没有
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+} Nv21ContainerFrame;
+
+typedef struct Nv21Container       Nv21Container;
+typedef struct Nv21ContainerWriter Nv21ContainerWriter;
+
+// ---- 写入 ----
+// 创建(覆盖)容器文件, width/height 为默认尺寸, 写入头部. 失败返回 NULL
+Nv21ContainerWriter* nv21_container_create(const char* path, int width, int height);
+// 追加一帧, 尺寸可以和默认尺寸不同. 返回帧序号, 失败返回 -1
+int64_t nv21_container_append(Nv21ContainerWriter* writer, const uint8_t* y, const uint8_t* vu,
+                              int width, int height, uint64_t timestamp_ns);
+// 写索引、回填头部并关闭. 返回 0 成功
+int nv21_container_finish(Nv21ContainerWriter* writer);
+
+// ---- 读取 ----
+// 文件开头是容器 magic 时返回 1
+int            nv21_container_probe(const char* path);
+// 只读 mmap 打开, 校验头部和索引. 失败返回 NULL
+Nv21Container* nv21_container_open(const char* path);
+void           nv21_container_close(Nv21Container* container);
+
+int64_t nv21_container_frame_count(const Nv21Container* container);
+int     nv21_container_width(const Nv21Container* container);
+int     nv21_container_height(const Nv21Container* container);
+// 第 index 帧的 Y 平面(VU 紧随其后), 指针在 close 之前有效. 越界或条目无效返回 NULL
+const uint8_t* nv21_container_frame(const Nv21Container* container, int64_t index,
+                                    Nv21ContainerFrame* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // NV21_CONTAINER_H
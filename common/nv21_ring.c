@@ -0,0 +1,393 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE
+#endif
+
+#include "nv21_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+#endif
+
+#define NV21_RING_MAGIC       0x4752564eu   // "NVRG"
+#define NV21_RING_VERSION     1
+#define NV21_RING_HEADER_SIZE 4096
+#define NV21_RING_PAGE_SIZE   4096
+#define NV21_RING_SPIN        2000   // 休眠前的自旋次数, 约几十微秒
+
+typedef struct
+{
+    uint64_t sequence;
+    uint64_t timestamp_ns;
+} SlotMeta;
+
+// 生产者和消费者各自写的字段放在不同的缓存行, 避免伪共享
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t  width;
+    int32_t  height;
+    uint32_t slot_count;
+    uint32_t reserved;
+    uint64_t frame_size;
+    uint64_t slot_stride;
+
+    _Alignas(64) _Atomic uint64_t head;   // 生产者: 已发布帧数
+    atomic_uint head_word;                // head 低 32 位, 消费者在它上面 futex 等待
+    atomic_uint consumer_waiting;
+    atomic_uint producer_closed;
+
+    _Alignas(64) _Atomic uint64_t tail;   // 消费者: 已释放帧数
+    atomic_uint tail_word;
+    atomic_uint producer_waiting;
+    atomic_uint consumer_closed;
+
+    _Alignas(64) SlotMeta slots[NV21_RING_MAX_SLOTS];
+} RingHeader;
+
+_Static_assert(sizeof(RingHeader) <= NV21_RING_HEADER_SIZE, "ring header exceeds one page");
+
+struct Nv21Ring
+{
+    RingHeader* hdr;
+    uint8_t*    base;
+    size_t      map_size;
+    int         producer;
+    uint64_t    cursor;   // 生产者: 下一个要写的帧; 消费者: 下一个要读的帧
+
+    // 打开时校验过的几何参数, 之后不再读共享头里的这几个字段(对端随时可能改写)
+    int      width;
+    int      height;
+    uint32_t slot_count;
+    uint64_t slot_stride;
+};
+
+uint64_t nv21_ring_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// 跨进程 futex(不能用 FUTEX_PRIVATE_FLAG)
+static void futex_wait(atomic_uint* addr, unsigned expected, int64_t timeout_us)
+{
+#if defined(__linux__)
+    struct timespec  ts;
+    struct timespec* pts = NULL;
+    if (timeout_us >= 0) {
+        ts.tv_sec  = timeout_us / 1000000;
+        ts.tv_nsec = (timeout_us % 1000000) * 1000;
+        pts        = &ts;
+    }
+    syscall(SYS_futex, (void*)addr, FUTEX_WAIT, expected, pts, NULL, 0);
+#else
+    (void)addr;
+    (void)expected;
+    usleep(timeout_us >= 0 && timeout_us < 1000 ? (useconds_t)timeout_us : 1000);
+#endif
+}
+
+static void futex_wake(atomic_uint* addr)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, (void*)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)addr;
+#endif
+}
+
+// 自旋后在 *word 上休眠, 直到 ready() 成立、closed 被置位或超时.
+// waiting 标志让对方只在必要时才发起唤醒系统调用.
+static int wait_for(Nv21Ring* ring, atomic_uint* word, atomic_uint* waiting, atomic_uint* closed,
+                    int (*ready)(Nv21Ring*), int64_t timeout_us)
+{
+    uint64_t deadline = timeout_us >= 0 ? nv21_ring_now_ns() + (uint64_t)timeout_us * 1000 : 0;
+
+    for (int spin = 0;; spin++) {
+        if (ready(ring)) return 1;
+        if (atomic_load(closed)) return ready(ring) ? 1 : -1;
+
+        if (spin < NV21_RING_SPIN) {
+            cpu_relax();
+            continue;
+        }
+
+        int64_t remaining_us = -1;
+        if (timeout_us >= 0) {
+            uint64_t now = nv21_ring_now_ns();
+            if (now >= deadline) return ready(ring) ? 1 : 0;
+            remaining_us = (int64_t)((deadline - now) / 1000);
+        }
+
+        // 先登记等待再复查, 对方推进计数后一定能看到 waiting 并唤醒
+        unsigned observed = atomic_load(word);
+        atomic_store(waiting, 1);
+        if (!ready(ring) && !atomic_load(closed)) futex_wait(word, observed, remaining_us);
+        atomic_store(waiting, 0);
+    }
+}
+
+static int ring_readable(Nv21Ring* ring)
+{
+    return atomic_load_explicit(&ring->hdr->head, memory_order_acquire) != ring->cursor;
+}
+
+static int ring_writable(Nv21Ring* ring)
+{
+    uint64_t tail = atomic_load_explicit(&ring->hdr->tail, memory_order_acquire);
+    return ring->cursor - tail < ring->slot_count;
+}
+
+static void shm_path(char* path, size_t size, const char* name)
+{
+    snprintf(path, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+static uint8_t* slot_data(Nv21Ring* ring, uint64_t index)
+{
+    return ring->base + NV21_RING_HEADER_SIZE + (index % ring->slot_count) * ring->slot_stride;
+}
+
+Nv21Ring* nv21_ring_create(const char* name, int width, int height, int slot_count)
+{
+    if (width <= 0 || height <= 0 || width % 2 || height % 2) return NULL;
+    if (slot_count < 2 || slot_count > NV21_RING_MAX_SLOTS) return NULL;
+
+    uint64_t frame_size = (uint64_t)width * height * 3 / 2;
+    uint64_t stride     = (frame_size + NV21_RING_PAGE_SIZE - 1) / NV21_RING_PAGE_SIZE *
+                      NV21_RING_PAGE_SIZE;
+    size_t map_size = NV21_RING_HEADER_SIZE + (size_t)stride * slot_count;
+
+    char path[256];
+    shm_path(path, sizeof(path), name);
+    int fd = shm_open(path, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        printf("shm_open %s failed: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (ftruncate(fd, (off_t)map_size) != 0) {
+        printf("ftruncate %s failed: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    void* mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        printf("mmap %s failed: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    RingHeader* hdr = (RingHeader*)mem;
+    __atomic_store_n(&hdr->magic, 0, __ATOMIC_RELEASE);   // 重建时先让新打开的消费者校验失败
+    memset(hdr, 0, NV21_RING_HEADER_SIZE);
+    hdr->version     = NV21_RING_VERSION;
+    hdr->width       = width;
+    hdr->height      = height;
+    hdr->slot_count  = (uint32_t)slot_count;
+    hdr->frame_size  = frame_size;
+    hdr->slot_stride = stride;
+    atomic_init(&hdr->head, 0);
+    atomic_init(&hdr->tail, 0);
+    atomic_init(&hdr->head_word, 0);
+    atomic_init(&hdr->tail_word, 0);
+    atomic_init(&hdr->consumer_waiting, 0);
+    atomic_init(&hdr->producer_waiting, 0);
+    atomic_init(&hdr->producer_closed, 0);
+    atomic_init(&hdr->consumer_closed, 0);
+    // magic 最后写, 消费者看到 magic 时其余字段已就绪
+    __atomic_store_n(&hdr->magic, NV21_RING_MAGIC, __ATOMIC_RELEASE);
+
+    Nv21Ring* ring = (Nv21Ring*)calloc(1, sizeof(Nv21Ring));
+    if (!ring) {
+        munmap(mem, map_size);
+        return NULL;
+    }
+    ring->hdr         = hdr;
+    ring->base        = (uint8_t*)mem;
+    ring->map_size    = map_size;
+    ring->producer    = 1;
+    ring->width       = width;
+    ring->height      = height;
+    ring->slot_count  = (uint32_t)slot_count;
+    ring->slot_stride = stride;
+    return ring;
+}
+
+Nv21Ring* nv21_ring_open(const char* name)
+{
+    char path[256];
+    shm_path(path, sizeof(path), name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < NV21_RING_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    void* mem = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return NULL;
+
+    // 共享头不可信: 各字段只读一次, 按 nv21_ring_create 的规则校验,
+    // 槽位总大小用除法比较, 避免乘法溢出
+    RingHeader* hdr        = (RingHeader*)mem;
+    uint64_t    data_size  = (uint64_t)st.st_size - NV21_RING_HEADER_SIZE;
+    int32_t     width      = hdr->width;
+    int32_t     height     = hdr->height;
+    uint32_t    slot_count = hdr->slot_count;
+    uint64_t    frame_size = hdr->frame_size;
+    uint64_t    stride     = hdr->slot_stride;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != NV21_RING_MAGIC ||
+        hdr->version != NV21_RING_VERSION || width <= 0 || height <= 0 || width % 2 ||
+        height % 2 || slot_count < 2 || slot_count > NV21_RING_MAX_SLOTS ||
+        frame_size != (uint64_t)width * height * 3 / 2 || stride < frame_size ||
+        stride > data_size / slot_count) {
+        munmap(mem, (size_t)st.st_size);
+        return NULL;
+    }
+
+    Nv21Ring* ring = (Nv21Ring*)calloc(1, sizeof(Nv21Ring));
+    if (!ring) {
+        munmap(mem, (size_t)st.st_size);
+        return NULL;
+    }
+    ring->hdr         = hdr;
+    ring->base        = (uint8_t*)mem;
+    ring->map_size    = (size_t)st.st_size;
+    ring->producer    = 0;
+    ring->cursor      = atomic_load_explicit(&hdr->tail, memory_order_acquire);
+    ring->width       = width;
+    ring->height      = height;
+    ring->slot_count  = slot_count;
+    ring->slot_stride = stride;
+    return ring;
+}
+
+void nv21_ring_close(Nv21Ring* ring)
+{
+    if (!ring) return;
+
+    RingHeader* hdr = ring->hdr;
+    if (ring->producer) {
+        atomic_store(&hdr->producer_closed, 1);
+        futex_wake(&hdr->head_word);
+    }
+    else {
+        atomic_store(&hdr->consumer_closed, 1);
+        futex_wake(&hdr->tail_word);
+    }
+    munmap(ring->base, ring->map_size);
+    free(ring);
+}
+
+int nv21_ring_unlink(const char* name)
+{
+    char path[256];
+    shm_path(path, sizeof(path), name);
+    return shm_unlink(path);
+}
+
+int nv21_ring_width(const Nv21Ring* ring)
+{
+    return ring->width;
+}
+
+int nv21_ring_height(const Nv21Ring* ring)
+{
+    return ring->height;
+}
+
+int nv21_ring_slot_count(const Nv21Ring* ring)
+{
+    return (int)ring->slot_count;
+}
+
+uint8_t* nv21_ring_acquire(Nv21Ring* ring)
+{
+    if (!ring_writable(ring)) return NULL;
+    return slot_data(ring, ring->cursor);
+}
+
+void nv21_ring_publish(Nv21Ring* ring)
+{
+    RingHeader* hdr  = ring->hdr;
+    SlotMeta*   meta = &hdr->slots[ring->cursor % ring->slot_count];
+    meta->sequence     = ring->cursor;
+    meta->timestamp_ns = nv21_ring_now_ns();
+
+    ring->cursor++;
+    atomic_store_explicit(&hdr->head, ring->cursor, memory_order_release);
+    atomic_store(&hdr->head_word, (unsigned)ring->cursor);
+    if (atomic_load(&hdr->consumer_waiting)) futex_wake(&hdr->head_word);
+}
+
+int nv21_ring_wait_writable(Nv21Ring* ring, int64_t timeout_us)
+{
+    RingHeader* hdr = ring->hdr;
+    return wait_for(ring,
+                    &hdr->tail_word,
+                    &hdr->producer_waiting,
+                    &hdr->consumer_closed,
+                    ring_writable,
+                    timeout_us);
+}
+
+const uint8_t* nv21_ring_peek(Nv21Ring* ring, Nv21RingFrame* frame)
+{
+    if (!ring_readable(ring)) return NULL;
+
+    RingHeader*     hdr  = ring->hdr;
+    const SlotMeta* meta = &hdr->slots[ring->cursor % ring->slot_count];
+    if (frame) {
+        frame->sequence     = meta->sequence;
+        frame->timestamp_ns = meta->timestamp_ns;
+        frame->width        = ring->width;
+        frame->height       = ring->height;
+    }
+    return slot_data(ring, ring->cursor);
+}
+
+void nv21_ring_release(Nv21Ring* ring)
+{
+    RingHeader* hdr = ring->hdr;
+
+    ring->cursor++;
+    atomic_store_explicit(&hdr->tail, ring->cursor, memory_order_release);
+    atomic_store(&hdr->tail_word, (unsigned)ring->cursor);
+    if (atomic_load(&hdr->producer_waiting)) futex_wake(&hdr->tail_word);
+}
+
+int nv21_ring_wait_readable(Nv21Ring* ring, int64_t timeout_us)
+{
+    RingHeader* hdr = ring->hdr;
+    return wait_for(ring,
+                    &hdr->head_word,
+                    &hdr->consumer_waiting,
+                    &hdr->producer_closed,
+                    ring_readable,
+                    timeout_us);
+}
@@ -0,0 +1,71 @@
+#ifndef NV21_RING_H
+#define NV21_RING_H
+
+// 进程间 NV21 帧环形缓冲(POSIX 共享内存), 单生产者/单消费者, 无锁.
+//
+// 共享内存布局:
+//   [0, 4096)  头部: 参数、head/tail 计数、每个槽位的元数据
+//   之后       slot_count 个槽位, 每个槽位按页对齐, 内容为 Y 平面紧跟 VU 平面
+//
+// head 只由生产者写(已发布的帧数), tail 只由消费者写(已释放的帧数), 两者都单调递增,
+// 槽位下标为 计数 % slot_count. 生产者写完一帧后以 release 语义推进 head, 消费者以
+// acquire 语义读取 head, 所以不需要锁. 消费者直接读取槽位中的数据(零拷贝), 处理完再
+// release 归还槽位. 等待时先自旋, 再用 futex 休眠, 只有对方在等待时才发起唤醒系统调用.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NV21_RING_MAX_SLOTS 64
+
+typedef struct Nv21Ring Nv21Ring;
+
+typedef struct
+{
+    uint64_t sequence;       // 帧序号, 从 0 开始
+    uint64_t timestamp_ns;   // 生产者发布时的 CLOCK_MONOTONIC 时间
+    int      width;
+    int      height;
+} Nv21RingFrame;
+
+// 生产者创建(已存在则覆盖), slot_count 取 2..NV21_RING_MAX_SLOTS. 失败返回 NULL
+Nv21Ring* nv21_ring_create(const char* name, int width, int height, int slot_count);
+// 消费者打开已存在的环, 校验头部. 失败返回 NULL
+Nv21Ring* nv21_ring_open(const char* name);
+// 解除映射; 生产者关闭时会标记流结束并唤醒消费者
+void nv21_ring_close(Nv21Ring* ring);
+// 删除共享内存对象(已映射的一方不受影响)
+int nv21_ring_unlink(const char* name);
+
+int nv21_ring_width(const Nv21Ring* ring);
+int nv21_ring_height(const Nv21Ring* ring);
+int nv21_ring_slot_count(const Nv21Ring* ring);
+
+// ---- 生产者 ----
+// 取一个空闲槽位用于写入 width * height * 3 / 2 字节, 没有空闲槽位时返回 NULL
+uint8_t* nv21_ring_acquire(Nv21Ring* ring);
+// 发布 acquire 得到的槽位
+void nv21_ring_publish(Nv21Ring* ring);
+// 等待空闲槽位, timeout_us < 0 表示一直等. 返回 1 可写, 0 超时, -1 消费者已关闭
+int nv21_ring_wait_writable(Nv21Ring* ring, int64_t timeout_us);
+
+// ---- 消费者 ----
+// 取最早的未读帧, 返回指向共享内存中 Y 平面的指针(VU 紧随其后), 没有帧时返回 NULL.
+// 指针在 nv21_ring_release 之前一直有效
+const uint8_t* nv21_ring_peek(Nv21Ring* ring, Nv21RingFrame* frame);
+// 归还 peek 得到的槽位
+void nv21_ring_release(Nv21Ring* ring);
+// 等待新帧, timeout_us < 0 表示一直等. 返回 1 可读, 0 超时, -1 生产者已关闭且无剩余帧
+int nv21_ring_wait_readable(Nv21Ring* ring, int64_t timeout_us);
+
+// CLOCK_MONOTONIC 纳秒, 与 Nv21RingFrame.timestamp_ns 同一时钟
+uint64_t nv21_ring_now_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // NV21_RING_H
@@ -0,0 +1,292 @@
+#include "perf_regions.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#    include <linux/perf_event.h>
+#    include <sys/ioctl.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+#define PERF_MAX_REGIONS 64
+
+struct PerfRegion
+{
+    const char* name;
+    uint64_t    calls;
+    uint64_t    time_ns;
+    uint64_t    values[PERF_COUNTER_COUNT];
+};
+
+static const char* const counter_names[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "L1D-miss", "LLC-miss", "branch-miss"};
+
+static PerfRegion      regions[PERF_MAX_REGIONS];
+static int             region_count;
+static int             counters_available = -1;   // -1 未知, 取第一个线程的结果用于报表
+static int             counter_present[PERF_COUNTER_COUNT];
+static pthread_mutex_t regions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 每个线程一组计数器, 以 cycles 为组长, 一次 read 读出整组
+typedef struct
+{
+    int opened;
+    int leader_fd;
+    int fds[PERF_COUNTER_COUNT];
+    int slot[PERF_COUNTER_COUNT];   // 在组读取结果中的位置, -1 表示该计数器不可用
+    int members;
+} ThreadCounters;
+
+static __thread ThreadCounters thread_counters;
+static __thread PerfScope*     current_scope;   // 本线程最内层的作用域
+
+// 线程退出时关闭它的计数器
+static pthread_key_t  counters_key;
+static pthread_once_t counters_key_once = PTHREAD_ONCE_INIT;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__linux__)
+static int open_counter(uint32_t type, uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+static void close_thread_counters(void* arg)
+{
+    ThreadCounters* tc = (ThreadCounters*)arg;
+#if defined(__linux__)
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (tc->fds[i] >= 0) close(tc->fds[i]);
+        tc->fds[i]  = -1;
+        tc->slot[i] = -1;
+    }
+#endif
+    // opened 保持为 1, 退出过程中再被调用也不会重新打开
+    tc->leader_fd = -1;
+    tc->members   = 0;
+}
+
+static void create_counters_key(void)
+{
+    pthread_key_create(&counters_key, close_thread_counters);
+}
+
+static void open_thread_counters(ThreadCounters* tc)
+{
+    tc->opened    = 1;
+    tc->leader_fd = -1;
+    tc->members   = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        tc->fds[i]  = -1;
+        tc->slot[i] = -1;
+    }
+
+#if defined(__linux__)
+    static const struct
+    {
+        uint32_t type;
+        uint64_t config;
+    } events[PERF_COUNTER_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE,
+         PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        int fd = open_counter(events[i].type, events[i].config, tc->leader_fd);
+        if (fd < 0) {
+            // 组长打不开就整体放弃, 组员打不开只缺这一项
+            if (i == PERF_COUNTER_CYCLES) break;
+            continue;
+        }
+        if (tc->leader_fd < 0) tc->leader_fd = fd;
+        tc->fds[i]  = fd;
+        tc->slot[i] = tc->members++;
+    }
+
+    if (tc->leader_fd >= 0) {
+        ioctl(tc->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(tc->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        pthread_once(&counters_key_once, create_counters_key);
+        pthread_setspecific(counters_key, tc);
+    }
+#endif
+
+    pthread_mutex_lock(&regions_lock);
+    if (counters_available < 0) {
+        counters_available = tc->leader_fd >= 0;
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) counter_present[i] = tc->slot[i] >= 0;
+    }
+    pthread_mutex_unlock(&regions_lock);
+}
+
+static void read_thread_counters(uint64_t values[PERF_COUNTER_COUNT])
+{
+    ThreadCounters* tc = &thread_counters;
+    if (!tc->opened) open_thread_counters(tc);
+
+    memset(values, 0, sizeof(uint64_t) * PERF_COUNTER_COUNT);
+#if defined(__linux__)
+    if (tc->leader_fd < 0) return;
+
+    // PERF_FORMAT_GROUP: { nr, value[nr] }
+    uint64_t buf[1 + PERF_COUNTER_COUNT];
+    if (read(tc->leader_fd, buf, sizeof(uint64_t) * (1 + tc->members)) <= 0) return;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (tc->slot[i] >= 0) values[i] = buf[1 + tc->slot[i]];
+    }
+#endif
+}
+
+PerfRegion* perf_region_get(const char* name)
+{
+    PerfRegion* region = NULL;
+
+    pthread_mutex_lock(&regions_lock);
+    for (int i = 0; i < region_count; i++) {
+        if (regions[i].name == name || strcmp(regions[i].name, name) == 0) {
+            region = &regions[i];
+            break;
+        }
+    }
+    if (!region && region_count < PERF_MAX_REGIONS) {
+        if (region_count == 0) atexit(perf_regions_report);
+        region       = &regions[region_count++];
+        region->name = name;
+    }
+    pthread_mutex_unlock(&regions_lock);
+    return region;
+}
+
+void perf_scope_begin(PerfScope* scope, const char* name)
+{
+    scope->region = perf_region_get(name);
+    scope->parent = current_scope;
+    memset(scope->forwarded, 0, sizeof(scope->forwarded));
+    current_scope = scope;
+    read_thread_counters(scope->values);
+    scope->time_ns = now_ns();
+}
+
+void perf_scope_end(PerfScope* scope)
+{
+    uint64_t end_time = now_ns();
+    uint64_t values[PERF_COUNTER_COUNT];
+    read_thread_counters(values);
+
+    if (current_scope == scope) current_scope = scope->parent;
+
+    // owner 结束时线程池的行带都已完成, 但转记和这里仍可能并发(不同的 owner), 统一加锁
+    pthread_mutex_lock(&regions_lock);
+    PerfRegion* region = scope->region;
+    if (region) {
+        region->calls++;
+        region->time_ns += end_time - scope->time_ns;
+    }
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (region) region->values[i] += values[i] - scope->values[i] + scope->forwarded[i];
+        // 外层作用域在本线程上的计数已包含这段时间, 只需再加上其他线程转记的部分
+        if (scope->parent) scope->parent->forwarded[i] += scope->forwarded[i];
+    }
+    pthread_mutex_unlock(&regions_lock);
+}
+
+PerfScope* perf_scope_current(void)
+{
+    return current_scope;
+}
+
+void perf_scope_forward_begin(PerfScope* scope, PerfScope* owner)
+{
+    scope->region = NULL;
+    scope->parent = current_scope ? NULL : owner;
+    if (scope->parent) read_thread_counters(scope->values);
+}
+
+void perf_scope_forward_end(PerfScope* scope)
+{
+    PerfScope* owner = scope->parent;
+    if (!owner) return;
+
+    uint64_t values[PERF_COUNTER_COUNT];
+    read_thread_counters(values);
+
+    pthread_mutex_lock(&regions_lock);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        owner->forwarded[i] += values[i] - scope->values[i];
+    }
+    pthread_mutex_unlock(&regions_lock);
+}
+
+void perf_regions_report(void)
+{
+    pthread_mutex_lock(&regions_lock);
+    if (region_count == 0) {
+        pthread_mutex_unlock(&regions_lock);
+        return;
+    }
+
+    fprintf(stderr, "\n==== perf regions ====\n");
+    if (counters_available != 1) {
+        fprintf(stderr,
+                "hardware counters unavailable (check /proc/sys/kernel/perf_event_paranoid), "
+                "time only\n");
+    }
+    fprintf(stderr, "%-28s %8s %12s %10s", "region", "calls", "total(ms)", "avg(us)");
+    if (counters_available == 1) {
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) fprintf(stderr, " %14s", counter_names[i]);
+        fprintf(stderr, " %6s", "IPC");
+    }
+    fprintf(stderr, "\n");
+
+    for (int r = 0; r < region_count; r++) {
+        const PerfRegion* region = &regions[r];
+        fprintf(stderr,
+                "%-28s %8llu %12.3f %10.2f",
+                region->name,
+                (unsigned long long)region->calls,
+                region->time_ns / 1e6,
+                region->calls ? region->time_ns / 1e3 / region->calls : 0.0);
+        if (counters_available == 1) {
+            for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+                if (counter_present[i]) {
+                    fprintf(stderr, " %14llu", (unsigned long long)region->values[i]);
+                }
+                else {
+                    fprintf(stderr, " %14s", "n/a");
+                }
+            }
+            uint64_t cycles = region->values[PERF_COUNTER_CYCLES];
+            fprintf(stderr,
+                    " %6.2f",
+                    cycles ? (double)region->values[PERF_COUNTER_INSTRUCTIONS] / cycles : 0.0);
+        }
+        fprintf(stderr, "\n");
+    }
+    pthread_mutex_unlock(&regions_lock);
+}
@@ -0,0 +1,99 @@
+#ifndef PERF_REGIONS_H
+#define PERF_REGIONS_H
+
+// 命名区域的硬件计数器统计(Linux perf_event_open).
+// 每个区域累计调用次数、耗时、cycles、instructions、L1D/LLC miss 和分支预测失败,
+// 进程退出时打印汇总表. 计数器不可用时(权限不足、虚拟机、非 Linux)只统计耗时.
+// 计数器按线程打开, 区域内交给 thread_pool 其他线程执行的行带由线程池转记回来
+// (perf_scope_forward_begin/end), 所以多线程内核的 cycles/miss 是所有线程之和;
+// 自己起线程、不经过 thread_pool 的工作仍只统计调用 begin/end 的线程.
+//
+// 用法:
+//   PERF_SCOPE_BEGIN(scope, "affine_transform");
+//   ...
+//   PERF_SCOPE_END(scope);
+// C++ 中可直接用 PERF_SCOPE("detectMultiScale"), 离开作用域时结束.
+// 不定义 WITH_PERF_REGIONS 时宏为空.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_L1D_MISSES,
+    PERF_COUNTER_LLC_MISSES,
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+typedef struct PerfRegion PerfRegion;
+
+typedef struct PerfScope PerfScope;
+struct PerfScope
+{
+    PerfRegion* region;
+    PerfScope*  parent;   // 同一线程上外层的作用域; 转记时为目标作用域
+    uint64_t    time_ns;
+    uint64_t    values[PERF_COUNTER_COUNT];
+    uint64_t    forwarded[PERF_COUNTER_COUNT];   // 其他线程替本作用域执行时的计数
+};
+
+// 按名字查找或注册区域, name 需为静态字符串
+PerfRegion* perf_region_get(const char* name);
+
+void perf_scope_begin(PerfScope* scope, const char* name);
+void perf_scope_end(PerfScope* scope);
+
+// 供线程池使用: 提交行带时取提交线程最内层的作用域(没有时为 NULL),
+// 其他线程执行行带前后调用 forward_begin/end, 把这段计数器增量记到 owner,
+// 随 owner 结束时计入它和外层的区域. 执行线程自己有打开的作用域时不转记(已由它统计)
+PerfScope* perf_scope_current(void);
+void       perf_scope_forward_begin(PerfScope* scope, PerfScope* owner);
+void       perf_scope_forward_end(PerfScope* scope);
+
+// 立即打印汇总表(退出时会自动打印一次)
+void perf_regions_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(WITH_PERF_REGIONS)
+#    define PERF_SCOPE_BEGIN(var, name)                                                            \
+        PerfScope var;                                                                             \
+        perf_scope_begin(&var, name)
+#    define PERF_SCOPE_END(var) perf_scope_end(&var)
+#else
+#    define PERF_SCOPE_BEGIN(var, name) ((void)0)
+#    define PERF_SCOPE_END(var)         ((void)0)
+#endif
+
+#ifdef __cplusplus
+class PerfScopeGuard
+{
+public:
+    explicit PerfScopeGuard(const char* name) { perf_scope_begin(&scope_, name); }
+    ~PerfScopeGuard() { perf_scope_end(&scope_); }
+
+private:
+    PerfScopeGuard(const PerfScopeGuard&);
+    PerfScopeGuard& operator=(const PerfScopeGuard&);
+
+    PerfScope scope_;
+};
+
+#    define PERF_CONCAT_(a, b) a##b
+#    define PERF_CONCAT(a, b)  PERF_CONCAT_(a, b)
+#    if defined(WITH_PERF_REGIONS)
+#        define PERF_SCOPE(name) PerfScopeGuard PERF_CONCAT(perf_scope_, __LINE__)(name)
+#    else
+#        define PERF_SCOPE(name) ((void)0)
+#    endif
+#endif
+
+#endif   // PERF_REGIONS_H
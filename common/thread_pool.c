@@ -0,0 +1,401 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE
+#endif
+
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#    include <sched.h>
+#endif
+
+#if defined(WITH_PERF_REGIONS)
+#    include "perf_regions.h"
+#endif
+
+// 一次 parallel_for 的全部行带, 计数归零即完成
+typedef struct
+{
+    atomic_int pending;
+} TaskGroup;
+
+typedef struct
+{
+    ThreadPoolBandFn fn;
+    void*            ctx;
+    int              begin;
+    int              end;
+    TaskGroup*       group;
+#if defined(WITH_PERF_REGIONS)
+    PerfScope*       perf_owner;   // 提交线程当时的作用域, 别的线程执行时计数器转记给它
+#endif
+} Task;
+
+// 加锁的环形双端队列: 所属线程从尾部取(后进先出, 缓存更热), 窃取者从头部取
+typedef struct
+{
+    pthread_mutex_t lock;
+    Task*           tasks;
+    int             capacity;
+    int             head;
+    int             count;
+} TaskDeque;
+
+struct ThreadPool
+{
+    int        num_threads;   // 参与计算的线程数, 含调用线程
+    int        num_workers;   // 后台工作线程数 = num_threads - 1
+    pthread_t* threads;
+    TaskDeque* deques;        // 每个工作线程一个
+    int        num_deques;
+    atomic_int queued;        // 所有队列中尚未取走的任务数
+    atomic_int next_deque;    // 外部线程提交时的起始队列, 轮转分配
+
+    pthread_mutex_t lock;   // 保护 stop, 与 cond 配合用于休眠/唤醒
+    pthread_cond_t  cond;   // 有新任务或某个任务组完成时广播
+    int             stop;
+};
+
+typedef struct
+{
+    ThreadPool* pool;
+    int         index;
+} WorkerArg;
+
+// 当前线程所属的线程池和队列编号, 外部线程为 NULL / -1
+static __thread ThreadPool* current_pool;
+static __thread int         current_worker = -1;
+
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static ThreadPool*    default_pool;
+
+// 返回 0 成功; 队列扩容失败返回 -1, 任务未入队
+static int deque_push(TaskDeque* dq, const Task* task, atomic_int* queued)
+{
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->capacity) {
+        int   capacity = dq->capacity ? dq->capacity * 2 : 64;
+        Task* tasks    = (Task*)malloc(sizeof(Task) * capacity);
+        if (!tasks) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        for (int i = 0; i < dq->count; i++) tasks[i] = dq->tasks[(dq->head + i) % dq->capacity];
+        free(dq->tasks);
+        dq->tasks    = tasks;
+        dq->capacity = capacity;
+        dq->head     = 0;
+    }
+    dq->tasks[(dq->head + dq->count) % dq->capacity] = *task;
+    dq->count++;
+    // 在释放队列锁之前计数, 保证 queued 不会因先取后加而变成负数
+    atomic_fetch_add(queued, 1);
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+static int deque_pop_back(TaskDeque* dq, Task* task)
+{
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        dq->count--;
+        *task = dq->tasks[(dq->head + dq->count) % dq->capacity];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static int deque_steal_front(TaskDeque* dq, Task* task)
+{
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        *task    = dq->tasks[dq->head];
+        dq->head = (dq->head + 1) % dq->capacity;
+        dq->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+// 先取自己的队列, 再依次窃取其他队列
+static int find_task(ThreadPool* pool, int self, Task* task)
+{
+    if (atomic_load(&pool->queued) == 0) return 0;
+
+    int n     = pool->num_workers;
+    int start = self;
+    if (self >= 0) {
+        if (deque_pop_back(&pool->deques[self], task)) goto found;
+    }
+    else {
+        start = atomic_load(&pool->next_deque) % n;
+    }
+
+    for (int i = self >= 0 ? 1 : 0; i < n; i++) {
+        if (deque_steal_front(&pool->deques[(start + i) % n], task)) goto found;
+    }
+    return 0;
+
+found:
+    atomic_fetch_sub(&pool->queued, 1);
+    return 1;
+}
+
+static void run_task(ThreadPool* pool, const Task* task)
+{
+#if defined(WITH_PERF_REGIONS)
+    PerfScope forward;
+    perf_scope_forward_begin(&forward, task->perf_owner);
+    task->fn(task->ctx, task->begin, task->end);
+    perf_scope_forward_end(&forward);
+#else
+    task->fn(task->ctx, task->begin, task->end);
+#endif
+
+    // 最后一个行带完成后唤醒等待者. 之后不能再访问 group, 它在等待者的栈上
+    if (atomic_fetch_sub(&task->group->pending, 1) == 1) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    WorkerArg   worker = *(WorkerArg*)arg;
+    ThreadPool* pool   = worker.pool;
+    free(arg);
+
+    current_pool   = pool;
+    current_worker = worker.index;
+
+    for (;;) {
+        Task task;
+        if (find_task(pool, worker.index, &task)) {
+            run_task(pool, &task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        int stop = pool->stop && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+int thread_pool_physical_cores(void)
+{
+    long logical = sysconf(_SC_NPROCESSORS_ONLN);
+    if (logical < 1) logical = 1;
+
+#if defined(__linux__)
+    cpu_set_t affinity;
+    int       allowed = (int)logical;
+    if (sched_getaffinity(0, sizeof(affinity), &affinity) == 0) allowed = CPU_COUNT(&affinity);
+
+    // (package, core) 去重, 超线程的兄弟逻辑核只算一次
+    long conf  = sysconf(_SC_NPROCESSORS_CONF);
+    int* ids   = (int*)malloc(sizeof(int) * 2 * (conf > 0 ? conf : 1));
+    int  cores = 0;
+    for (long cpu = 0; ids && cpu < conf; cpu++) {
+        char path[128];
+        int  package = -1, core = -1;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/topology/core_id", cpu);
+        FILE* fp = fopen(path, "r");
+        if (!fp) continue;
+        if (fscanf(fp, "%d", &core) != 1) core = -1;
+        fclose(fp);
+
+        snprintf(path,
+                 sizeof(path),
+                 "/sys/devices/system/cpu/cpu%ld/topology/physical_package_id",
+                 cpu);
+        fp = fopen(path, "r");
+        if (fp) {
+            if (fscanf(fp, "%d", &package) != 1) package = -1;
+            fclose(fp);
+        }
+        if (core < 0) continue;
+
+        int seen = 0;
+        for (int i = 0; i < cores && !seen; i++) {
+            seen = ids[2 * i] == package && ids[2 * i + 1] == core;
+        }
+        if (!seen) {
+            ids[2 * cores]     = package;
+            ids[2 * cores + 1] = core;
+            cores++;
+        }
+    }
+    free(ids);
+
+    if (cores < 1) cores = (int)logical;
+    return cores < allowed ? cores : allowed;
+#else
+    return (int)logical;
+#endif
+}
+
+static int default_thread_count(void)
+{
+    const char* env = getenv("THREAD_POOL_SIZE");
+    if (env && atoi(env) > 0) return atoi(env);
+    return thread_pool_physical_cores();
+}
+
+ThreadPool* thread_pool_create(int num_threads)
+{
+    if (num_threads <= 0) num_threads = default_thread_count();
+
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+
+    pool->num_threads = num_threads;
+    pool->num_workers = num_threads - 1;
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->next_deque, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    if (pool->num_workers > 0) {
+        pool->num_deques = pool->num_workers;
+        pool->deques     = (TaskDeque*)calloc(pool->num_deques, sizeof(TaskDeque));
+        pool->threads    = (pthread_t*)calloc(pool->num_workers, sizeof(pthread_t));
+        for (int i = 0; i < pool->num_deques; i++) pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+        for (int i = 0; i < pool->num_workers; i++) {
+            WorkerArg* arg = (WorkerArg*)malloc(sizeof(WorkerArg));
+            arg->pool      = pool;
+            arg->index     = i;
+            if (pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0) {
+                // 建不出来就按已有线程数运行
+                free(arg);
+                pool->num_workers = i;
+                pool->num_threads = i + 1;
+                break;
+            }
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool* pool)
+{
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_workers; i++) pthread_join(pool->threads[i], NULL);
+
+    // 按创建时的数量释放, 创建线程失败时 num_workers 会比它小
+    for (int i = 0; i < pool->num_deques; i++) {
+        free(pool->deques[i].tasks);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    free(pool->deques);
+    free(pool->threads);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int thread_pool_size(const ThreadPool* pool)
+{
+    return pool ? pool->num_threads : 1;
+}
+
+static void destroy_default_pool(void)
+{
+    thread_pool_destroy(default_pool);
+    default_pool = NULL;
+}
+
+static void create_default_pool(void)
+{
+    default_pool = thread_pool_create(0);
+    atexit(destroy_default_pool);
+}
+
+ThreadPool* thread_pool_default(void)
+{
+    pthread_once(&default_once, create_default_pool);
+    return default_pool;
+}
+
+void thread_pool_parallel_for(ThreadPool* pool, int begin, int end, int grain, ThreadPoolBandFn fn,
+                              void* ctx)
+{
+    if (end <= begin) return;
+    if (grain < 1) grain = 1;
+    if (!pool) pool = thread_pool_default();
+
+    int bands = (end - begin + grain - 1) / grain;
+
+    // 单线程或只有一个行带时直接在本线程按同样的切分执行
+    if (!pool || pool->num_workers == 0 || bands == 1) {
+        for (int b = begin; b < end; b += grain) fn(ctx, b, b + grain < end ? b + grain : end);
+        return;
+    }
+
+    TaskGroup group;
+    atomic_init(&group.pending, bands);
+
+    int self = current_pool == pool ? current_worker : -1;
+    int n    = pool->num_workers;
+    int base = atomic_fetch_add(&pool->next_deque, 1);
+
+    // 工作线程内嵌套调用时全部放进自己的队列, 其他线程来窃取;
+    // 外部线程按连续的段分给各队列, 相邻行带尽量落在同一线程上
+    for (int i = 0; i < bands; i++) {
+        Task task;
+        task.fn    = fn;
+        task.ctx   = ctx;
+        task.begin = begin + i * grain;
+        task.end   = task.begin + grain < end ? task.begin + grain : end;
+        task.group = &group;
+#if defined(WITH_PERF_REGIONS)
+        task.perf_owner = perf_scope_current();
+#endif
+
+        int target = self >= 0 ? self : (base + (int)((long)i * n / bands)) % n;
+        // 入队失败时在本线程直接执行这个行带
+        if (deque_push(&pool->deques[target], &task, &pool->queued) != 0) run_task(pool, &task);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    // 调用线程一起干活, 直到本组全部完成
+    while (atomic_load(&group.pending) > 0) {
+        Task task;
+        if (find_task(pool, self, &task)) {
+            run_task(pool, &task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (atomic_load(&group.pending) > 0 && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// 所有图像内核共用的工作窃取线程池(pthread).
+// 每个工作线程有自己的任务双端队列, 自己从尾部取, 空闲时从其他线程头部窃取;
+// 调用 thread_pool_parallel_for 的线程也参与执行, 等待期间不会空转.
+// 任务按固定的行带(grain)切分, 切分方式与线程数无关, 每个行带只写自己的输出行,
+// 因此结果与线程数、调度顺序无关.
+//
+// 线程数默认取物理核数, 可用环境变量 THREAD_POOL_SIZE 覆盖(1 表示串行).
+// 定义 WITH_PERF_REGIONS 时, 行带在其他线程上的计数器增量记回提交线程当时的
+// perf 区域(见 perf_regions.h), 此时需要同时链接 perf_regions.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ThreadPool ThreadPool;
+
+// 处理 [begin, end) 行带
+typedef void (*ThreadPoolBandFn)(void* ctx, int begin, int end);
+
+// num_threads 为参与计算的线程总数(含调用线程), <= 0 时取默认值
+ThreadPool* thread_pool_create(int num_threads);
+void        thread_pool_destroy(ThreadPool* pool);
+int         thread_pool_size(const ThreadPool* pool);
+
+// 进程内共享的线程池, 首次调用时创建, 退出时销毁
+ThreadPool* thread_pool_default(void);
+
+// 物理核数(读取 /sys 拓扑失败时退化为在线逻辑核数)
+int thread_pool_physical_cores(void);
+
+// 把 [begin, end) 按 grain 切成行带并行执行 fn, 返回时全部行带已完成.
+// pool 为 NULL 时使用 thread_pool_default(). 可在任务内部嵌套调用.
+void thread_pool_parallel_for(ThreadPool* pool, int begin, int end, int grain, ThreadPoolBandFn fn,
+                              void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // THREAD_POOL_H
@@ -0,0 +1,112 @@
+#include "alloc_counter.hpp"
+
+#include <errno.h>
+#include <stdlib.h>   // defines __GLIBC__
+#include <sys/resource.h>
+
+#if defined(WITH_ALLOC_COUNTER) && defined(__GLIBC__)
+
+#include <malloc.h>
+
+// The counters live in the executable's static TLS block, so touching them
+// from inside malloc never allocates.
+static __thread unsigned long long tCounted;
+static __thread unsigned long long tExcluded;
+static __thread int tExcludeDepth;
+
+static inline void countAllocation() {
+    if (tExcludeDepth) {
+        tExcluded++;
+    } else {
+        tCounted++;
+    }
+}
+
+// Declarations match glibc's (__THROW), the definitions replace libc's.
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) __THROW {
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) __THROW {
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) __THROW {
+    countAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) __THROW {
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) __THROW {
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) __THROW {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    countAllocation();
+    void *p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr) __THROW {
+    __libc_free(ptr);
+}
+
+}  // extern "C"
+
+bool allocCounterEnabled() {
+    return true;
+}
+
+AllocCount threadAllocCount() {
+    AllocCount count = {tCounted, tExcluded};
+    return count;
+}
+
+AllocExcludeScope::AllocExcludeScope() {
+    tExcludeDepth++;
+}
+
+AllocExcludeScope::~AllocExcludeScope() {
+    tExcludeDepth--;
+}
+
+#else
+
+bool allocCounterEnabled() {
+    return false;
+}
+
+AllocCount threadAllocCount() {
+    AllocCount count = {0, 0};
+    return count;
+}
+
+AllocExcludeScope::AllocExcludeScope() {}
+
+AllocExcludeScope::~AllocExcludeScope() {}
+
+#endif
+
+size_t peakRssBytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (size_t) usage.ru_maxrss * 1024;   // kilobytes on Linux
+}
@@ -0,0 +1,37 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+// Per-thread heap allocation counts, used to check that steady-state
+// detection doesn't allocate. Only built with WITH_ALLOC_COUNTER (glibc):
+// alloc_counter.cpp then interposes malloc, calloc, realloc and the aligned
+// variants, which also covers operator new and cv::fastMalloc. Otherwise
+// allocCounterEnabled() is false and the counts stay 0.
+
+#include <stddef.h>
+
+struct AllocCount {
+    unsigned long long counted;    // allocations outside AllocExcludeScope
+    unsigned long long excluded;   // allocations inside one
+};
+
+bool allocCounterEnabled();
+
+// Allocations made by the calling thread so far.
+AllocCount threadAllocCount();
+
+// Peak resident set size of the process (getrusage), 0 if unavailable.
+size_t peakRssBytes();
+
+// Marks third-party code whose allocations we can't avoid (the cascade
+// internals); they are counted separately instead of as ours.
+class AllocExcludeScope {
+public:
+    AllocExcludeScope();
+    ~AllocExcludeScope();
+
+private:
+    AllocExcludeScope(const AllocExcludeScope &);
+    AllocExcludeScope &operator=(const AllocExcludeScope &);
+};
+
+#endif  // ALLOC_COUNTER_HPP
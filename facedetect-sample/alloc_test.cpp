@@ -0,0 +1,68 @@
+// Runs a still image through DetectorContext frame after frame and fails if
+// steady-state detection allocates (see alloc_counter.hpp). Built and
+// registered with ctest only with WITH_ALLOC_COUNTER.
+//
+// Usage: alloc_test <face cascade> <nested cascade> <image>
+
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+#include "alloc_counter.hpp"
+#include "detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const int kFrames = DetectorContext::kWarmupFrames + 20;
+
+// Every frame of the motion-gated pass alternates between frames[0] and
+// frames[1], so the gate hands the detector changed regions instead of
+// skipping.
+static bool run(const char *name, bool motionGate, const Mat *frames,
+                CascadeClassifier &cascade, CascadeClassifier &nestedCascade) {
+    DetectorContext detector(1, false, motionGate);
+    for (int i = 0; i < kFrames; i++) detector.detect(frames[i % 2], cascade, nestedCascade);
+
+    const DetectorContext::AllocStats &stats = detector.allocStats();
+    printf("%s: ", name);
+    detector.printAllocStats();
+    if (stats.frames == 0 || stats.allocs != 0) {
+        cerr << name << ": steady-state detection allocated" << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, const char **argv) {
+    if (argc != 4) {
+        cerr << "Usage: " << argv[0] << " <face cascade> <nested cascade> <image>" << endl;
+        return 1;
+    }
+    if (!allocCounterEnabled()) {
+        cerr << "ERROR: alloc_test needs a build with WITH_ALLOC_COUNTER (glibc)" << endl;
+        return 1;
+    }
+    CascadeClassifier cascade, nestedCascade;
+    if (!cascade.load(argv[1]) || !nestedCascade.load(argv[2])) {
+        cerr << "ERROR: Could not load the cascades" << endl;
+        return 1;
+    }
+    Mat frames[2];
+    frames[0] = imread(argv[3], IMREAD_COLOR);
+    if (frames[0].empty()) {
+        cerr << "ERROR: Could not read " << argv[3] << endl;
+        return 1;
+    }
+    // A block in one corner changes between the two frames.
+    frames[0].copyTo(frames[1]);
+    rectangle(frames[1], Rect(0, 0, frames[1].cols / 4, frames[1].rows / 4), Scalar::all(0),
+              FILLED);
+
+    bool ok = run("full frame", false, frames, cascade, nestedCascade);
+    ok = run("motion gate", true, frames, cascade, nestedCascade) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+#include "detector.hpp"
+
+#include "opencv2/imgproc.hpp"
+
+#include <cstdio>
+
+#include "alloc_counter.hpp"
+#include "nv21_simd.h"
+#include "perf_regions.h"
+#include "scale_controller.hpp"
+#include "tile_detector.hpp"
+#include "two_tier_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+// Capacity reserved up front for the face lists; more faces than this in one
+// frame grow the vectors once and they stay grown.
+static const size_t kReservedFaces = 32;
+
+// Eyes lie in the upper part of the face box and are roughly a fifth of its
+// width wide, so the nested search covers only that band and size range
+// instead of the whole box at every scale. In split mode the two halves
+// overlap a little around the nose.
+static const double kEyeBandTop = 0.1;
+static const double kEyeBandBottom = 0.6;
+static const double kEyeMinWidth = 0.12;
+static const double kEyeMaxWidth = 0.4;
+static const double kEyeHalfOverlap = 0.05;
+static const int kMinEye = 30;
+// The eye search runs on a small band with a bounded size range, so the
+// cascade can afford the fine pyramid step.
+static const double kEyeScaleFactor = 1.1;
+static const int kEyeMinNeighbors = 2;
+
+// Margin around a previous face when a changed region is grown over it, as a
+// fraction of the face's size: the face may have moved a little.
+static const double kFacePad = 0.25;
+
+static bool intersectsAny(const Rect &r, const vector<Rect> &regions) {
+    for (size_t i = 0; i < regions.size(); i++) {
+        if ((r & regions[i]).area() > 0) return true;
+    }
+    return false;
+}
+
+// The gate's regions only add one block of margin around the changed blocks,
+// which doesn't hold a face larger than that when only part of it moved (the
+// mouth, the eyes). Grows every region over the padded previous faces it
+// touches and merges regions that end up overlapping, until nothing changes.
+// Works in place: no allocations once regions has its capacity.
+static void coverFaces(vector<Rect> &regions, const vector<Rect> &faces, const Rect &bounds) {
+    bool grown = true;
+    while (grown) {
+        grown = false;
+        for (size_t i = 0; i < regions.size(); i++) {
+            for (size_t j = 0; j < faces.size(); j++) {
+                const Rect &f = faces[j];
+                if ((regions[i] & f).area() == 0) continue;
+                int pad = cvRound(max(f.width, f.height) * kFacePad);
+                Rect r = (regions[i] | Rect(f.x - pad, f.y - pad, f.width + 2 * pad,
+                                            f.height + 2 * pad)) & bounds;
+                if (r != regions[i]) {
+                    regions[i] = r;
+                    grown = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < regions.size(); i++) {
+            for (size_t j = i + 1; j < regions.size();) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + j);
+                    grown = true;
+                    j = i + 1;
+                } else {
+                    j++;
+                }
+            }
+        }
+    }
+}
+
+DetectorContext::DetectorContext(double scale, bool tryflip, bool motionGate,
+                                 double motionThreshold)
+    : scale_(scale), scaleFactor_(1.1), tryflip_(tryflip), motionGate_(motionGate),
+      tiles_(NULL), twoTier_(NULL), controller_(NULL), eyeSplit_(NULL), gate_(motionThreshold),
+      frames_(0) {
+    found_.reserve(kReservedFaces);
+    eyes_.reserve(kReservedFaces);
+    result_.faces.reserve(kReservedFaces);
+    result_.nested.reserve(kReservedFaces);
+    gate_.faces.reserve(kReservedFaces);
+    gate_.nested.reserve(kReservedFaces);
+    result_.scale = scale;
+    result_.ms = 0;
+    result_.skipped = false;
+    result_.regions = 0;
+    allocStats_.frames = 0;
+    allocStats_.allocs = 0;
+    allocStats_.cascadeAllocs = 0;
+}
+
+// Face cascade on img into found_, in one call, behind the LBP proposals or
+// spread over the tiles. Motion-gate regions are small and change size every
+// frame, so only the whole frame goes through the tiles.
+void DetectorContext::runCascade(const Mat &img, CascadeClassifier &cascade) {
+    if (twoTier_) {
+        twoTier_->detect(img, cascade, found_, scaleFactor_);
+        return;
+    }
+    if (tiles_ && img.size() == preprocessor_.image().size()) {
+        tiles_->detect(img, cascade, found_, scaleFactor_);
+        return;
+    }
+    AllocExcludeScope cascadeAllocs;
+    cascade.detectMultiScale(img,
+                             found_,
+                             scaleFactor_,
+                             kFaceMinNeighbors,
+                             0
+                             //|CASCADE_FIND_BIGGEST_OBJECT
+                             //|CASCADE_DO_ROUGH_SEARCH
+                             | CASCADE_SCALE_IMAGE,
+                             Size(kMinFaceSize, kMinFaceSize));
+}
+
+// Runs the face cascade on the preprocessed image's roi and appends the hits
+// in detection-image coordinates.
+void DetectorContext::detectFaces(const Rect &roi, CascadeClassifier &cascade) {
+    Mat roiImg = preprocessor_.image()(roi);
+    vector<Rect> &faces = result_.faces;
+    {
+        PERF_SCOPE("detectMultiScale");
+        runCascade(roiImg, cascade);
+    }
+    for (vector<Rect>::const_iterator r = found_.begin(); r != found_.end(); ++r) {
+        faces.push_back(*r + roi.tl());
+    }
+    if (tryflip_) {
+        PERF_SCOPE("detectMultiScale(flip)");
+        // Mirrored in place and back afterwards, the nested search and the
+        // motion gate still need the original. Each pass costs about a
+        // memcpy, and there is no flip buffer to keep per stream.
+        flip_plane(roiImg.data, roi.width, roi.height, roiImg.step, 1, 1, 0);
+        runCascade(roiImg, cascade);
+        flip_plane(roiImg.data, roi.width, roi.height, roiImg.step, 1, 1, 0);
+        for (vector<Rect>::const_iterator r = found_.begin(); r != found_.end(); ++r) {
+            faces.push_back(
+                Rect(roi.x + roi.width - r->x - r->width, roi.y + r->y, r->width, r->height));
+        }
+    }
+}
+
+// Nested cascade on roi of the face image, hits appended relative to the face.
+void DetectorContext::searchEyes(const Mat &faceImg, const Rect &roi, CascadeClassifier &cascade,
+                                 int minSide, int maxSide, vector<Rect> &eyes) {
+    maxSide = min(maxSide, min(roi.width, roi.height));
+    if (maxSide < minSide) return;
+    {
+        AllocExcludeScope cascadeAllocs;
+        cascade.detectMultiScale(faceImg(roi),
+                                 eyes_,
+                                 kEyeScaleFactor,
+                                 kEyeMinNeighbors,
+                                 0
+                                 //|CASCADE_FIND_BIGGEST_OBJECT
+                                 //|CASCADE_DO_ROUGH_SEARCH
+                                 //|CASCADE_DO_CANNY_PRUNING
+                                 | CASCADE_SCALE_IMAGE,
+                                 Size(minSide, minSide),
+                                 Size(maxSide, maxSide));
+    }
+    for (size_t i = 0; i < eyes_.size(); i++) eyes.push_back(eyes_[i] + roi.tl());
+}
+
+void DetectorContext::detectNested(size_t face, CascadeClassifier &nestedCascade) {
+    vector<Rect> &nestedObjects = result_.nested[face];
+    nestedObjects.clear();
+    if (nestedCascade.empty()) return;
+    const Rect &r = result_.faces[face];
+    Mat faceImg = preprocessor_.image()(r);
+    int top = cvRound(r.height * kEyeBandTop);
+    Rect band(0, top, r.width, cvRound(r.height * kEyeBandBottom) - top);
+    int minSide = max(kMinEye, cvRound(r.width * kEyeMinWidth));
+    int maxSide = cvRound(r.width * kEyeMaxWidth);
+    PERF_SCOPE("detectMultiScale(nested)");
+    if (!eyeSplit_ || eyeSplit_->empty()) {
+        searchEyes(faceImg, band, nestedCascade, minSide, maxSide, nestedObjects);
+        return;
+    }
+    int split = r.width / 2;
+    int overlap = cvRound(r.width * kEyeHalfOverlap);
+    Rect left(0, band.y, split + overlap, band.height);
+    Rect right(split - overlap, band.y, r.width - split + overlap, band.height);
+    searchEyes(faceImg, left, nestedCascade, minSide, maxSide, nestedObjects);
+    searchEyes(faceImg, right, *eyeSplit_, minSide, maxSide, nestedObjects);
+}
+
+const DetectionResult &DetectorContext::detect(const Mat &img, CascadeClassifier &cascade,
+                                               CascadeClassifier &nestedCascade) {
+    AllocCount before = threadAllocCount();
+    int64 start = getTickCount();
+    if (controller_) {
+        double scale = controller_->scale();
+        // A new scale regrows the preprocessing and motion gate buffers, so
+        // the next frames are warm-up again rather than steady state.
+        if (scale != scale_) frames_ = 0;
+        scale_ = scale;
+        scaleFactor_ = controller_->scaleFactor();
+    }
+
+    double t = 0;
+    vector<Rect> &faces = result_.faces;
+    vector<vector<Rect> > &nested = result_.nested;
+    faces.clear();
+    result_.ms = 0;
+
+    PERF_SCOPE_BEGIN(downscale, "preprocess");
+    Mat &smallImg = preprocessor_.downscale(img, scale_);
+    PERF_SCOPE_END(downscale);
+
+    // The gate compares the un-equalized plane: equalizeHist is global, so a
+    // change in one corner would otherwise shift every block.
+    changed_.clear();
+    bool analyse = true;
+    if (motionGate_) {
+        PERF_SCOPE("motion gate");
+        analyse = gate_.update(smallImg, changed_);
+    }
+
+    if (!analyse) {
+        gate_.recordSkip();
+        faces = gate_.faces;
+        if (nested.size() < faces.size()) nested.resize(faces.size());
+        for (size_t i = 0; i < faces.size(); i++) nested[i] = gate_.nested[i];
+    } else {
+        {
+            PERF_SCOPE("preprocess");
+            preprocessor_.equalize();
+        }
+
+        t = (double) getTickCount();
+        size_t kept = 0;
+        if (changed_.empty()) {
+            detectFaces(Rect(0, 0, smallImg.cols, smallImg.rows), cascade);
+        } else {
+            // Keep what was found outside the changed regions, re-detect inside.
+            coverFaces(changed_, gate_.faces, Rect(0, 0, smallImg.cols, smallImg.rows));
+            for (size_t i = 0; i < gate_.faces.size(); i++) {
+                if (intersectsAny(gate_.faces[i], changed_)) continue;
+                faces.push_back(gate_.faces[i]);
+                if (nested.size() < faces.size()) nested.resize(faces.size());
+                nested[kept++] = gate_.nested[i];
+            }
+            for (size_t i = 0; i < changed_.size(); i++) {
+                if (changed_[i].width < kMinFaceSize || changed_[i].height < kMinFaceSize) continue;
+                detectFaces(changed_[i], cascade);
+            }
+        }
+        t = (double) getTickCount() - t;
+        double ms = t * 1000 / getTickFrequency();
+        result_.ms = ms;
+
+        // Faces kept from the previous frame already carry their nested objects.
+        if (nested.size() < faces.size()) nested.resize(faces.size());
+        for (size_t i = kept; i < faces.size(); i++) detectNested(i, nestedCascade);
+
+        if (motionGate_) {
+            gate_.recordDetection(changed_.empty(), ms);
+            gate_.faces = faces;
+            if (gate_.nested.size() < faces.size()) gate_.nested.resize(faces.size());
+            for (size_t i = 0; i < faces.size(); i++) gate_.nested[i] = nested[i];
+        }
+    }
+
+    result_.scale = scale_;
+    result_.skipped = !analyse;
+    result_.regions = (int) changed_.size();
+    // A new scale changes the detection image size, which makes the motion
+    // gate start over with a full-frame detection.
+    if (controller_) {
+        controller_->record((getTickCount() - start) * 1000 / getTickFrequency());
+    }
+
+    AllocCount after = threadAllocCount();
+    if (++frames_ > kWarmupFrames) {
+        allocStats_.frames++;
+        allocStats_.allocs += after.counted - before.counted;
+        allocStats_.cascadeAllocs += after.excluded - before.excluded;
+    }
+    return result_;
+}
+
+size_t DetectorContext::bufferBytes() const {
+    size_t bytes = preprocessor_.bufferBytes() + found_.capacity() * sizeof(Rect) +
+                   changed_.capacity() * sizeof(Rect) + eyes_.capacity() * sizeof(Rect) +
+                   gate_.bufferBytes() +
+                   result_.faces.capacity() * sizeof(Rect) +
+                   result_.nested.capacity() * sizeof(vector<Rect>);
+    for (size_t i = 0; i < result_.nested.size(); i++) {
+        bytes += result_.nested[i].capacity() * sizeof(Rect);
+    }
+    return bytes;
+}
+
+void DetectorContext::printAllocStats() const {
+    if (!allocCounterEnabled()) {
+        printf("allocations: not counted (build with WITH_ALLOC_COUNTER)\n");
+        return;
+    }
+    const AllocStats &s = allocStats_;
+    printf("allocations: %llu in %ld steady-state frame(s) (%d warm-up per scale), "
+           "cascade internals %.1f/frame\n",
+           s.allocs,
+           s.frames,
+           kWarmupFrames,
+           s.frames ? (double) s.cascadeAllocs / s.frames : 0.0);
+}
@@ -0,0 +1,128 @@
+#ifndef DETECTOR_HPP
+#define DETECTOR_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "motion_gate.hpp"
+#include "preprocess.hpp"
+
+class ScaleController;
+class TileDetector;
+class TwoTierDetector;
+
+// Face cascade parameters, shared with the tile and two-tier searches so that
+// every mode looks for the same faces.
+const int kFaceMinNeighbors = 2;
+const int kMinFaceSize = 30;
+
+// Two hits of the same face: they overlap by more than half of the smaller
+// one. Used to merge the hits of overlapping searches.
+inline bool sameFace(const cv::Rect &a, const cv::Rect &b) {
+    return (a & b).area() * 2 > std::min(a.area(), b.area());
+}
+
+// Result of one DetectorContext::detect() call. Face rectangles are in the
+// coordinates of the downscaled detection image (multiply by scale for the
+// input frame), nested objects are relative to their face.
+struct DetectionResult {
+    std::vector<cv::Rect> faces;
+    // nested[i] belongs to faces[i]. The outer vector never shrinks so that
+    // the inner buffers survive from frame to frame: entries past
+    // faces.size() are spare, iterate up to faces.size().
+    std::vector<std::vector<cv::Rect> > nested;
+    double scale;   // downscale factor the faces were detected at
+    double ms;      // face cascade time, 0 when skipped
+    bool skipped;   // motion gate saw no change, previous results reused
+    int regions;    // changed regions searched, 0 means the whole frame
+};
+
+// Per-stream detection state: preprocessing buffers, the cascade output
+// vectors, the motion gate and the result. Everything is sized
+// on the first frames and reused afterwards, so steady-state detection makes
+// no heap allocations of its own; only the cascade's internal ones remain
+// (counted apart, see AllocStats). A context serves one stream and is not
+// thread-safe. The classifiers are scratch state of the calling thread.
+class DetectorContext {
+public:
+    // Frames ignored by the allocation statistics while buffers grow, at
+    // the start and again after every scale change.
+    static const int kWarmupFrames = 10;
+
+    struct AllocStats {
+        long frames;                       // frames counted, after the warm-up
+        unsigned long long allocs;         // allocations made by the detector
+        unsigned long long cascadeAllocs;  // made inside detectMultiScale
+    };
+
+    DetectorContext(double scale, bool tryflip, bool motionGate = false,
+                    double motionThreshold = 6.0);
+
+    // Face + nested detection on a BGR frame (or an 8-bit gray image such as
+    // an NV21 Y plane). The result stays valid until the next call.
+    const DetectionResult &detect(const cv::Mat &img, cv::CascadeClassifier &cascade,
+                                  cv::CascadeClassifier &nestedCascade);
+
+    // Runs the face cascade through tiles (see tile_detector.hpp) instead of
+    // a single detectMultiScale call; NULL switches back. Not owned.
+    void setTileDetector(TileDetector *tiles) { tiles_ = tiles; }
+
+    // Lets an LBP cascade propose candidates that the face cascade then
+    // verifies (see two_tier_detector.hpp); takes precedence over tiles.
+    // NULL switches back. Not owned.
+    void setTwoTierDetector(TwoTierDetector *twoTier) { twoTier_ = twoTier; }
+
+    // Lets controller pick the scale and pyramid step of every frame and
+    // feeds it the frame's detection time; NULL keeps the fixed scale. Not
+    // owned.
+    void setScaleController(ScaleController *controller) { controller_ = controller; }
+
+    // Splits the eye band into halves for a pair of one-eye cascades: the
+    // nested cascade searches the image-left half (the subject's right eye,
+    // haarcascade_righteye_2splits) and imageRight the other one
+    // (haarcascade_lefteye_2splits). NULL searches the whole band with the
+    // nested cascade. Not owned; like the context, used by one thread at a
+    // time.
+    void setEyeSplitCascade(cv::CascadeClassifier *imageRight) { eyeSplit_ = imageRight; }
+
+    // Scale of the next frame; a result carries the one it was computed at.
+    double scale() const { return scale_; }
+    const MotionGate *gate() const { return motionGate_ ? &gate_ : NULL; }
+
+    // Heap memory held by the context's buffers.
+    size_t bufferBytes() const;
+    // Only meaningful with WITH_ALLOC_COUNTER, see alloc_counter.hpp.
+    const AllocStats &allocStats() const { return allocStats_; }
+    void printAllocStats() const;
+
+private:
+    void detectFaces(const cv::Rect &roi, cv::CascadeClassifier &cascade);
+    void runCascade(const cv::Mat &img, cv::CascadeClassifier &cascade);
+    void detectNested(size_t face, cv::CascadeClassifier &nestedCascade);
+    void searchEyes(const cv::Mat &faceImg, const cv::Rect &roi, cv::CascadeClassifier &cascade,
+                    int minSide, int maxSide, std::vector<cv::Rect> &eyes);
+
+    double scale_;
+    double scaleFactor_;
+    bool tryflip_;
+    bool motionGate_;
+    TileDetector *tiles_;
+    TwoTierDetector *twoTier_;
+    ScaleController *controller_;
+    cv::CascadeClassifier *eyeSplit_;
+
+    DetectPreprocessor preprocessor_;
+    std::vector<cv::Rect> found_;      // cascade output, before the region offset
+    std::vector<cv::Rect> changed_;
+    std::vector<cv::Rect> eyes_;       // nested cascade output, before the band offset
+    MotionGate gate_;
+    DetectionResult result_;
+
+    long frames_;
+    AllocStats allocStats_;
+};
+
+#endif  // DETECTOR_HPP
@@ -0,0 +1,135 @@
+#include "face_eval.hpp"
+
+#include "opencv2/imgcodecs.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "detector.hpp"
+#include "two_tier_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+const double kMinOverlap = 0.5;
+
+struct LabelledImage {
+    string path;
+    Mat image;
+    vector<Rect> faces;
+};
+
+bool readLabels(const string &labelFile, vector<LabelledImage> &images) {
+    ifstream in(labelFile.c_str());
+    if (!in) {
+        cerr << "Could not read " << labelFile << endl;
+        return false;
+    }
+    size_t slash = labelFile.find_last_of('/');
+    string dir = slash == string::npos ? "" : labelFile.substr(0, slash + 1);
+
+    string line;
+    while (getline(in, line)) {
+        stringstream fields(line);
+        LabelledImage entry;
+        if (!(fields >> entry.path) || entry.path[0] == '#') continue;
+        if (entry.path[0] != '/') entry.path = dir + entry.path;
+        Rect r;
+        while (fields >> r.x >> r.y >> r.width >> r.height) entry.faces.push_back(r);
+        entry.image = imread(entry.path, IMREAD_COLOR);
+        if (entry.image.empty()) {
+            cerr << "Could not read " << entry.path << endl;
+            return false;
+        }
+        images.push_back(entry);
+    }
+    return !images.empty();
+}
+
+double overlap(const Rect &a, const Rect &b) {
+    double inter = (a & b).area();
+    return inter / (a.area() + b.area() - inter);
+}
+
+// Greedy matching: each detection takes the free label it overlaps most.
+int countMatches(const vector<Rect> &detections, const vector<Rect> &labels) {
+    vector<bool> taken(labels.size(), false);
+    int matched = 0;
+    for (size_t i = 0; i < detections.size(); i++) {
+        int best = -1;
+        double bestOverlap = kMinOverlap;
+        for (size_t j = 0; j < labels.size(); j++) {
+            double o = overlap(detections[i], labels[j]);
+            if (!taken[j] && o >= bestOverlap) {
+                best = (int) j;
+                bestOverlap = o;
+            }
+        }
+        if (best >= 0) {
+            taken[best] = true;
+            matched++;
+        }
+    }
+    return matched;
+}
+
+void evaluate(const char *mode, vector<LabelledImage> &images, CascadeClassifier &cascade,
+              TwoTierDetector *twoTier, double scale) {
+    DetectorContext detector(scale, false);
+    detector.setTwoTierDetector(twoTier);
+    CascadeClassifier noNested;
+    long labels = 0, detections = 0, matched = 0;
+    double ms = 0;
+    vector<Rect> found;
+    for (size_t i = 0; i < images.size(); i++) {
+        const DetectionResult &result = detector.detect(images[i].image, cascade, noNested);
+        found.clear();
+        for (size_t j = 0; j < result.faces.size(); j++) {
+            const Rect &r = result.faces[j];
+            found.push_back(Rect(cvRound(r.x * result.scale),
+                                 cvRound(r.y * result.scale),
+                                 cvRound(r.width * result.scale),
+                                 cvRound(r.height * result.scale)));
+        }
+        labels += (long) images[i].faces.size();
+        detections += (long) found.size();
+        matched += countMatches(found, images[i].faces);
+        ms += result.ms;
+    }
+    printf("%-9s precision %5.1f%%  recall %5.1f%%  (%ld of %ld detections, %ld labels)  "
+           "%.2f ms/image\n",
+           mode,
+           detections ? 100.0 * matched / detections : 0.0,
+           labels ? 100.0 * matched / labels : 0.0,
+           matched,
+           detections,
+           labels,
+           ms / images.size());
+}
+
+}  // namespace
+
+int runFaceEvaluation(const string &labelFile, CascadeClassifier &haar, const SharedCascade &lbp,
+                      double scale) {
+    vector<LabelledImage> images;
+    if (!readLabels(labelFile, images)) return 1;
+
+    CascadeClassifier lbpClassifier;
+    TwoTierDetector twoTier(lbp);
+    if (!lbp.instantiate(lbpClassifier) || !twoTier.ok()) {
+        cerr << "ERROR: Could not build the LBP classifier from " << lbp.path() << endl;
+        return -1;
+    }
+
+    printf("%d labelled image(s), scale %.2f\n", (int) images.size(), scale);
+    evaluate("haar", images, haar, NULL, scale);
+    evaluate("lbp", images, lbpClassifier, NULL, scale);
+    evaluate("two-tier", images, haar, &twoTier, scale);
+    twoTier.printStats();
+    return 0;
+}
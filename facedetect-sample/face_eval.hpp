@@ -0,0 +1,22 @@
+#ifndef FACE_EVAL_HPP
+#define FACE_EVAL_HPP
+
+#include "opencv2/objdetect.hpp"
+
+#include <string>
+
+#include "shared_cascade.hpp"
+
+// Compares the Haar cascade, the LBP cascade and the two-tier mode (LBP
+// proposals verified by Haar) on a labelled image set. Each line of
+// labelFile is an image path followed by the labelled face boxes in image
+// pixels:
+//   photos/group1.jpg 120 80 64 64 310 95 60 60
+// Relative paths are resolved against the label file's directory. A
+// detection matches a free label of intersection over union >= 0.5. Prints
+// precision, recall and the detection time per image for every mode.
+// Returns 0 on success.
+int runFaceEvaluation(const std::string &labelFile, cv::CascadeClassifier &haar,
+                      const SharedCascade &lbp, double scale);
+
+#endif  // FACE_EVAL_HPP
@@ -0,0 +1,105 @@
+#include "gray_decode.hpp"
+
+#include "opencv2/imgcodecs.hpp"
+
+#include <csetjmp>
+#include <cstdio>
+
+#ifdef WITH_JPEG_TURBO
+#include <jpeglib.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+int GrayDecoder::denomForScale(double scale) {
+    int denom = 1;
+    while (denom < 8 && denom * 2 <= scale) denom *= 2;
+    return denom;
+}
+
+static int reducedGrayFlag(int denom) {
+    switch (denom) {
+        case 2: return IMREAD_REDUCED_GRAYSCALE_2;
+        case 4: return IMREAD_REDUCED_GRAYSCALE_4;
+        case 8: return IMREAD_REDUCED_GRAYSCALE_8;
+        default: return IMREAD_GRAYSCALE;
+    }
+}
+
+bool GrayDecoder::decode(const string &path, int denom, Mat &gray) {
+    lastWasJpeg_ = false;
+#ifdef WITH_JPEG_TURBO
+    if (decodeJpeg(path, denom, gray)) {
+        lastWasJpeg_ = true;
+        return true;
+    }
+#endif
+    gray = imread(path, reducedGrayFlag(denom));
+    return !gray.empty();
+}
+
+#ifdef WITH_JPEG_TURBO
+
+namespace {
+
+// libjpeg reports fatal errors through error_exit, which must not return.
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+void jpegErrorExit(j_common_ptr cinfo) {
+    JpegError *err = reinterpret_cast<JpegError *>(cinfo->err);
+    char message[JMSG_LENGTH_MAX];
+    cinfo->err->format_message(cinfo, message);
+    fprintf(stderr, "jpeg: %s\n", message);
+    longjmp(err->jump, 1);
+}
+
+}  // namespace
+
+// Only objects without destructors live between setjmp and a possible
+// longjmp; gray belongs to the caller.
+bool GrayDecoder::decodeJpeg(const string &path, int denom, Mat &gray) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    unsigned char magic[2] = {0, 0};
+    if (fread(magic, 1, 2, fp) != 2 || magic[0] != 0xFF || magic[1] != 0xD8) {
+        fclose(fp);
+        return false;
+    }
+    rewind(fp);
+
+    jpeg_decompress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = jpegErrorExit;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(fp);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, fp);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_GRAYSCALE;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    cinfo.dct_method = JDCT_ISLOW;
+    jpeg_start_decompress(&cinfo);
+
+    gray.create(cinfo.output_height, cinfo.output_width, CV_8UC1);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = gray.ptr<uchar>(cinfo.output_scanline);
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(fp);
+    return true;
+}
+
+#endif
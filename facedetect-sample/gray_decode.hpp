@@ -0,0 +1,36 @@
+#ifndef GRAY_DECODE_HPP
+#define GRAY_DECODE_HPP
+
+#include "opencv2/core.hpp"
+
+#include <string>
+
+// Detection-only image decode: luma only, reduced by 1/denom while decoding.
+//
+// With WITH_JPEG_TURBO, JPEGs go through libjpeg-turbo directly with
+// out_color_space = JCS_GRAYSCALE (the chroma components are entropy-decoded
+// but never inverse-transformed, upsampled or colour-converted) and
+// scale_denom = denom (the IDCT itself outputs 1/2, 1/4 or 1/8 size blocks),
+// straight into the rows of gray. The full-size image never exists. Other
+// formats, and JPEGs in builds without libjpeg-turbo, use imread with the
+// matching IMREAD_REDUCED_GRAYSCALE_* flag.
+class GrayDecoder {
+public:
+    // Largest of 1, 2, 4, 8 not above the detection scale: the decoder
+    // reduces by that much and the detector by the rest (scale / denom).
+    static int denomForScale(double scale);
+
+    // gray is (re)allocated only when the decoded size changes. Returns false
+    // if the image can't be read.
+    bool decode(const std::string &path, int denom, cv::Mat &gray);
+
+    // True when the last decode() went through libjpeg-turbo.
+    bool lastWasJpeg() const { return lastWasJpeg_; }
+
+private:
+    bool decodeJpeg(const std::string &path, int denom, cv::Mat &gray);
+
+    bool lastWasJpeg_ = false;
+};
+
+#endif  // GRAY_DECODE_HPP
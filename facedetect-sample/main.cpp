@@ -4,6 +4,17 @@
 #include "opencv2/videoio.hpp"
 
 #include <iostream>
+#include <memory>
+#include <sstream>
+
+#include "alloc_counter.hpp"
+#include "detector.hpp"
+#include "face_eval.hpp"
+#include "gray_decode.hpp"
+#include "scale_controller.hpp"
+#include "stream_server.hpp"
+#include "tile_detector.hpp"
+#include "two_tier_detector.hpp"
 
 using namespace std;
 using namespace cv;
@@ -20,9 +31,34 @@ static void help(const char **argv) {
             "such as frontal face]\n"
             "   [--nested-cascade[=nested_cascade_path this an optional "
             "secondary classifier such as eyes]]\n"
+            "   [--eye-split-cascade=<cascade for the image-right half of the eye band, e.g.\n"
+            "     haarcascade_lefteye_2splits.xml; --nested-cascade then searches the left\n"
+            "     half, e.g. with haarcascade_righteye_2splits.xml>]\n"
             "   [--scale=<image scale greater or equal to 1, try 1.3 for "
             "example>]\n"
             "   [--try-flip]\n"
+            "   [--motion-gate] skip detection on unchanged video frames\n"
+            "   [--motion-threshold=<mean abs difference per pixel, default 6>]\n"
+            "   [--streams=<src1,src2,...> multi-stream mode, a source is a video file,\n"
+            "     a camera index or still:<image> (an image replayed as a camera)]\n"
+            "   [--workers=<detection threads, default: core count>]\n"
+            "   [--queue-depth=<frames queued per stream, default 4>]\n"
+            "   [--stream-frames=<frames per camera/still source, default 300>]\n"
+            "   [--gray-decode] decode still images as reduced-size luma only (JPEG DCT\n"
+            "     scaling by the largest of 1/2, 1/4, 1/8 within --scale)\n"
+            "   [--tile-detect=<largest face in input pixels>] split large frames into\n"
+            "     overlapping tiles detected on several threads\n"
+            "   [--tile-threads=<threads for --tile-detect, default: core count>]\n"
+            "   [--latency-budget=<ms>] adapt the video/stream detection scale between\n"
+            "     --scale and --max-scale to keep p95 detection time under the budget\n"
+            "   [--max-scale=<largest scale --latency-budget may use, default 4>]\n"
+            "   [--two-tier] propose faces with the LBP cascade, verify them with the\n"
+            "     face cascade on the candidate regions only\n"
+            "   [--lbp-cascade=<LBP cascade for --two-tier and --eval>]\n"
+            "   [--eval=<label file>] compare Haar, LBP and --two-tier precision, recall\n"
+            "     and time on labelled images (lines of: image x y w h [x y w h ...])\n"
+            "   [--alloc-check] report per-frame heap allocations and fail if steady-state\n"
+            "     detection allocates (needs a WITH_ALLOC_COUNTER build)\n"
             "   [filename|camera_index]\n\n"
             "example:\n"
             << argv[0]
@@ -36,7 +72,35 @@ static void help(const char **argv) {
 }
 
 void detectAndDraw(Mat &img, CascadeClassifier &cascade, CascadeClassifier &nestedCascade,
-                   double scale, bool tryflip);
+                   DetectorContext &detector);
+
+// Full-size BGR decode, or with a GrayDecoder the reduced luma-only decode
+// (results are then drawn in gray levels).
+static bool readImage(const string &path, GrayDecoder *grayDecoder, int denom, Mat &image) {
+    double t = (double) getTickCount();
+    bool ok;
+    if (grayDecoder) {
+        ok = grayDecoder->decode(path, denom, image);
+    } else {
+        image = imread(path, IMREAD_COLOR);
+        ok = !image.empty();
+    }
+    t = ((double) getTickCount() - t) * 1000 / getTickFrequency();
+    if (ok) {
+        // Which decoder ran: JPEGs only take the libjpeg-turbo path in WITH_JPEG_TURBO builds.
+        const char *decoder = "BGR, imread";
+        if (grayDecoder) {
+            decoder = grayDecoder->lastWasJpeg() ? "gray, libjpeg-turbo" : "gray, imread";
+        }
+        printf("decode time = %g ms, %dx%d %s, %.1f KB\n",
+               t,
+               image.cols,
+               image.rows,
+               decoder,
+               image.total() * image.elemSize() / 1024.0);
+    }
+    return ok;
+}
 
 string cascadeName;
 string nestedCascadeName;
@@ -55,7 +119,12 @@ int main(int argc, const char **argv) {
         "{help h||}"
         "{cascade|data/haarcascades/haarcascade_frontalface_alt.xml|}"
         "{nested-cascade|data/haarcascades/haarcascade_eye_tree_eyeglasses.xml|}"
-        "{scale|1|}{try-flip||}{@filename||}");
+        "{eye-split-cascade||}"
+        "{scale|1|}{try-flip||}{motion-gate||}{motion-threshold|6|}"
+        "{streams||}{workers|0|}{queue-depth|4|}{stream-frames|300|}{alloc-check||}{gray-decode||}"
+        "{tile-detect|0|}{tile-threads|0|}{latency-budget|0|}{max-scale|4|}"
+        "{two-tier||}{lbp-cascade|data/lbpcascades/lbpcascade_frontalface_improved.xml|}{eval||}"
+        "{@filename||}");
     if (parser.has("help")) {
         help(argv);
         return 0;
@@ -65,18 +134,108 @@ int main(int argc, const char **argv) {
     scale = parser.get<double>("scale");
     if (scale < 1) scale = 1;
     tryflip = parser.has("try-flip");
+    bool motionGate = parser.has("motion-gate");
+    double motionThreshold = parser.get<double>("motion-threshold");
+    bool allocCheck = parser.has("alloc-check");
+    bool grayDecode = parser.has("gray-decode");
+    int tileMaxFace = parser.get<int>("tile-detect");
+    int tileThreads = parser.get<int>("tile-threads");
+    double latencyBudget = parser.get<double>("latency-budget");
+    double maxScale = parser.get<double>("max-scale");
+    bool twoTierMode = parser.has("two-tier");
+    string lbpCascadeName = parser.get<string>("lbp-cascade");
+    string evalLabels = parser.get<string>("eval");
     inputName = parser.get<string>("@filename");
     if (!parser.check()) {
         parser.printErrors();
         return 0;
     }
+    if (allocCheck && !allocCounterEnabled()) {
+        cerr << "ERROR: --alloc-check needs a build with WITH_ALLOC_COUNTER (glibc)" << endl;
+        return 1;
+    }
+    // The LBP proposer of --two-tier, parsed once like the stream cascades.
+    SharedCascade sharedLbp;
+    if ((twoTierMode || !evalLabels.empty()) &&
+        !sharedLbp.load(samples::findFile(lbpCascadeName))) {
+        cerr << "ERROR: Could not load LBP cascade" << endl;
+        return -1;
+    }
+    if (parser.has("streams")) {
+        vector<string> sources;
+        stringstream list(parser.get<string>("streams"));
+        string source;
+        while (getline(list, source, ',')) {
+            if (!source.empty()) sources.push_back(source);
+        }
+
+        SharedCascade sharedCascade, sharedNested;
+        if (!sharedNested.load(samples::findFileOrKeep(nestedCascadeName)))
+            cerr << "WARNING: Could not load classifier cascade for nested objects" << endl;
+        if (!sharedCascade.load(samples::findFile(cascadeName))) {
+            cerr << "ERROR: Could not load classifier cascade" << endl;
+            help(argv);
+            return -1;
+        }
+
+        StreamServerOptions options;
+        options.workers = parser.get<int>("workers");
+        options.queueDepth = parser.get<int>("queue-depth");
+        options.liveFrames = parser.get<int>("stream-frames");
+        options.stillFps = 30;
+        options.scale = scale;
+        options.tryflip = tryflip;
+        options.motionGate = motionGate;
+        options.motionThreshold = motionThreshold;
+        options.reportInterval = 2;
+        options.allocCheck = allocCheck;
+        options.latencyBudget = latencyBudget;
+        options.maxScale = maxScale;
+        options.proposer = twoTierMode ? &sharedLbp : NULL;
+        return runStreamServer(sources, sharedCascade, sharedNested, options);
+    }
+
     if (!nestedCascade.load(samples::findFileOrKeep(nestedCascadeName)))
         cerr << "WARNING: Could not load classifier cascade for nested objects" << endl;
+    CascadeClassifier eyeSplitCascade;
+    if (parser.has("eye-split-cascade") &&
+        !eyeSplitCascade.load(samples::findFile(parser.get<string>("eye-split-cascade")))) {
+        cerr << "ERROR: Could not load the eye split cascade" << endl;
+        return -1;
+    }
     if (!cascade.load(samples::findFile(cascadeName))) {
         cerr << "ERROR: Could not load classifier cascade" << endl;
         help(argv);
         return -1;
     }
+    if (!evalLabels.empty()) return runFaceEvaluation(evalLabels, cascade, sharedLbp, scale);
+    GrayDecoder grayDecoder;
+    int denom = GrayDecoder::denomForScale(scale);
+
+    // The tile workers need classifiers of their own.
+    SharedCascade sharedCascade;
+    unique_ptr<TileDetector> tiles;
+    if (tileMaxFace > 0) {
+        if (!sharedCascade.load(samples::findFile(cascadeName))) {
+            cerr << "ERROR: Could not load classifier cascade" << endl;
+            return -1;
+        }
+        tiles.reset(new TileDetector(sharedCascade, tileThreads, cvRound(tileMaxFace / scale)));
+        if (!tiles->ok()) {
+            cerr << "ERROR: Could not build the tile classifiers" << endl;
+            return -1;
+        }
+        cout << "Tile detection on " << tiles->threads() << " thread(s), faces up to "
+             << tileMaxFace << " px" << endl;
+    }
+    unique_ptr<TwoTierDetector> twoTier;
+    if (twoTierMode) {
+        twoTier.reset(new TwoTierDetector(sharedLbp));
+        if (!twoTier->ok()) {
+            cerr << "ERROR: Could not build the LBP classifier" << endl;
+            return -1;
+        }
+    }
     if (inputName.empty() || (isdigit(inputName[0]) && inputName.size() == 1)) {
         int camera = inputName.empty() ? 0 : inputName[0] - '0';
         if (!capture.open(camera)) {
@@ -84,7 +243,8 @@ int main(int argc, const char **argv) {
             return 1;
         }
     } else if (!inputName.empty()) {
-        image = imread(samples::findFileOrKeep(inputName), IMREAD_COLOR);
+        readImage(samples::findFileOrKeep(inputName), grayDecode ? &grayDecoder : NULL, denom,
+                  image);
         if (image.empty()) {
             if (!capture.open(samples::findFileOrKeep(inputName))) {
                 cout << "Could not read " << inputName << endl;
@@ -105,20 +265,48 @@ int main(int argc, const char **argv) {
     if (capture.isOpened()) {
         cout << "Video capturing has been started ..." << endl;
 
+        // frame1 is drawn on, so it is a copy; copyTo reuses its buffer.
+        DetectorContext detector(scale, tryflip, motionGate, motionThreshold);
+        detector.setTileDetector(tiles.get());
+        detector.setTwoTierDetector(twoTier.get());
+        detector.setEyeSplitCascade(&eyeSplitCascade);
+        ScaleController controller(latencyBudget, scale, maxScale);
+        if (latencyBudget > 0) detector.setScaleController(&controller);
+        Mat frame1;
         for (;;) {
             capture >> frame;
             if (frame.empty()) break;
 
-            Mat frame1 = frame.clone();
-            detectAndDraw(frame1, cascade, nestedCascade, scale, tryflip);
+            frame.copyTo(frame1);
+            detectAndDraw(frame1, cascade, nestedCascade, detector);
 
             char c = (char) waitKey(10);
             if (c == 27 || c == 'q' || c == 'Q') break;
         }
+        if (detector.gate()) detector.gate()->printStats();
+        if (latencyBudget > 0) controller.printStats();
+        if (twoTier) twoTier->printStats();
+        printf("detector buffers %.1f KB, peak RSS %.1f MB\n",
+               detector.bufferBytes() / 1024.0,
+               peakRssBytes() / (1024.0 * 1024.0));
+        detector.printAllocStats();
+        if (allocCheck) {
+            const DetectorContext::AllocStats &stats = detector.allocStats();
+            if (stats.frames == 0 || stats.allocs != 0) {
+                cerr << "alloc check FAILED: steady-state detection allocated" << endl;
+                return 1;
+            }
+            cout << "alloc check passed" << endl;
+        }
     } else {
         cout << "Detecting face(s) in " << inputName << endl;
+        // A gray-decoded image is already 1/denom of the original size.
+        DetectorContext detector(grayDecode ? scale / denom : scale, tryflip);
+        detector.setTileDetector(tiles.get());
+        detector.setTwoTierDetector(twoTier.get());
+        detector.setEyeSplitCascade(&eyeSplitCascade);
         if (!image.empty()) {
-            detectAndDraw(image, cascade, nestedCascade, scale, tryflip);
+            detectAndDraw(image, cascade, nestedCascade, detector);
             waitKey(0);
         } else if (!inputName.empty()) {
             /* assume it is a text file containing the
@@ -131,9 +319,8 @@ int main(int argc, const char **argv) {
                     while (len > 0 && isspace(buf[len - 1])) len--;
                     buf[len] = '\0';
                     cout << "file " << buf << endl;
-                    image = imread(buf, IMREAD_COLOR);
-                    if (!image.empty()) {
-                        detectAndDraw(image, cascade, nestedCascade, scale, tryflip);
+                    if (readImage(buf, grayDecode ? &grayDecoder : NULL, denom, image)) {
+                        detectAndDraw(image, cascade, nestedCascade, detector);
                         char c = (char) waitKey(0);
                         if (c == 27 || c == 'q' || c == 'Q') break;
                     } else {
@@ -149,9 +336,7 @@ int main(int argc, const char **argv) {
 }
 
 void detectAndDraw(Mat &img, CascadeClassifier &cascade, CascadeClassifier &nestedCascade,
-                   double scale, bool tryflip) {
-    double t = 0;
-    vector<Rect> faces, faces2;
+                   DetectorContext &detector) {
     const static Scalar colors[] = {
         Scalar(255, 0, 0),
         Scalar(255, 128, 0),
@@ -162,44 +347,21 @@ void detectAndDraw(Mat &img, CascadeClassifier &cascade, CascadeClassifier &nest
         Scalar(0, 0, 255),
         Scalar(255, 0, 255)
     };
-    Mat gray, smallImg;
-
-    cvtColor(img, gray, COLOR_BGR2GRAY);
-    double fx = 1 / scale;
-    resize(gray, smallImg, Size(), fx, fx, INTER_LINEAR_EXACT);
-    equalizeHist(smallImg, smallImg);
-
-    t = (double) getTickCount();
-    cascade.detectMultiScale(smallImg,
-                             faces,
-                             1.1,
-                             2,
-                             0
-                             //|CASCADE_FIND_BIGGEST_OBJECT
-                             //|CASCADE_DO_ROUGH_SEARCH
-                             | CASCADE_SCALE_IMAGE,
-                             Size(30, 30));
-    if (tryflip) {
-        flip(smallImg, smallImg, 1);
-        cascade.detectMultiScale(smallImg,
-                                 faces2,
-                                 1.1,
-                                 2,
-                                 0
-                                 //|CASCADE_FIND_BIGGEST_OBJECT
-                                 //|CASCADE_DO_ROUGH_SEARCH
-                                 | CASCADE_SCALE_IMAGE,
-                                 Size(30, 30));
-        for (vector<Rect>::const_iterator r = faces2.begin(); r != faces2.end(); ++r) {
-            faces.push_back(Rect(smallImg.cols - r->x - r->width, r->y, r->width, r->height));
-        }
+
+    const DetectionResult &result = detector.detect(img, cascade, nestedCascade);
+    double scale = result.scale;
+    const vector<Rect> &faces = result.faces;
+    const vector<vector<Rect> > &nested = result.nested;
+    if (result.skipped) {
+        printf("motion gate: no change, reusing %d face(s)\n", (int) faces.size());
+    } else if (result.regions == 0) {
+        printf("detection time = %g ms\n", result.ms);
+    } else {
+        printf("detection time = %g ms (%d changed region(s))\n", result.ms, result.regions);
     }
-    t = (double) getTickCount() - t;
-    printf("detection time = %g ms\n", t * 1000 / getTickFrequency());
+
     for (size_t i = 0; i < faces.size(); i++) {
         Rect r = faces[i];
-        Mat smallImgROI;
-        vector<Rect> nestedObjects;
         Point center;
         Scalar color = colors[i % 8];
         int radius;
@@ -219,18 +381,7 @@ void detectAndDraw(Mat &img, CascadeClassifier &cascade, CascadeClassifier &nest
                 3,
                 8,
                 0);
-        if (nestedCascade.empty()) continue;
-        smallImgROI = smallImg(r);
-        nestedCascade.detectMultiScale(smallImgROI,
-                                       nestedObjects,
-                                       1.1,
-                                       2,
-                                       0
-                                       //|CASCADE_FIND_BIGGEST_OBJECT
-                                       //|CASCADE_DO_ROUGH_SEARCH
-                                       //|CASCADE_DO_CANNY_PRUNING
-                                       | CASCADE_SCALE_IMAGE,
-                                       Size(30, 30));
+        const vector<Rect> &nestedObjects = nested[i];
         for (size_t j = 0; j < nestedObjects.size(); j++) {
             Rect nr = nestedObjects[j];
             center.x = cvRound((r.x + nr.x + nr.width * 0.5) * scale);
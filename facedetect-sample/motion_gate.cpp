@@ -0,0 +1,185 @@
+#include "motion_gate.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace cv;
+using namespace std;
+
+MotionGate::MotionGate(double threshold, int downscale, int blockSize, double fullFrameRatio)
+    : threshold_(threshold),
+      downscale_(max(downscale, 1)),
+      blockSize_(max(blockSize, 1)),
+      fullFrameRatio_(fullFrameRatio) {
+    stats_ = Stats();
+}
+
+void MotionGate::reset() {
+    reference_.release();
+    faces.clear();
+    nested.clear();
+}
+
+// Box average over factor x factor pixels, the last block of a row or column
+// averages whatever is left.
+static void boxDownscale(const Mat &gray, Mat &dst, int factor) {
+    for (int y = 0; y < dst.rows; y++) {
+        int y0 = y * factor, y1 = min(y0 + factor, gray.rows);
+        uchar *d = dst.ptr<uchar>(y);
+        for (int x = 0; x < dst.cols; x++) {
+            int x0 = x * factor, x1 = min(x0 + factor, gray.cols);
+            int sum = 0;
+            for (int yy = y0; yy < y1; yy++) {
+                const uchar *g = gray.ptr<uchar>(yy);
+                for (int xx = x0; xx < x1; xx++) sum += g[xx];
+            }
+            int n = (y1 - y0) * (x1 - x0);
+            d[x] = (uchar) ((sum + n / 2) / n);
+        }
+    }
+}
+
+bool MotionGate::update(const Mat &gray, vector<Rect> &changed) {
+    changed.clear();
+
+    // Everything below works in member buffers sized on the first frame, so
+    // a steady stream doesn't allocate.
+    Size small(max(gray.cols / downscale_, 1), max(gray.rows / downscale_, 1));
+    current_.create(small, CV_8UC1);
+    boxDownscale(gray, current_, downscale_);
+
+    int bw = (small.width + blockSize_ - 1) / blockSize_;
+    int bh = (small.height + blockSize_ - 1) / blockSize_;
+    if (reference_.empty() || gray.size() != frameSize_) {
+        frameSize_ = gray.size();
+        current_.copyTo(reference_);
+        changedBlocks_.create(bh, bw, CV_8UC1);
+        dilated_.create(bh, bw, CV_8UC1);
+        visited_.create(bh, bw, CV_8UC1);
+        stack_.reserve(bw * bh);
+        changed.reserve(bw * bh);
+        return true;
+    }
+
+    // Per-block mean absolute difference on the downsampled plane.
+    int changedCount = 0;
+    for (int by = 0; by < bh; by++) {
+        int y0 = by * blockSize_, y1 = min(y0 + blockSize_, small.height);
+        for (int bx = 0; bx < bw; bx++) {
+            int x0 = bx * blockSize_, x1 = min(x0 + blockSize_, small.width);
+            int sad = 0;
+            for (int y = y0; y < y1; y++) {
+                const uchar *c = current_.ptr<uchar>(y);
+                const uchar *r = reference_.ptr<uchar>(y);
+                for (int x = x0; x < x1; x++) sad += abs(c[x] - r[x]);
+            }
+            bool hit = sad > threshold_ * (x1 - x0) * (y1 - y0);
+            changedBlocks_.at<uchar>(by, bx) = hit ? 255 : 0;
+            changedCount += hit;
+        }
+    }
+    if (changedCount == 0) return false;
+
+    // One block of margin (3x3 dilation of the block map) so that a face of
+    // up to about a block straddling the edge of a changed block is fully
+    // contained in the region handed to the detector. Larger faces that only
+    // partly moved are covered by DetectorContext, which grows the regions
+    // over the previous faces they touch.
+    for (int by = 0; by < bh; by++) {
+        for (int bx = 0; bx < bw; bx++) {
+            uchar hit = 0;
+            for (int ny = max(by - 1, 0); ny <= min(by + 1, bh - 1) && !hit; ny++) {
+                for (int nx = max(bx - 1, 0); nx <= min(bx + 1, bw - 1); nx++) {
+                    hit |= changedBlocks_.at<uchar>(ny, nx);
+                }
+            }
+            dilated_.at<uchar>(by, bx) = hit;
+        }
+    }
+
+    // Refresh the reference only where the detector is going to look.
+    int regionBlocks = 0;
+    for (int by = 0; by < bh; by++) {
+        for (int bx = 0; bx < bw; bx++) {
+            if (!dilated_.at<uchar>(by, bx)) continue;
+            regionBlocks++;
+            Rect block(bx * blockSize_, by * blockSize_, blockSize_, blockSize_);
+            block &= Rect(0, 0, small.width, small.height);
+            current_(block).copyTo(reference_(block));
+        }
+    }
+    if (regionBlocks > fullFrameRatio_ * bw * bh) {
+        current_.copyTo(reference_);
+        return true;
+    }
+
+    // Bounding boxes of the 8-connected changed areas, in raster order like
+    // connectedComponentsWithStats.
+    Rect frame(0, 0, gray.cols, gray.rows);
+    int step = blockSize_ * downscale_;
+    visited_.setTo(Scalar(0));
+    for (int by = 0; by < bh; by++) {
+        for (int bx = 0; bx < bw; bx++) {
+            if (!dilated_.at<uchar>(by, bx) || visited_.at<uchar>(by, bx)) continue;
+            int minX = bx, maxX = bx, minY = by, maxY = by;
+            visited_.at<uchar>(by, bx) = 1;
+            stack_.push_back(by * bw + bx);
+            while (!stack_.empty()) {
+                int cy = stack_.back() / bw, cx = stack_.back() % bw;
+                stack_.pop_back();
+                minX = min(minX, cx);
+                maxX = max(maxX, cx);
+                minY = min(minY, cy);
+                maxY = max(maxY, cy);
+                for (int ny = max(cy - 1, 0); ny <= min(cy + 1, bh - 1); ny++) {
+                    for (int nx = max(cx - 1, 0); nx <= min(cx + 1, bw - 1); nx++) {
+                        if (!dilated_.at<uchar>(ny, nx) || visited_.at<uchar>(ny, nx)) continue;
+                        visited_.at<uchar>(ny, nx) = 1;
+                        stack_.push_back(ny * bw + nx);
+                    }
+                }
+            }
+            Rect r(minX * step, minY * step, (maxX - minX + 1) * step, (maxY - minY + 1) * step);
+            changed.push_back(r & frame);
+        }
+    }
+    return true;
+}
+
+size_t MotionGate::bufferBytes() const {
+    size_t bytes = reference_.total() + current_.total() + changedBlocks_.total() +
+                   dilated_.total() + visited_.total() + stack_.capacity() * sizeof(int) +
+                   faces.capacity() * sizeof(Rect);
+    for (size_t i = 0; i < nested.size(); i++) bytes += nested[i].capacity() * sizeof(Rect);
+    return bytes;
+}
+
+void MotionGate::recordSkip() {
+    stats_.frames++;
+    stats_.skipped++;
+    stats_.savedMs += stats_.fullMs;
+}
+
+void MotionGate::recordDetection(bool fullFrame, double ms) {
+    stats_.frames++;
+    if (fullFrame) {
+        stats_.full++;
+        stats_.fullMs = stats_.full == 1 ? ms : stats_.fullMs * 0.9 + ms * 0.1;
+    } else {
+        stats_.partial++;
+        if (stats_.fullMs > ms) stats_.savedMs += stats_.fullMs - ms;
+    }
+}
+
+void MotionGate::printStats() const {
+    if (stats_.frames == 0) return;
+    printf("motion gate: %ld frames, %ld skipped (%.1f%%), %ld partial, %ld full, "
+           "avg full detection %.2f ms, saved ~%.1f ms\n",
+           stats_.frames,
+           stats_.skipped,
+           100.0 * stats_.skipped / stats_.frames,
+           stats_.partial,
+           stats_.full,
+           stats_.fullMs,
+           stats_.savedMs);
+}
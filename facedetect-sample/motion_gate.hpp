@@ -0,0 +1,72 @@
+#ifndef MOTION_GATE_HPP
+#define MOTION_GATE_HPP
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+// Cheap change detector used to skip the cascade on static scenes.
+//
+// The gray frame is box-downsampled, split into blocks and each block's mean
+// absolute difference (SAD / pixel count) against the last analysed frame is
+// compared with a threshold. Changed blocks are grown by one block, merged
+// into rectangles and returned in the coordinates of the input frame. The
+// reference is only refreshed for blocks that were reported as changed, so a
+// slow drift keeps accumulating until it crosses the threshold.
+class MotionGate {
+public:
+    struct Stats {
+        long frames;
+        long skipped;         // nothing changed, previous detections reused
+        long partial;         // detection re-run on changed regions only
+        long full;            // detection re-run on the whole frame
+        double fullMs;        // running average of a full-frame detection
+        double savedMs;       // estimated detection time saved
+    };
+
+    explicit MotionGate(double threshold = 6.0, int downscale = 4, int blockSize = 8,
+                        double fullFrameRatio = 0.5);
+
+    // Compares gray with the reference. Returns false when nothing changed.
+    // Otherwise fills changed with the regions to re-analyse; it is empty when
+    // the whole frame should be analysed (first frame, size change or too
+    // much of the frame changed).
+    bool update(const cv::Mat &gray, std::vector<cv::Rect> &changed);
+
+    // Forgets the reference so the next frame is analysed in full.
+    void reset();
+
+    // Book-keeping for the report, ms is the detection time actually spent.
+    void recordSkip();
+    void recordDetection(bool fullFrame, double ms);
+
+    const Stats &stats() const { return stats_; }
+    void printStats() const;
+
+    // Heap memory held by the gate's buffers.
+    size_t bufferBytes() const;
+
+    // Results of the last analysed frame, reused for unchanged regions.
+    // nested[i] belongs to faces[i]; like DetectionResult, nested may hold
+    // spare entries past faces.size().
+    std::vector<cv::Rect> faces;
+    std::vector<std::vector<cv::Rect> > nested;
+
+private:
+    double threshold_;
+    int downscale_;
+    int blockSize_;
+    double fullFrameRatio_;
+
+    cv::Size frameSize_;
+    cv::Mat reference_;   // downsampled gray of the analysed content
+    cv::Mat current_;
+    cv::Mat changedBlocks_;
+    cv::Mat dilated_;
+    cv::Mat visited_;
+    std::vector<int> stack_;   // flood fill of the changed-block map
+
+    Stats stats_;
+};
+
+#endif  // MOTION_GATE_HPP
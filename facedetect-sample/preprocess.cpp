@@ -0,0 +1,253 @@
+#include "preprocess.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+const int kWeightBits = 7;
+const int kWeightOne = 1 << kWeightBits;
+
+// cvtColor's BGR2GRAY coefficients, 14-bit fixed point.
+const int kGrayB = 1868, kGrayG = 9617, kGrayR = 4899;
+const int kGrayShift = 14;
+
+void bgrRowToGray(const uchar *src, uchar *dst, int width) {
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wbg = _mm_set1_epi32((kGrayG << 16) | kGrayB);
+    const __m128i wr1 = _mm_set1_epi32(((1 << (kGrayShift - 1)) << 16) | kGrayR);
+    const __m128i one = _mm_set1_epi16(1);
+    for (; x + 16 <= width; x += 16) {
+        // Deinterleave 16 BGR pixels with SSE2 unpacks only (no pshufb).
+        const uchar *p = src + x * 3;
+        __m128i t00 = _mm_loadu_si128((const __m128i *) p);
+        __m128i t01 = _mm_loadu_si128((const __m128i *) (p + 16));
+        __m128i t02 = _mm_loadu_si128((const __m128i *) (p + 32));
+
+        __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+        __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+        __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+        __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+        __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+        __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+        __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+        __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+        __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+        __m128i b = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+        __m128i g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+        __m128i r = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+
+        __m128i gray[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i b16 = k ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+            __m128i g16 = k ? _mm_unpackhi_epi8(g, zero) : _mm_unpacklo_epi8(g, zero);
+            __m128i r16 = k ? _mm_unpackhi_epi8(r, zero) : _mm_unpacklo_epi8(r, zero);
+            // (b, g) . (kGrayB, kGrayG) + (r, 1) . (kGrayR, rounding)
+            __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b16, g16), wbg),
+                                       _mm_madd_epi16(_mm_unpacklo_epi16(r16, one), wr1));
+            __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b16, g16), wbg),
+                                       _mm_madd_epi16(_mm_unpackhi_epi16(r16, one), wr1));
+            gray[k] = _mm_packs_epi32(_mm_srli_epi32(lo, kGrayShift),
+                                      _mm_srli_epi32(hi, kGrayShift));
+        }
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(gray[0], gray[1]));
+    }
+#endif
+    for (; x < width; x++) {
+        const uchar *p = src + x * 3;
+        dst[x] = (uchar) ((p[0] * kGrayB + p[1] * kGrayG + p[2] * kGrayR +
+                           (1 << (kGrayShift - 1))) >> kGrayShift);
+    }
+}
+
+// Four sub-histograms so that runs of equal pixels don't serialise on one
+// counter.
+void countRow(const uchar *row, int width, int hist[4][256]) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        hist[0][row[x]]++;
+        hist[1][row[x + 1]]++;
+        hist[2][row[x + 2]]++;
+        hist[3][row[x + 3]]++;
+    }
+    for (; x < width; x++) hist[0][row[x]]++;
+}
+
+// Blends two horizontally filtered rows: (h0 * (1 - wy) + h1 * wy) >> 14.
+void verticalRow(const short *h0, const short *h1, int wy, uchar *dst, int width) {
+    const int shift = 2 * kWeightBits;
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i weights = _mm_set1_epi32((wy << 16) | (kWeightOne - wy));
+    const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+    for (; x + 16 <= width; x += 16) {
+        __m128i out[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (h0 + x + k * 8));
+            __m128i b = _mm_loadu_si128((const __m128i *) (h1 + x + k * 8));
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights);
+            lo = _mm_srai_epi32(_mm_add_epi32(lo, round), shift);
+            hi = _mm_srai_epi32(_mm_add_epi32(hi, round), shift);
+            out[k] = _mm_packs_epi32(lo, hi);
+        }
+        _mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(out[0], out[1]));
+    }
+#endif
+    for (; x < width; x++) {
+        dst[x] = (uchar) ((h0[x] * (kWeightOne - wy) + h1[x] * wy + (1 << (shift - 1))) >> shift);
+    }
+}
+
+// resize()'s bilinear mapping: source coordinate of the centre of dst pixel
+// d, clamped to the image, with the fraction as a fixed-point weight.
+void linearTap(int d, double scale, int size, int &i0, int &i1, int &w) {
+    double f = (d + 0.5) * scale - 0.5;
+    int i = (int) floor(f);
+    f -= i;
+    if (i < 0) {
+        i = 0;
+        f = 0;
+    }
+    if (i >= size - 1) {
+        i = size - 1;
+        f = 0;
+    }
+    i0 = i;
+    i1 = min(i + 1, size - 1);
+    w = cvRound(f * kWeightOne);
+}
+
+}  // namespace
+
+DetectPreprocessor::DetectPreprocessor() : scale_(0) {
+    memset(hist_, 0, sizeof(hist_));
+    rowY_[0] = rowY_[1] = -1;
+}
+
+void DetectPreprocessor::buildTables(Size srcSize, double scale) {
+    int width = small_.cols;
+    x0_.resize(width);
+    x1_.resize(width);
+    wx_.resize(width);
+    for (int x = 0; x < width; x++) {
+        int w;
+        linearTap(x, scale, srcSize.width, x0_[x], x1_[x], w);
+        wx_[x] = (short) w;
+    }
+    grayRow_.resize(srcSize.width);
+    rows_[0].resize(width);
+    rows_[1].resize(width);
+    srcSize_ = srcSize;
+    scale_ = scale;
+}
+
+// Returns source row y gray-converted and horizontally filtered, from the
+// row cache when possible. keep is the other row the caller still needs.
+const short *DetectPreprocessor::horizontalRow(const Mat &src, int y, int keep) {
+    if (rowY_[0] == y) return &rows_[0][0];
+    if (rowY_[1] == y) return &rows_[1][0];
+
+    int slot = rowY_[0] == keep ? 1 : 0;
+    const uchar *gray = src.ptr<uchar>(y);
+    if (src.channels() == 3) {
+        bgrRowToGray(gray, &grayRow_[0], src.cols);
+        gray = &grayRow_[0];
+    }
+
+    short *h = &rows_[slot][0];
+    const int *x0 = &x0_[0];
+    const int *x1 = &x1_[0];
+    const short *wx = &wx_[0];
+    for (int x = 0; x < small_.cols; x++) {
+        h[x] = (short) (gray[x0[x]] * (kWeightOne - wx[x]) + gray[x1[x]] * wx[x]);
+    }
+    rowY_[slot] = y;
+    return h;
+}
+
+Mat &DetectPreprocessor::downscale(const Mat &src, double scale) {
+    CV_Assert(src.type() == CV_8UC3 || src.type() == CV_8UC1);
+
+    // Same output size as resize(src, dst, Size(), 1 / scale, 1 / scale).
+    double fx = 1 / scale;
+    Size size(cvRound(src.cols * fx), cvRound(src.rows * fx));
+    small_.create(size, CV_8UC1);
+
+    int hist[4][256];
+    memset(hist, 0, sizeof(hist));
+
+    if (size == src.size()) {
+        // No resampling: convert (or copy) and count.
+        for (int y = 0; y < size.height; y++) {
+            uchar *dst = small_.ptr<uchar>(y);
+            if (src.channels() == 3) {
+                bgrRowToGray(src.ptr<uchar>(y), dst, size.width);
+            } else {
+                memcpy(dst, src.ptr<uchar>(y), size.width);
+            }
+            countRow(dst, size.width, hist);
+        }
+    } else {
+        if (src.size() != srcSize_ || scale != scale_ || (int) x0_.size() != size.width) {
+            buildTables(src.size(), scale);
+        }
+        rowY_[0] = rowY_[1] = -1;   // the cached rows belong to the previous frame
+        for (int y = 0; y < size.height; y++) {
+            int y0, y1, wy;
+            linearTap(y, scale, src.rows, y0, y1, wy);
+            const short *h0 = horizontalRow(src, y0, y1);
+            const short *h1 = wy ? horizontalRow(src, y1, y0) : h0;
+            uchar *dst = small_.ptr<uchar>(y);
+            verticalRow(h0, h1, wy, dst, size.width);
+            countRow(dst, size.width, hist);
+        }
+    }
+
+    for (int i = 0; i < 256; i++) hist_[i] = hist[0][i] + hist[1][i] + hist[2][i] + hist[3][i];
+    return small_;
+}
+
+void DetectPreprocessor::equalize() {
+    int total = small_.rows * small_.cols;
+    if (total == 0) return;
+
+    // Same LUT as equalizeHist.
+    uchar lut[256];
+    int i = 0;
+    while (!hist_[i]) ++i;
+    if (hist_[i] == total) {
+        small_.setTo(Scalar(i));
+        return;
+    }
+    float lutScale = 255.f / (total - hist_[i]);
+    int sum = 0;
+    for (lut[i++] = 0; i < 256; ++i) {
+        sum += hist_[i];
+        lut[i] = saturate_cast<uchar>(sum * lutScale);
+    }
+
+    for (int y = 0; y < small_.rows; y++) {
+        uchar *p = small_.ptr<uchar>(y);
+        for (int x = 0; x < small_.cols; x++) p[x] = lut[p[x]];
+    }
+}
+
+size_t DetectPreprocessor::bufferBytes() const {
+    return small_.total() + (x0_.capacity() + x1_.capacity()) * sizeof(int) +
+           wx_.capacity() * sizeof(short) + grayRow_.capacity() +
+           (rows_[0].capacity() + rows_[1].capacity()) * sizeof(short);
+}
@@ -0,0 +1,54 @@
+#ifndef PREPROCESS_HPP
+#define PREPROCESS_HPP
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+// Cascade input preparation (gray, downscale by 1/scale, equalizeHist) in two
+// passes over buffers that are kept between frames, instead of cvtColor +
+// resize(INTER_LINEAR_EXACT) + equalizeHist with two full-size intermediates:
+//   downscale()  converts each source row the bilinear taps need to gray in a
+//                row buffer, filters it horizontally, blends two filtered rows
+//                into the small image and counts its histogram while the
+//                output row is still in L1;
+//   equalize()   applies the equalizeHist LUT of that histogram in place.
+// Weights are 7-bit fixed point, so pixels can differ from the OpenCV chain
+// by a unit or so; the LUT is built exactly like equalizeHist's.
+class DetectPreprocessor {
+public:
+    DetectPreprocessor();
+
+    // src is BGR (CV_8UC3) or 8-bit gray / an NV21 Y plane (CV_8UC1). Returns
+    // the downscaled, not yet equalized image, which is overwritten by the
+    // next call.
+    cv::Mat &downscale(const cv::Mat &src, double scale);
+    // Equalizes the last downscale() result in place.
+    void equalize();
+
+    cv::Mat &image() { return small_; }
+
+    // Heap memory held by the buffers.
+    size_t bufferBytes() const;
+
+private:
+    void buildTables(cv::Size srcSize, double scale);
+    const short *horizontalRow(const cv::Mat &src, int y, int keep);
+
+    cv::Mat small_;
+    int hist_[256];
+
+    // Column taps, recomputed only when the source size or scale changes.
+    cv::Size srcSize_;
+    double scale_;
+    std::vector<int> x0_, x1_;
+    std::vector<short> wx_;
+
+    // Gray conversion of the source row being filtered (BGR input only).
+    std::vector<uchar> grayRow_;
+    // Two horizontally filtered source rows, reused by consecutive output rows.
+    std::vector<short> rows_[2];
+    int rowY_[2];
+};
+
+#endif  // PREPROCESS_HPP
@@ -0,0 +1,97 @@
+#include "scale_controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+namespace {
+
+// detectMultiScale's pyramid step: DetectorContext's default and the
+// coarsest step the controller goes to.
+const double kBaseScaleFactor = 1.1;
+const double kMaxScaleFactor = 1.3;
+const double kScaleFactorStep = 0.05;
+
+// Settings are given back only below kRelaxBelow of the budget, aiming at
+// kRelaxTarget, so the controller doesn't oscillate around the budget.
+const double kRelaxBelow = 0.6;
+const double kRelaxTarget = 0.8;
+// Headroom added when backing off, and the largest scale change per step.
+const double kBackoffMargin = 1.05;
+const double kMaxStep = 1.5;
+
+}  // namespace
+
+ScaleController::ScaleController(double budgetMs, double minScale, double maxScale)
+    : budgetMs_(budgetMs), minScale_(max(minScale, 1.0)), maxScale_(max(maxScale, minScale_)),
+      scale_(minScale_), scaleFactor_(kBaseScaleFactor), count_(0), next_(0), frames_(0),
+      misses_(0), changes_(0), lowestScale_(scale_), highestScale_(scale_) {}
+
+double ScaleController::windowP95() const {
+    double sorted[kWindow];
+    copy(window_, window_ + count_, sorted);
+    int k = (int) ceil(0.95 * count_) - 1;
+    nth_element(sorted, sorted + k, sorted + count_);
+    return sorted[k];
+}
+
+bool ScaleController::record(double ms) {
+    frames_++;
+    if (ms > budgetMs_) misses_++;
+    window_[next_] = ms;
+    next_ = (next_ + 1) % kWindow;
+    if (count_ < kWindow) count_++;
+    if (count_ < kCooldown) return false;
+
+    double p95 = windowP95();
+    double scale = scale_;
+    double factor = scaleFactor_;
+    if (p95 > budgetMs_) {
+        if (scale_ < maxScale_) {
+            scale = min(maxScale_, scale_ * min(kMaxStep, sqrt(p95 / budgetMs_) * kBackoffMargin));
+        } else {
+            factor = min(kMaxScaleFactor, scaleFactor_ + kScaleFactorStep);
+        }
+    } else if (p95 < budgetMs_ * kRelaxBelow) {
+        if (scaleFactor_ > kBaseScaleFactor + 1e-9) {
+            factor = max(kBaseScaleFactor, scaleFactor_ - kScaleFactorStep);
+        } else {
+            scale = max(minScale_, scale_ / min(kMaxStep, sqrt(budgetMs_ * kRelaxTarget / p95)));
+        }
+    }
+    if (scale == scale_ && factor == scaleFactor_) return false;
+
+    printf("scale controller: p95 %.1f ms, budget %.1f ms: scale %.2f -> %.2f, "
+           "scaleFactor %.2f -> %.2f\n",
+           p95,
+           budgetMs_,
+           scale_,
+           scale,
+           scaleFactor_,
+           factor);
+    scale_ = scale;
+    scaleFactor_ = factor;
+    lowestScale_ = min(lowestScale_, scale_);
+    highestScale_ = max(highestScale_, scale_);
+    changes_++;
+    // Times measured with the old settings say nothing about the new ones.
+    count_ = 0;
+    next_ = 0;
+    return true;
+}
+
+void ScaleController::printStats() const {
+    printf("scale controller: %ld frame(s), %ld over the %.1f ms budget (%.1f%%), "
+           "%ld adjustment(s), scale %.2f (used %.2f-%.2f), scaleFactor %.2f\n",
+           frames_,
+           misses_,
+           budgetMs_,
+           frames_ ? 100.0 * misses_ / frames_ : 0.0,
+           changes_,
+           scale_,
+           lowestScale_,
+           highestScale_,
+           scaleFactor_);
+}
@@ -0,0 +1,55 @@
+#ifndef SCALE_CONTROLLER_HPP
+#define SCALE_CONTROLLER_HPP
+
+// Keeps per-frame detection time under a latency budget by moving the
+// detection downscale factor between bounds, instead of a fixed --scale.
+//
+// The p95 of the last kWindow frame times is checked once kCooldown frames
+// have been measured at the current settings. Over budget, the scale grows
+// by the square root of the overshoot (cascade cost follows the pixel
+// count); once the scale is at its upper bound the pyramid step
+// (detectMultiScale's scaleFactor) coarsens instead. Well under budget,
+// the same knobs are given back in reverse order. Both trade small or
+// in-between-size faces for time, so an overloaded stream keeps its frame
+// rate and loses the smallest faces first. Allocation-free.
+class ScaleController {
+public:
+    static const int kWindow = 30;
+    static const int kCooldown = 10;
+
+    ScaleController(double budgetMs, double minScale, double maxScale);
+
+    double scale() const { return scale_; }
+    double scaleFactor() const { return scaleFactor_; }
+
+    // Detection time of the frame just processed with scale()/scaleFactor().
+    // Returns true when the settings changed for the next frame.
+    bool record(double ms);
+
+    double budgetMs() const { return budgetMs_; }
+    long frames() const { return frames_; }
+    long misses() const { return misses_; }
+
+    void printStats() const;
+
+private:
+    double windowP95() const;
+
+    double budgetMs_;
+    double minScale_;
+    double maxScale_;
+    double scale_;
+    double scaleFactor_;
+
+    double window_[kWindow];   // ring of the latest frame times
+    int count_;                // samples since the last change, capped at kWindow
+    int next_;
+
+    long frames_;
+    long misses_;
+    long changes_;
+    double lowestScale_;
+    double highestScale_;
+};
+
+#endif  // SCALE_CONTROLLER_HPP
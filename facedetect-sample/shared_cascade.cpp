@@ -0,0 +1,25 @@
+#include "shared_cascade.hpp"
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace cv;
+
+bool SharedCascade::load(const string &path) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in) return false;
+    stringstream xml;
+    xml << in.rdbuf();
+
+    // Parsed once here; instantiate() only walks the tree.
+    if (!fs_.open(xml.str(), FileStorage::READ | FileStorage::MEMORY)) return false;
+    path_ = path;
+    loaded_ = true;
+    return true;
+}
+
+bool SharedCascade::instantiate(CascadeClassifier &classifier) const {
+    if (!loaded_) return false;
+    return classifier.read(fs_.getFirstTopLevelNode());
+}
@@ -0,0 +1,33 @@
+#ifndef SHARED_CASCADE_HPP
+#define SHARED_CASCADE_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include <string>
+
+// Cascade XML read and parsed once. Worker classifiers are instantiated from
+// the parsed tree instead of re-reading and re-parsing the file per stream.
+// cv::CascadeClassifier keeps its detection buffers inside the object, so a
+// classifier can't be used by two threads at once; the stream server and
+// TileDetector therefore create one per thread from this tree.
+class SharedCascade {
+public:
+    SharedCascade() : loaded_(false) {}
+
+    bool load(const std::string &path);
+    bool empty() const { return !loaded_; }
+
+    // Builds a classifier from the parsed tree. Not thread-safe, call it
+    // before the workers start.
+    bool instantiate(cv::CascadeClassifier &classifier) const;
+
+    const std::string &path() const { return path_; }
+
+private:
+    std::string path_;
+    cv::FileStorage fs_;
+    bool loaded_;
+};
+
+#endif  // SHARED_CASCADE_HPP
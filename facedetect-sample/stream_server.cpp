@@ -0,0 +1,403 @@
+#include "stream_server.hpp"
+
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/videoio.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "alloc_counter.hpp"
+#include "detector.hpp"
+#include "scale_controller.hpp"
+#include "two_tier_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+enum SourceKind { SOURCE_FILE, SOURCE_CAMERA, SOURCE_STILL };
+
+// Fixed-capacity frame queue. Frames move in and out by swapping Mat headers,
+// so a stream's pixel buffers circulate between its capture thread, the slots
+// and the frame being detected instead of being allocated for every frame.
+class FrameRing {
+public:
+    FrameRing() : head_(0), count_(0) {}
+
+    void init(size_t capacity) { slots_.resize(capacity); }
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == slots_.size(); }
+
+    // frame gets back the recycled buffer of the slot it is stored in.
+    void push(Mat &frame) {
+        cv::swap(slots_[(head_ + count_) % slots_.size()], frame);
+        count_++;
+    }
+    // The previous content of frame is left in the slot for reuse.
+    void pop(Mat &frame) {
+        cv::swap(slots_[head_], frame);
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+    }
+    void dropOldest() {
+        head_ = (head_ + 1) % slots_.size();
+        count_--;
+    }
+
+    size_t bufferBytes() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < slots_.size(); i++) {
+            bytes += slots_[i].total() * slots_[i].elemSize();
+        }
+        return bytes;
+    }
+
+private:
+    vector<Mat> slots_;
+    size_t head_;
+    size_t count_;
+};
+
+struct Stream {
+    explicit Stream(const StreamServerOptions &options)
+        : controller(options.latencyBudget, options.scale, options.maxScale),
+          detector(options.scale, options.tryflip, options.motionGate, options.motionThreshold) {
+        queue.init(options.queueDepth);
+        if (options.latencyBudget > 0) detector.setScaleController(&controller);
+    }
+
+    string name;
+    SourceKind kind;
+    VideoCapture capture;
+    Mat still;
+
+    // Guarded by StreamServer::lock_.
+    FrameRing queue;
+    bool finished = false;
+    bool busy = false;   // a worker is processing a frame of this stream
+    long captured = 0;
+    long processed = 0;
+    long dropped = 0;
+    long faces = 0;
+    double detectMs = 0;
+    long depthSum = 0;
+    long depthSamples = 0;
+    size_t maxDepth = 0;
+    long reportedProcessed = 0;
+
+    // Only touched by the worker that owns the stream (busy == true).
+    Mat frame;
+    ScaleController controller;
+    unique_ptr<TwoTierDetector> twoTier;   // has its own LBP classifier, see two_tier_detector.hpp
+    DetectorContext detector;
+};
+
+class StreamServer {
+public:
+    StreamServer(const StreamServerOptions &options) : options_(options), cursor_(0) {}
+
+    bool addSource(const string &source);
+    bool addWorkers(int count, const SharedCascade &cascade, const SharedCascade &nestedCascade);
+    int run();
+
+private:
+    void captureLoop(Stream *s);
+    void workerLoop(int index);
+    Stream *nextStream();
+    bool allDone() const;
+    void report(double seconds, double sinceStart);
+    bool summary(double seconds);
+
+    StreamServerOptions options_;
+    vector<unique_ptr<Stream> > streams_;
+    vector<unique_ptr<CascadeClassifier> > cascades_;
+    vector<unique_ptr<CascadeClassifier> > nestedCascades_;
+
+    mutable mutex lock_;
+    condition_variable ready_;   // a frame was queued, a stream became free or finished
+    condition_variable space_;   // a file stream's queue has room again
+    size_t cursor_;              // round-robin position
+};
+
+bool StreamServer::addSource(const string &source) {
+    unique_ptr<Stream> s(new Stream(options_));
+    s->name = source;
+    if (options_.proposer) {
+        s->twoTier.reset(new TwoTierDetector(*options_.proposer));
+        if (!s->twoTier->ok()) {
+            cerr << "Could not build the LBP classifier from " << options_.proposer->path() << endl;
+            return false;
+        }
+        s->detector.setTwoTierDetector(s->twoTier.get());
+    }
+
+    if (source.compare(0, 6, "still:") == 0) {
+        s->kind = SOURCE_STILL;
+        s->still = imread(samples::findFileOrKeep(source.substr(6)), IMREAD_COLOR);
+        if (s->still.empty()) {
+            cerr << "Could not read " << source.substr(6) << endl;
+            return false;
+        }
+    } else if (source.size() == 1 && isdigit(source[0])) {
+        s->kind = SOURCE_CAMERA;
+        if (!s->capture.open(source[0] - '0')) {
+            cerr << "Capture from camera #" << source << " didn't work" << endl;
+            return false;
+        }
+    } else {
+        s->kind = SOURCE_FILE;
+        if (!s->capture.open(samples::findFileOrKeep(source))) {
+            // A single image works as a still camera too.
+            s->kind = SOURCE_STILL;
+            s->still = imread(samples::findFileOrKeep(source), IMREAD_COLOR);
+            if (s->still.empty()) {
+                cerr << "Could not read " << source << endl;
+                return false;
+            }
+        }
+    }
+    streams_.push_back(move(s));
+    return true;
+}
+
+bool StreamServer::addWorkers(int count, const SharedCascade &cascade,
+                              const SharedCascade &nestedCascade) {
+    for (int i = 0; i < count; i++) {
+        unique_ptr<CascadeClassifier> c(new CascadeClassifier());
+        unique_ptr<CascadeClassifier> n(new CascadeClassifier());
+        if (!cascade.instantiate(*c)) return false;
+        // The nested cascade is optional, an empty classifier disables it.
+        if (!nestedCascade.empty()) nestedCascade.instantiate(*n);
+        cascades_.push_back(move(c));
+        nestedCascades_.push_back(move(n));
+    }
+    return true;
+}
+
+void StreamServer::captureLoop(Stream *s) {
+    bool live = s->kind != SOURCE_FILE;
+    Clock::duration period = chrono::duration_cast<Clock::duration>(
+        chrono::duration<double>(1.0 / max(options_.stillFps, 1.0)));
+    Clock::time_point next = Clock::now();
+
+    Mat frame;   // decoded into the buffer the queue handed back last time
+    for (long n = 0;; n++) {
+        if (live && options_.liveFrames > 0 && n >= options_.liveFrames) break;
+
+        if (s->kind == SOURCE_STILL) {
+            this_thread::sleep_until(next);
+            next += period;
+            frame = s->still;   // detection only reads the frame
+        } else if (!s->capture.read(frame) || frame.empty()) {
+            break;
+        }
+
+        unique_lock<mutex> lk(lock_);
+        if (live) {
+            // A camera doesn't wait for us: keep the newest frames.
+            if (s->queue.full()) {
+                s->queue.dropOldest();
+                s->dropped++;
+            }
+        } else {
+            while (s->queue.full()) space_.wait(lk);
+        }
+        s->queue.push(frame);
+        s->captured++;
+        s->depthSum += s->queue.size();
+        s->depthSamples++;
+        s->maxDepth = max(s->maxDepth, s->queue.size());
+        ready_.notify_one();
+    }
+
+    lock_guard<mutex> lk(lock_);
+    s->finished = true;
+    ready_.notify_all();
+}
+
+Stream *StreamServer::nextStream() {
+    for (size_t i = 0; i < streams_.size(); i++) {
+        size_t index = (cursor_ + i) % streams_.size();
+        Stream *s = streams_[index].get();
+        if (!s->busy && !s->queue.empty()) {
+            cursor_ = index + 1;
+            return s;
+        }
+    }
+    return NULL;
+}
+
+bool StreamServer::allDone() const {
+    for (size_t i = 0; i < streams_.size(); i++) {
+        const Stream *s = streams_[i].get();
+        if (!s->finished || s->busy || !s->queue.empty()) return false;
+    }
+    return true;
+}
+
+void StreamServer::workerLoop(int index) {
+    CascadeClassifier &cascade = *cascades_[index];
+    CascadeClassifier &nestedCascade = *nestedCascades_[index];
+
+    unique_lock<mutex> lk(lock_);
+    for (;;) {
+        Stream *s = nextStream();
+        if (!s) {
+            if (allDone()) break;
+            ready_.wait(lk);
+            continue;
+        }
+
+        s->queue.pop(s->frame);
+        s->busy = true;
+        space_.notify_all();
+        lk.unlock();
+
+        const DetectionResult &result = s->detector.detect(s->frame, cascade, nestedCascade);
+
+        lk.lock();
+        s->busy = false;
+        s->processed++;
+        s->faces += (long) result.faces.size();
+        s->detectMs += result.ms;
+        ready_.notify_all();
+    }
+    ready_.notify_all();
+}
+
+void StreamServer::report(double seconds, double sinceStart) {
+    lock_guard<mutex> lk(lock_);
+    printf("---- %.1f s ----\n", sinceStart);
+    printf("%-3s %-32s %8s %14s %8s %8s\n", "id", "source", "fps", "queue cur/avg/max", "dropped",
+           "frames");
+    for (size_t i = 0; i < streams_.size(); i++) {
+        Stream *s = streams_[i].get();
+        double fps = (s->processed - s->reportedProcessed) / seconds;
+        s->reportedProcessed = s->processed;
+        printf("%-3d %-32.32s %8.1f %4d/%4.1f/%4d %8ld %8ld\n",
+               (int) i,
+               s->name.c_str(),
+               fps,
+               (int) s->queue.size(),
+               s->depthSamples ? (double) s->depthSum / s->depthSamples : 0.0,
+               (int) s->maxDepth,
+               s->dropped,
+               s->processed);
+    }
+}
+
+bool StreamServer::summary(double seconds) {
+    lock_guard<mutex> lk(lock_);
+    long total = 0;
+    bool allocFree = true;
+    printf("==== %d stream(s), %d worker(s), %.1f s ====\n",
+           (int) streams_.size(),
+           (int) cascades_.size(),
+           seconds);
+    for (size_t i = 0; i < streams_.size(); i++) {
+        const Stream *s = streams_[i].get();
+        total += s->processed;
+        printf("%-3d %-32.32s fps %6.1f  frames %6ld  dropped %5ld  avg queue %4.1f  "
+               "avg detect %7.2f ms  faces %ld\n",
+               (int) i,
+               s->name.c_str(),
+               s->processed / seconds,
+               s->processed,
+               s->dropped,
+               s->depthSamples ? (double) s->depthSum / s->depthSamples : 0.0,
+               s->processed ? s->detectMs / s->processed : 0.0,
+               s->faces);
+        printf("    buffers: detector %.1f KB, frame queue %.1f KB\n",
+               s->detector.bufferBytes() / 1024.0,
+               (s->queue.bufferBytes() + s->frame.total() * s->frame.elemSize()) / 1024.0);
+        if (s->detector.gate()) s->detector.gate()->printStats();
+        if (options_.latencyBudget > 0) {
+            printf("    ");
+            s->controller.printStats();
+        }
+        if (s->twoTier) {
+            printf("    ");
+            s->twoTier->printStats();
+        }
+        if (options_.allocCheck) {
+            printf("    ");
+            s->detector.printAllocStats();
+            const DetectorContext::AllocStats &stats = s->detector.allocStats();
+            if (!allocCounterEnabled() || stats.frames == 0 || stats.allocs != 0) {
+                allocFree = false;
+            }
+        }
+    }
+    double rss = peakRssBytes() / (1024.0 * 1024.0);
+    printf("total fps %.1f  peak RSS %.1f MB (%.1f MB per stream)\n",
+           total / seconds,
+           rss,
+           streams_.empty() ? 0.0 : rss / streams_.size());
+    return allocFree;
+}
+
+int StreamServer::run() {
+    Clock::time_point start = Clock::now();
+
+    vector<thread> threads;
+    for (size_t i = 0; i < streams_.size(); i++) {
+        threads.push_back(thread(&StreamServer::captureLoop, this, streams_[i].get()));
+    }
+    for (size_t i = 0; i < cascades_.size(); i++) {
+        threads.push_back(thread(&StreamServer::workerLoop, this, (int) i));
+    }
+
+    Clock::time_point last = start;
+    for (;;) {
+        {
+            unique_lock<mutex> lk(lock_);
+            ready_.wait_for(lk,
+                            chrono::duration<double>(options_.reportInterval),
+                            [this] { return allDone(); });
+            if (allDone()) break;
+        }
+        Clock::time_point now = Clock::now();
+        report(chrono::duration<double>(now - last).count(),
+               chrono::duration<double>(now - start).count());
+        last = now;
+    }
+
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    if (!summary(chrono::duration<double>(Clock::now() - start).count())) {
+        cerr << "alloc check FAILED: steady-state detection allocated" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int runStreamServer(const vector<string> &sources, const SharedCascade &cascade,
+                    const SharedCascade &nestedCascade, const StreamServerOptions &options) {
+    StreamServerOptions opts = options;
+    if (opts.workers <= 0) opts.workers = max(1, (int) thread::hardware_concurrency());
+    if (opts.queueDepth < 1) opts.queueDepth = 1;
+    if (opts.reportInterval <= 0) opts.reportInterval = 2;
+
+    StreamServer server(opts);
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (!server.addSource(sources[i])) return 1;
+    }
+    if (!server.addWorkers(opts.workers, cascade, nestedCascade)) {
+        cerr << "ERROR: Could not build classifier from " << cascade.path() << endl;
+        return -1;
+    }
+    printf("serving %d stream(s) with %d worker(s), cascade %s parsed once\n",
+           (int) sources.size(),
+           opts.workers,
+           cascade.path().c_str());
+    return server.run();
+}
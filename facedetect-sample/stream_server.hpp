@@ -0,0 +1,41 @@
+#ifndef STREAM_SERVER_HPP
+#define STREAM_SERVER_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include <string>
+#include <vector>
+
+#include "shared_cascade.hpp"
+
+struct StreamServerOptions {
+    int workers;           // detection threads, <= 0 for the core count
+    int queueDepth;        // per-stream frame queue capacity
+    int liveFrames;        // frames produced by camera/still sources, <= 0 = no limit
+    double stillFps;       // frame rate of still:<image> stand-in cameras
+    double scale;
+    bool tryflip;
+    bool motionGate;
+    double motionThreshold;
+    double reportInterval; // seconds between per-stream reports
+    bool allocCheck;       // report detector allocations, fail if steady state allocates
+    double latencyBudget;  // per-stream p95 detection budget in ms, <= 0 = fixed scale
+    double maxScale;       // largest scale the latency budget may move a stream to
+    const SharedCascade *proposer;  // LBP cascade for two-tier detection, NULL = off
+};
+
+// Runs detection for several sources at once. Sources:
+//   <video file>      decoded as fast as the workers keep up (blocks when full)
+//   <digit>           local camera index
+//   still:<image>     the image replayed at stillFps, stand-in for a camera
+// Live sources (camera, still) drop their oldest queued frame when the queue
+// is full. Workers pick the next stream with a queued frame in round-robin
+// order and a stream is handled by one worker at a time, so frames of a
+// stream are processed in order and every stream gets an equal turn. Each
+// stream owns a DetectorContext and a fixed ring of frame buffers, so serving
+// doesn't allocate per frame once they are warm.
+int runStreamServer(const std::vector<std::string> &sources, const SharedCascade &cascade,
+                    const SharedCascade &nestedCascade, const StreamServerOptions &options);
+
+#endif  // STREAM_SERVER_HPP
@@ -0,0 +1,177 @@
+#include "tile_detector.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <utility>
+
+#include "alloc_counter.hpp"
+#include "detector.hpp"
+#include "perf_regions.h"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// Tiles per thread, so that a slow tile (a crowd) doesn't hold up the rest.
+const int kTilesPerThread = 2;
+
+// Splits [0, length) into n ranges of step + overlap, the last one clipped.
+void splitAxis(int length, int tile, int overlap, vector<Range> &ranges) {
+    ranges.clear();
+    int n = length <= tile ? 1 : (length - overlap + (tile - overlap) - 1) / (tile - overlap);
+    int step = (length - overlap + n - 1) / n;
+    for (int i = 0; i < n; i++) {
+        int begin = i * step;
+        ranges.push_back(Range(begin, min(begin + step + overlap, length)));
+    }
+}
+
+// Distance from r to the nearest tile edge that lies inside the image; a hit
+// close to such an edge may be a face cut off by the tile.
+int innerMargin(const Rect &r, const Rect &tile, Size image) {
+    int margin = INT_MAX;
+    if (tile.x > 0) margin = min(margin, r.x - tile.x);
+    if (tile.y > 0) margin = min(margin, r.y - tile.y);
+    if (tile.x + tile.width < image.width) margin = min(margin, tile.br().x - r.br().x);
+    if (tile.y + tile.height < image.height) margin = min(margin, tile.br().y - r.br().y);
+    return margin;
+}
+
+}  // namespace
+
+TileDetector::TileDetector(const SharedCascade &cascade, int threads, int maxFace)
+    : maxFace_(max(maxFace, kMinFaceSize)), ok_(true), scaleFactor_(1.1), next_(0), running_(0),
+      generation_(0), stop_(false) {
+    if (threads <= 0) threads = max(1, (int) thread::hardware_concurrency());
+    for (int i = 1; i < threads; i++) {
+        unique_ptr<CascadeClassifier> classifier(new CascadeClassifier());
+        if (!cascade.instantiate(*classifier)) ok_ = false;
+        classifiers_.push_back(move(classifier));
+    }
+    if (!ok_) return;
+    for (size_t i = 0; i < classifiers_.size(); i++) {
+        workers_.push_back(thread(&TileDetector::workerLoop, this, (int) i));
+    }
+}
+
+TileDetector::~TileDetector() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+}
+
+void TileDetector::buildTasks(Size size) {
+    int threads = (int) workers_.size() + 1;
+    int overlap = maxFace_;
+    // Square-ish tiles, at least twice the overlap so that it stays the
+    // smaller part of the work.
+    double area = (double) size.width * size.height / (threads * kTilesPerThread);
+    int tile = max(2 * overlap, (int) sqrt(area) + overlap);
+    if (threads == 1) tile = max(size.width, size.height);   // nothing to gain from tiles
+
+    vector<Range> cols, rows;
+    splitAxis(size.width, tile, overlap, cols);
+    splitAxis(size.height, tile, overlap, rows);
+
+    tasks_.clear();
+    // Large faces first: that task covers the whole image.
+    if (maxFace_ < min(size.width, size.height) && cols.size() * rows.size() > 1) {
+        Task task;
+        task.roi = Rect(0, 0, size.width, size.height);
+        task.minSize = Size(maxFace_ + 1, maxFace_ + 1);
+        tasks_.push_back(task);
+    }
+    for (size_t y = 0; y < rows.size(); y++) {
+        for (size_t x = 0; x < cols.size(); x++) {
+            Task task;
+            task.roi = Rect(cols[x].start, rows[y].start, cols[x].size(), rows[y].size());
+            task.minSize = Size(kMinFaceSize, kMinFaceSize);
+            // A single tile is the plain whole-image search.
+            if (cols.size() * rows.size() > 1) task.maxSize = Size(maxFace_, maxFace_);
+            tasks_.push_back(task);
+        }
+    }
+    size_ = size;
+}
+
+void TileDetector::runTasks(CascadeClassifier &classifier) {
+    for (;;) {
+        int index;
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (next_ >= (int) tasks_.size()) return;
+            index = next_++;
+        }
+        Task &task = tasks_[index];
+        AllocExcludeScope cascadeAllocs;
+        classifier.detectMultiScale(img_(task.roi),
+                                    task.found,
+                                    scaleFactor_,
+                                    kFaceMinNeighbors,
+                                    CASCADE_SCALE_IMAGE,
+                                    task.minSize,
+                                    task.maxSize);
+    }
+}
+
+void TileDetector::workerLoop(int index) {
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(mutex_);
+            while (!stop_ && generation_ == seen) wake_.wait(lock);
+            if (stop_) return;
+            seen = generation_;
+        }
+        runTasks(*classifiers_[index]);
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (--running_ == 0) done_.notify_one();
+        }
+    }
+}
+
+void TileDetector::detect(const Mat &img, CascadeClassifier &cascade, vector<Rect> &faces,
+                          double scaleFactor) {
+    if (img.size() != size_) buildTasks(img.size());
+
+    {
+        PERF_SCOPE("detectMultiScale(tiles)");
+        {
+            lock_guard<mutex> lock(mutex_);
+            img_ = img;
+            scaleFactor_ = scaleFactor;
+            next_ = 0;
+            running_ = (int) workers_.size();
+            generation_++;
+        }
+        wake_.notify_all();
+        runTasks(cascade);
+        unique_lock<mutex> lock(mutex_);
+        while (running_ > 0) done_.wait(lock);
+    }
+
+    faces.clear();
+    margins_.clear();
+    for (size_t t = 0; t < tasks_.size(); t++) {
+        const Task &task = tasks_[t];
+        for (size_t i = 0; i < task.found.size(); i++) {
+            Rect r = task.found[i] + task.roi.tl();
+            int margin = innerMargin(r, task.roi, img.size());
+            size_t j = 0;
+            while (j < faces.size() && !sameFace(r, faces[j])) j++;
+            if (j == faces.size()) {
+                faces.push_back(r);
+                margins_.push_back(margin);
+            } else if (margin > margins_[j]) {
+                faces[j] = r;
+                margins_[j] = margin;
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef TILE_DETECTOR_HPP
+#define TILE_DETECTOR_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "shared_cascade.hpp"
+
+// Face detection on one large image spread over several threads. Our OpenCV
+// build has no parallel backend, so a single detectMultiScale call runs on
+// one core however big the frame is.
+//
+// The image is split into a grid of tiles overlapping by maxFace pixels:
+// any face up to maxFace wide then lies entirely inside at least one tile,
+// and the tiles only search windows up to that size. Faces above maxFace are
+// left to one extra whole-image task restricted to the larger windows, which
+// is cheap since it only visits the coarse pyramid levels. Tasks are pulled
+// by persistent worker threads, each with its own classifier, and by the
+// calling thread. Hits are merged in task order: of two overlapping hits the
+// one farther from an inner tile edge is kept, so the result doesn't depend
+// on the thread count or timing.
+class TileDetector {
+public:
+    // threads counts the caller, <= 0 for the core count. maxFace is in
+    // pixels of the image passed to detect().
+    TileDetector(const SharedCascade &cascade, int threads, int maxFace);
+    ~TileDetector();
+
+    // False if a worker classifier couldn't be built.
+    bool ok() const { return ok_; }
+
+    // Same search as the single-call detectMultiScale (kFaceMinNeighbors,
+    // kMinFaceSize). cascade is used by the calling thread. faces is replaced
+    // with the merged hits in img coordinates.
+    void detect(const cv::Mat &img, cv::CascadeClassifier &cascade, std::vector<cv::Rect> &faces,
+                double scaleFactor = 1.1);
+
+    int threads() const { return (int) workers_.size() + 1; }
+    // Tasks of the last detect(), including the large-face pass.
+    int tasks() const { return (int) tasks_.size(); }
+
+private:
+    TileDetector(const TileDetector &);
+    TileDetector &operator=(const TileDetector &);
+
+    struct Task {
+        cv::Rect roi;
+        cv::Size minSize;
+        cv::Size maxSize;
+        std::vector<cv::Rect> found;
+    };
+
+    void buildTasks(cv::Size size);
+    void runTasks(cv::CascadeClassifier &classifier);
+    void workerLoop(int index);
+
+    int maxFace_;
+    bool ok_;
+    cv::Size size_;                 // image size the tasks were built for
+    std::vector<Task> tasks_;
+    std::vector<int> margins_;      // of the merged hits, see detect()
+    std::vector<std::unique_ptr<cv::CascadeClassifier> > classifiers_;
+    std::vector<std::thread> workers_;
+
+    cv::Mat img_;
+    double scaleFactor_;
+    int next_;                      // next task to take, under mutex_
+    int running_;                   // workers still busy with this image
+    unsigned long generation_;      // bumped for every image
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+};
+
+#endif  // TILE_DETECTOR_HPP
@@ -0,0 +1,98 @@
+#include "two_tier_detector.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "alloc_counter.hpp"
+#include "detector.hpp"
+#include "perf_regions.h"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// The two cascades were trained on differently framed faces: the LBP box is
+// tighter than the Haar one and drifts by a few pixels. The Haar search
+// covers the candidate grown by kExpand of its width on every side, with
+// windows from 1/kSizeRange to kSizeRange times the candidate's size.
+const double kExpand = 0.35;
+const double kSizeRange = 1.4;
+
+const size_t kReservedCandidates = 64;
+
+}  // namespace
+
+TwoTierDetector::TwoTierDetector(const SharedCascade &proposer)
+    : ok_(proposer.instantiate(proposer_)), calls_(0), candidateCount_(0), confirmed_(0),
+      proposeMs_(0), verifyMs_(0) {
+    candidates_.reserve(kReservedCandidates);
+    hits_.reserve(kReservedCandidates);
+}
+
+void TwoTierDetector::detect(const Mat &img, CascadeClassifier &verifier, vector<Rect> &faces,
+                             double scaleFactor) {
+    faces.clear();
+    int64 t0 = getTickCount();
+    {
+        PERF_SCOPE("two-tier propose");
+        AllocExcludeScope cascadeAllocs;
+        proposer_.detectMultiScale(img,
+                                   candidates_,
+                                   scaleFactor,
+                                   kFaceMinNeighbors,
+                                   CASCADE_SCALE_IMAGE,
+                                   Size(kMinFaceSize, kMinFaceSize));
+    }
+    int64 t1 = getTickCount();
+
+    Rect bounds(0, 0, img.cols, img.rows);
+    {
+        PERF_SCOPE("two-tier verify");
+        for (size_t i = 0; i < candidates_.size(); i++) {
+            const Rect &c = candidates_[i];
+            int pad = cvRound(c.width * kExpand);
+            Rect roi = Rect(c.x - pad, c.y - pad, c.width + 2 * pad, c.height + 2 * pad) & bounds;
+            int minSide = max(kMinFaceSize, cvFloor(c.width / kSizeRange));
+            int maxSide = min(min(roi.width, roi.height), cvCeil(c.width * kSizeRange));
+            if (maxSide < minSide) continue;
+
+            {
+                AllocExcludeScope cascadeAllocs;
+                verifier.detectMultiScale(img(roi),
+                                          hits_,
+                                          scaleFactor,
+                                          kFaceMinNeighbors,
+                                          CASCADE_SCALE_IMAGE,
+                                          Size(minSide, minSide),
+                                          Size(maxSide, maxSide));
+            }
+            // Expanded ROIs of neighbouring candidates overlap, so the same
+            // face can be confirmed twice.
+            for (size_t j = 0; j < hits_.size(); j++) {
+                Rect r = hits_[j] + roi.tl();
+                bool seen = false;
+                for (size_t k = 0; k < faces.size() && !seen; k++) seen = sameFace(r, faces[k]);
+                if (!seen) faces.push_back(r);
+            }
+        }
+    }
+    int64 t2 = getTickCount();
+
+    calls_++;
+    candidateCount_ += (long) candidates_.size();
+    confirmed_ += (long) faces.size();
+    proposeMs_ += (t1 - t0) * 1000.0 / getTickFrequency();
+    verifyMs_ += (t2 - t1) * 1000.0 / getTickFrequency();
+}
+
+void TwoTierDetector::printStats() const {
+    if (calls_ == 0) return;
+    printf("two-tier: %ld search(es), %.1f LBP candidate(s) and %.1f confirmed per search, "
+           "LBP %.2f ms + Haar %.2f ms\n",
+           calls_,
+           (double) candidateCount_ / calls_,
+           (double) confirmed_ / calls_,
+           proposeMs_ / calls_,
+           verifyMs_ / calls_);
+}
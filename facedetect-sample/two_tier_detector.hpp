@@ -0,0 +1,52 @@
+#ifndef TWO_TIER_DETECTOR_HPP
+#define TWO_TIER_DETECTOR_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/objdetect.hpp"
+
+#include <vector>
+
+#include "shared_cascade.hpp"
+
+// Face detection in two tiers. A fast but noisier LBP cascade searches the
+// whole pyramid and proposes candidate windows; the caller's Haar cascade
+// then re-checks each candidate on a slightly expanded ROI, restricted to
+// window sizes around the candidate's, and only confirmed windows are kept.
+// The cost is the LBP pass plus a few small Haar searches instead of a full
+// Haar pyramid, while a false LBP hit still has to pass the Haar cascade.
+// Faces the LBP cascade misses are lost, so recall is bounded by LBP's.
+//
+// Holds its own LBP classifier: attach one per DetectorContext (a context is
+// only used by one thread at a time).
+class TwoTierDetector {
+public:
+    explicit TwoTierDetector(const SharedCascade &proposer);
+
+    // False if the LBP classifier couldn't be built.
+    bool ok() const { return ok_; }
+
+    // Same search as the single-call detectMultiScale (kFaceMinNeighbors,
+    // kMinFaceSize). faces is replaced with the confirmed windows in img
+    // coordinates.
+    void detect(const cv::Mat &img, cv::CascadeClassifier &verifier, std::vector<cv::Rect> &faces,
+                double scaleFactor = 1.1);
+
+    void printStats() const;
+
+private:
+    TwoTierDetector(const TwoTierDetector &);
+    TwoTierDetector &operator=(const TwoTierDetector &);
+
+    cv::CascadeClassifier proposer_;
+    bool ok_;
+    std::vector<cv::Rect> candidates_;
+    std::vector<cv::Rect> hits_;
+
+    long calls_;
+    long candidateCount_;
+    long confirmed_;
+    double proposeMs_;
+    double verifyMs_;
+};
+
+#endif  // TWO_TIER_DETECTOR_HPP
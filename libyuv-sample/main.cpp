@@ -1,9 +1,75 @@
 #include "libyuv.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <png.h>
 #include <jpeglib.h>
+#include <sys/resource.h>
+
+#include "mjpeg_decoder.hpp"
+#include "nv21_affine_dispatch.h"
+
+// Rows held between png_read_row and jpeg_write_scanlines. A multiple of the
+// largest JPEG MCU height (16 rows with 4:2:0 subsampling), so every batch
+// completes whole MCU rows and the encoder can emit them right away.
+static const png_uint_32 kRingRows = 16;
+static const size_t kOutputBufferSize = 16 * 1024;
+
+// JPEG destination writing through a fixed buffer to a FILE, remembering when
+// the first compressed bytes went out.
+struct StreamDest {
+    jpeg_destination_mgr pub;
+    FILE *fp;
+    JOCTET *buffer;
+    size_t size;
+    size_t bytes;
+    std::chrono::steady_clock::time_point start;
+    double firstByteMs;   // < 0 until the first flush
+};
+
+static void flushDest(StreamDest *dest, size_t n) {
+    if (n == 0) return;
+    fwrite(dest->buffer, 1, n, dest->fp);
+    if (dest->bytes == 0) {
+        dest->firstByteMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - dest->start).count();
+    }
+    dest->bytes += n;
+}
 
+static void initDest(j_compress_ptr cinfo) {
+    StreamDest *dest = (StreamDest *)cinfo->dest;
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = dest->size;
+}
+
+static boolean emptyDest(j_compress_ptr cinfo) {
+    StreamDest *dest = (StreamDest *)cinfo->dest;
+    flushDest(dest, dest->size);
+    initDest(cinfo);
+    return TRUE;
+}
+
+static void termDest(j_compress_ptr cinfo) {
+    StreamDest *dest = (StreamDest *)cinfo->dest;
+    flushDest(dest, dest->size - dest->pub.free_in_buffer);
+    fflush(dest->fp);
+}
+
+static double peakRssMB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;   // kilobytes on Linux
+}
+
+// Streams PNG rows into the JPEG encoder: png_read_row fills a ring of
+// kRingRows rows and each filled batch goes straight to jpeg_write_scanlines,
+// so decode and encode interleave and the working memory (ring + output
+// buffer, one allocation) doesn't depend on the image height. Interlaced PNGs
+// only finish their rows in the last Adam7 pass and are buffered whole.
 int pngTorgb(const char* pngFile, const char* jpgFile) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     FILE *fp = fopen(pngFile, "rb");
     if (!fp) {
         std::cerr << "Error opening PNG file: " << pngFile << "\n";
@@ -56,46 +122,27 @@ int pngTorgb(const char* pngFile, const char* jpgFile) {
         color_type == PNG_COLOR_TYPE_GRAY ||
         color_type == PNG_COLOR_TYPE_PALETTE)
         png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER); // Add alpha channel if missing
+    int passes = png_set_interlace_handling(png_ptr);
 
     png_read_update_info(png_ptr, info_ptr); // Update info after transformations
 
-    // Allocate memory for image data
-    png_bytep *row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * height);
-    if (!row_pointers) {
+    // Row ring and JPEG output buffer in one allocation
+    size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
+    png_uint_32 ring_rows = passes > 1 ? height : kRingRows;
+    size_t ring_bytes = row_bytes * ring_rows;
+    unsigned char *block = (unsigned char *)malloc(ring_bytes + kOutputBufferSize);
+    if (!block) {
         png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
         fclose(fp);
         return 1;
     }
 
-    for (png_uint_32 y = 0; y < height; y++) {
-        row_pointers[y] = (png_byte *)malloc(png_get_rowbytes(png_ptr, info_ptr));
-        if (!row_pointers[y]) {
-            // Handle allocation error and free previously allocated rows
-            for (png_uint_32 i = 0; i < y; ++i) {
-                free(row_pointers[i]);
-            }
-            free(row_pointers);
-            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-            fclose(fp);
-            return 1;
-        }
-    }
-
-    // Read the entire image
-    png_read_image(png_ptr, row_pointers);
-
-    // Image data is now in row_pointers. You can process it here.
-    // For example, print the first pixel's RGBA values:
-    if (height > 0 && width > 0) {
-        printf("First pixel (RGBA): %d %d %d %d\n",
-               row_pointers[0][0], row_pointers[0][1],
-               row_pointers[0][2], row_pointers[0][3]);
-    }
-
-    // save JPEG file
     FILE *jpeg_fp = fopen(jpgFile, "wb");
     if (!jpeg_fp) {
         std::cerr << "Error opening JPEG file: " << jpgFile << "\n";
+        free(block);
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
         return -1;
     }
 
@@ -104,7 +151,28 @@ int pngTorgb(const char* pngFile, const char* jpgFile) {
     struct jpeg_error_mgr jerr;
     cinfo.err = jpeg_std_error(&jerr);
     jpeg_create_compress(&cinfo);
-    jpeg_stdio_dest(&cinfo, jpeg_fp);
+
+    StreamDest dest;
+    dest.pub.init_destination = initDest;
+    dest.pub.empty_output_buffer = emptyDest;
+    dest.pub.term_destination = termDest;
+    dest.fp = jpeg_fp;
+    dest.buffer = block + ring_bytes;
+    dest.size = kOutputBufferSize;
+    dest.bytes = 0;
+    dest.start = start;
+    dest.firstByteMs = -1;
+    cinfo.dest = &dest.pub;
+
+    // A PNG error from here on also has to release the encoder and the output.
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        jpeg_destroy_compress(&cinfo);
+        fclose(jpeg_fp);
+        free(block);
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        fclose(fp);
+        return 1;
+    }
 
     // Set JPEG parameters
     cinfo.image_width = width;
@@ -114,22 +182,48 @@ int pngTorgb(const char* pngFile, const char* jpgFile) {
     jpeg_set_defaults(&cinfo);
     jpeg_start_compress(&cinfo, TRUE);
 
-    // Write image data
-    while (cinfo.next_scanline < cinfo.image_height) {
-        JSAMPROW row_pointer[1];
-        row_pointer[0] = (JSAMPROW)row_pointers[cinfo.next_scanline];
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    if (passes > 1) {
+        for (int pass = 0; pass < passes; pass++) {
+            for (png_uint_32 y = 0; y < height; y++) {
+                png_read_row(png_ptr, block + y * row_bytes, NULL);
+            }
+        }
+    }
+
+    JSAMPROW rows[kRingRows];
+    while (cinfo.next_scanline < height) {
+        png_uint_32 n = std::min(kRingRows, height - cinfo.next_scanline);
+        for (png_uint_32 i = 0; i < n; i++) {
+            if (passes > 1) {
+                rows[i] = block + (cinfo.next_scanline + i) * row_bytes;
+            } else {
+                rows[i] = block + i * row_bytes;
+                png_read_row(png_ptr, rows[i], NULL);
+            }
+        }
+        if (cinfo.next_scanline == 0 && width > 0) {
+            printf("First pixel (RGBA): %d %d %d %d\n",
+                   rows[0][0], rows[0][1], rows[0][2], rows[0][3]);
+        }
+        jpeg_write_scanlines(&cinfo, rows, n);
     }
+    png_read_end(png_ptr, NULL);
 
     // Clean up
     jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
     fclose(jpeg_fp);
 
-    // Clean up
-    for (png_uint_32 y = 0; y < height; y++) {
-        free(row_pointers[y]);
-    }
-    free(row_pointers);
+    double total_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+    double pixel_mb = (double)row_bytes * height / (1024 * 1024);
+    printf("png->jpeg %ux%u%s: first byte %.1f ms, total %.1f ms, %.1f MB/s (decoded RGBA), "
+           "%zu bytes out, working buffer %.1f KB, peak RSS %.1f MB\n",
+           width, height, passes > 1 ? " (interlaced, buffered)" : "",
+           dest.firstByteMs, total_ms, pixel_mb * 1000 / total_ms, dest.bytes,
+           (ring_bytes + kOutputBufferSize) / 1024.0, peakRssMB());
+
+    free(block);
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
     fclose(fp);
 
@@ -137,13 +231,95 @@ int pngTorgb(const char* pngFile, const char* jpgFile) {
 
 }
 
-int main(int, char **)
+// Decodes every frame of a .jpg / .mjpeg file into a pooled NV21 buffer and
+// warps the centred square of it straight to a crop x crop NV21 image, one
+// decode and one warp pass per frame. Crops are appended to outFile if given.
+int mjpegToCrops(const char* mjpegFile, int crop, const char* outFile) {
+    MjpegFile input;
+    if (!input.open(mjpegFile)) {
+        std::cerr << "Error mapping MJPEG file: " << mjpegFile << "\n";
+        return -1;
+    }
+    FILE *out = NULL;
+    if (outFile && !(out = fopen(outFile, "wb"))) {
+        std::cerr << "Error opening output NV21 file: " << outFile << "\n";
+        return -1;
+    }
+
+    // One frame is enough for this loop; the second lets a consumer hold on to
+    // a frame while the next one decodes.
+    Nv21FramePool pool(2);
+    NV21Image *aligned = create_nv21(crop, crop);
+    if (!aligned) {
+        std::cerr << "Error allocating the " << crop << "x" << crop << " crop\n";
+        if (out) fclose(out);
+        return -1;
+    }
+    int frames = 0, failed = 0;
+    double decodeMs = 0, warpMs = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    const uint8_t *data;
+    size_t size;
+    while (input.next(&data, &size)) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        NV21Image *frame = decodeToNv21(data, size, pool);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        if (!frame) {
+            failed++;
+            continue;
+        }
+
+        // Centred square, scaled to the crop (pixel centres map onto each other)
+        int side = std::min(frame->width, frame->height);
+        float scale = (float)side / crop;
+        AffineMatrix mat = {scale, 0, (frame->width - side) / 2 + 0.5f * scale - 0.5f,
+                            0, scale, (frame->height - side) / 2 + 0.5f * scale - 0.5f};
+        affine_transform_dispatch(aligned, frame, mat);
+        pool.release(frame);
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+        if (out) {
+            fwrite(aligned->y, 1, (size_t)crop * crop, out);
+            fwrite(aligned->vu, 1, (size_t)crop * crop / 2, out);
+        }
+        decodeMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        warpMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+        frames++;
+    }
+    double totalSec = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    printf("mjpeg->nv21 %s: %d frame(s), %d undecodable, %.1f fps, "
+           "decode %.2f ms/frame, warp to %dx%d %.3f ms/frame\n",
+           mjpegFile, frames, failed, totalSec > 0 ? frames / totalSec : 0.0,
+           frames ? decodeMs / frames : 0.0, crop, crop, frames ? warpMs / frames : 0.0);
+    printf("mapped %.1f MB, frame pool %.1f KB\n",
+           input.size() / (1024.0 * 1024), pool.bufferBytes() / 1024.0);
+
+    free_nv21(aligned);
+    if (out) fclose(out);
+    return frames > 0 ? 0 : -1;
+}
+
+// usage: yuvsimpleapp [input.png output.jpg]
+//        yuvsimpleapp --mjpeg <input.jpg|input.mjpeg> [crop [output.nv21]]
+int main(int argc, char **argv)
 {
     std::cout << "Hello, from yuvsimpleapp!\n";
     std::cout << "LibYUV version: " << LIBYUV_VERSION << "\n";
     int  result = -1;
-    const char* png_file = "../lena.png";
-    const char* jpg_file = "../lena.jpg";
+    if (argc > 2 && strcmp(argv[1], "--mjpeg") == 0) {
+        int crop = argc > 3 ? atoi(argv[3]) & ~1 : 224;
+        if (crop <= 0) {
+            std::cerr << "Invalid crop size: " << argv[3] << "\n";
+            return -1;
+        }
+        return mjpegToCrops(argv[2], crop, argc > 4 ? argv[4] : NULL);
+    }
+
+    const char* png_file = argc > 2 ? argv[1] : "../lena.png";
+    const char* jpg_file = argc > 2 ? argv[2] : "../lena.jpg";
     // Convert PNG to RGB (JPEG) format
     result = pngTorgb(png_file, jpg_file);
     if (result != 0) {
@@ -151,131 +327,5 @@ int main(int, char **)
         return result;
     }
 
-
-
-    return 0;
-
-    // Example usage of a LibYUV function
-    int width = 640;
-    int height = 480;
-
-    int y_stride = width;
-    int u_stride = width / 2;
-    int v_stride = width / 2;
-
-    int y_size = y_stride * height;
-    int u_size = u_stride * height / 2;
-    int v_size = v_stride * height / 2;
-
-    int yuv_size = y_size + u_size + v_size;
-    int rgb_size = width * height * 3;
-
-    uint8_t *src_nv21 = new uint8_t[yuv_size];
-    uint8_t *i420 = new uint8_t[yuv_size];
-    uint8_t *dst_rgb = new uint8_t[rgb_size];
-
-    size_t bytes_read = 0;
-    FILE *input_file = nullptr;
-    FILE *output_file = nullptr;
-
-   const char *jpeg_file = "../trumps_640x480.jpg";
-   const char* nv21_file = "../output_trumps_640x480_nv21.bin";
-   const char* rgb_file =  "../output_trumps_640x480_rgb24.bin";
-    uint8_t *jpeg_buffer = nullptr;
-    size_t jpeg_size = 0;
-    input_file = fopen(jpeg_file, "rb");
-    if (!input_file)
-    {        std::cerr << "Error opening input JPEG file: " << jpeg_file << "\n";
-        goto clean_up;
-    }
-    // Read the JPEG file into a buffer
-    fseek(input_file, 0, SEEK_END);
-    jpeg_size = ftell(input_file);
-    fseek(input_file, 0, SEEK_SET);
-    jpeg_buffer = new uint8_t[jpeg_size];
-    bytes_read = fread(jpeg_buffer, 1, jpeg_size, input_file);
-    fclose(input_file);
-    if (bytes_read != jpeg_size)
-    {
-        std::cerr << "Error reading JPEG data from file. Expected "
-                  << jpeg_size << " bytes, but read " << bytes_read << " bytes.\n";
-        goto clean_up;                  
-    }
-
-    // Convert JPEG to NV21 format
-    result = libyuv::MJPGToNV21(jpeg_buffer, jpeg_size, src_nv21, y_stride, src_nv21 + y_size, u_stride + v_stride, width, height,width, height);
-    delete[] jpeg_buffer;
-    if (result != 0)
-    {   
-        std::cerr << "Error converting JPEG to NV21: " << result << "\n";
-        goto clean_up;
-    }
-
-    // Save NV21 data to a file (optional)
-    output_file = fopen(nv21_file, "wb");
-    if (!output_file)
-    {       std::cerr << "Error opening output NV21 file.\n";
-        goto clean_up;
-    }   
-    fwrite(src_nv21, 1, yuv_size, output_file);
-    fclose(output_file);    
-    std::cout << "Successfully converted JPEG to NV21 and saved to " << nv21_file << ".\n";
-
-
-    // char *nv21_file = "../trumps_640x480.nv21";
-    // input_file = fopen(nv21_file, "rb");
-    // if (!input_file)
-    // {
-    //     std::cerr << "Error opening input NV21 file: " << nv21_file << "\n";
-    //     goto clean_up;
-    // }
-
-    // bytes_read = fread(src_nv21, 1, yuv_size, input_file);
-    // fclose(input_file);
-    // if (bytes_read != yuv_size)
-    // {
-    //     std::cerr << "Error reading NV21 data from file. Expected "
-    //               << yuv_size << " bytes, but read " << bytes_read
-    //               << " bytes.\n";
-    //     goto clean_up;
-    // }
-
-    result = libyuv::NV21ToI420(src_nv21, y_stride, src_nv21 + y_size, u_stride + v_stride,
-                                i420, y_stride, i420 + y_size, u_stride, i420 + y_size + u_size, v_stride, width, height);
-
-    // test ok
-    // result = libyuv::ConvertFromI420(i420, y_stride, i420 + y_size, u_stride, i420 + y_size + u_size, v_stride, dst_rgb, width * 3, width, height, libyuv::FOURCC_RGB3);
-
-    result = libyuv::NV21ToRAW(src_nv21, y_stride, src_nv21 + y_size, u_stride + v_stride, dst_rgb, width * 3, width, height);
-
-
-    // save rgb data to a file or process it as needed
-    if (result != 0)
-    {
-        std::cerr << "Error converting NV21 to RGB24: " << result << "\n";
-        goto clean_up;
-    }
-
-    output_file = fopen(rgb_file, "wb");
-    if (!output_file)
-    {
-        std::cerr << "Error opening output file.\n";
-        goto clean_up;
-    }
-    fwrite(dst_rgb, 1, rgb_size, output_file);
-    fclose(output_file);
-
-    std::cout << "Successfully converted NV21 to RGB24.\n";
-
-clean_up:
-    // Clean up
-    delete[] src_nv21;
-    delete[] i420;
-    delete[] dst_rgb;
-
-    std::cout << "LibYUV sample application completed successfully.\n";
-    std::cout << "You can now use LibYUV functions as needed.\n";
-    std::cout << "For more information, refer to the LibYUV documentation.\n";
-
     return 0;
 }
@@ -0,0 +1,155 @@
+#include "mjpeg_decoder.hpp"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libyuv.h"
+
+MjpegFile::MjpegFile() : map_(NULL), size_(0), pos_(0) {}
+
+MjpegFile::~MjpegFile() {
+    close();
+}
+
+bool MjpegFile::open(const char *path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);   // the mapping keeps the file referenced
+    if (map == MAP_FAILED) return false;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    map_ = (const uint8_t *) map;
+    size_ = st.st_size;
+    pos_ = 0;
+    return true;
+}
+
+void MjpegFile::close() {
+    if (map_) munmap((void *) map_, size_);
+    map_ = NULL;
+    size_ = 0;
+    pos_ = 0;
+}
+
+// Walks the marker segments from SOI to EOI. Searching for FF D9 alone isn't
+// enough: an EXIF thumbnail in APP1 carries its own SOI/EOI. Entropy-coded
+// data after SOS only contains FF 00 stuffing and RSTn, so the next other
+// marker ends the scan. All positions are offsets into map_ checked against
+// size_, so a bogus segment length can't move a pointer past the mapping.
+bool MjpegFile::next(const uint8_t **data, size_t *size) {
+    for (; pos_ + 1 < size_; pos_++) {
+        if (map_[pos_] == 0xFF && map_[pos_ + 1] == 0xD8) break;
+    }
+    if (pos_ + 1 >= size_) return false;
+
+    size_t start = pos_;
+    size_t i = start + 2;
+    while (i + 1 < size_) {
+        if (map_[i] != 0xFF) break;   // corrupt: the decoder rejects it, the next call resyncs
+        uint8_t marker = map_[i + 1];
+        if (marker == 0xFF) {   // fill byte
+            i++;
+            continue;
+        }
+        if (marker == 0xD9) {
+            i += 2;
+            break;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            i += 2;
+            continue;
+        }
+        if (size_ - i < 4) {
+            i = size_;
+            break;
+        }
+        size_t len = (map_[i + 2] << 8) | map_[i + 3];
+        if (len > size_ - i - 2) {   // segment runs past the end of the file
+            i = size_;
+            break;
+        }
+        i += 2 + len;
+        if (marker == 0xDA) {
+            while (i + 1 < size_ &&
+                   !(map_[i] == 0xFF && map_[i + 1] != 0 &&
+                     (map_[i + 1] < 0xD0 || map_[i + 1] > 0xD7))) {
+                i++;
+            }
+        }
+    }
+    // Without EOI (truncated or corrupt frame) this hands over what there is:
+    // the decoder fails on it and the next call looks for the following SOI.
+    *data = map_ + start;
+    *size = i - start;
+    pos_ = i;
+    return true;
+}
+
+Nv21FramePool::Nv21FramePool(int count) : slots_(count > 0 ? count : 1) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        slots_[i].buffer = NULL;
+        slots_[i].capacity = 0;
+        slots_[i].busy = false;
+    }
+}
+
+Nv21FramePool::~Nv21FramePool() {
+    for (size_t i = 0; i < slots_.size(); i++) free(slots_[i].buffer);
+}
+
+NV21Image *Nv21FramePool::acquire(int width, int height) {
+    size_t bytes = (size_t) width * height * 3 / 2;
+    for (size_t i = 0; i < slots_.size(); i++) {
+        Slot &slot = slots_[i];
+        if (slot.busy) continue;
+        if (slot.capacity < bytes) {
+            free(slot.buffer);
+            slot.buffer = (uint8_t *) malloc(bytes);
+            slot.capacity = slot.buffer ? bytes : 0;
+            if (!slot.buffer) return NULL;
+        }
+        slot.image.y = slot.buffer;
+        slot.image.vu = slot.buffer + (size_t) width * height;
+        slot.image.width = width;
+        slot.image.height = height;
+        slot.busy = true;
+        return &slot.image;
+    }
+    return NULL;
+}
+
+void Nv21FramePool::release(NV21Image *frame) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (&slots_[i].image == frame) slots_[i].busy = false;
+    }
+}
+
+size_t Nv21FramePool::bufferBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < slots_.size(); i++) bytes += slots_[i].capacity;
+    return bytes;
+}
+
+NV21Image *decodeToNv21(const uint8_t *data, size_t size, Nv21FramePool &pool) {
+    int width = 0, height = 0;
+    if (libyuv::MJPGSize(data, size, &width, &height) != 0) return NULL;
+    if (width <= 0 || height <= 0 || (width & 1) || (height & 1)) return NULL;
+
+    NV21Image *frame = pool.acquire(width, height);
+    if (!frame) return NULL;
+    if (libyuv::MJPGToNV21(data, size, frame->y, width, frame->vu, width,
+                           width, height, width, height) != 0) {
+        pool.release(frame);
+        return NULL;
+    }
+    return frame;
+}
@@ -0,0 +1,73 @@
+#ifndef MJPEG_DECODER_HPP
+#define MJPEG_DECODER_HPP
+
+// MJPEG -> NV21 decode stage for the warp kernels in ../nv21-sample:
+//   MjpegFile      maps a .jpg or a .mjpeg stream (concatenated JPEG frames,
+//                  as a UVC camera delivers them) and hands out each
+//                  compressed frame as a pointer into the mapping;
+//   Nv21FramePool  a fixed set of NV21 buffers allocated once and recycled;
+//   decodeToNv21   libyuv::MJPGToNV21 straight into a pooled frame.
+// A frame is decoded once into its final NV21 buffer and goes to the warp
+// from there, without any file copy or RGB/I420 intermediate.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "nv21_image.h"
+
+class MjpegFile {
+public:
+    MjpegFile();
+    ~MjpegFile();
+
+    bool open(const char *path);
+    void close();
+
+    // Next compressed frame (SOI..EOI) inside the mapping, false at the end.
+    // The pointer stays valid until close().
+    bool next(const uint8_t **data, size_t *size);
+
+    size_t size() const { return size_; }
+
+private:
+    MjpegFile(const MjpegFile &);
+    MjpegFile &operator=(const MjpegFile &);
+
+    const uint8_t *map_;
+    size_t size_;
+    size_t pos_;
+};
+
+class Nv21FramePool {
+public:
+    explicit Nv21FramePool(int count);
+    ~Nv21FramePool();
+
+    // A free frame of width x height, NULL when all of them are in use.
+    // Buffers are (re)allocated only when the frame size changes.
+    NV21Image *acquire(int width, int height);
+    void release(NV21Image *frame);
+
+    // Heap memory held by the buffers.
+    size_t bufferBytes() const;
+
+private:
+    Nv21FramePool(const Nv21FramePool &);
+    Nv21FramePool &operator=(const Nv21FramePool &);
+
+    struct Slot {
+        NV21Image image;
+        uint8_t *buffer;   // Y plane followed by VU, one allocation
+        size_t capacity;
+        bool busy;
+    };
+    std::vector<Slot> slots_;
+};
+
+// Decodes one JPEG into a frame from pool. Returns NULL when the pool is
+// exhausted, the data isn't a decodable JPEG or its size is odd (NV21 needs
+// even dimensions). The caller releases the frame back to the pool.
+NV21Image *decodeToNv21(const uint8_t *data, size_t size, Nv21FramePool &pool);
+
+#endif  // MJPEG_DECODER_HPP
@@ -0,0 +1,140 @@
+#include "debug_dump.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#include <opencv2/imgcodecs.hpp>
+
+static const int kJpegQuality    = 80;
+static const int kPngCompression = 1;
+
+static void releaseBuffer(void* data, void* ctx)
+{
+    (void)data;
+    delete static_cast<std::vector<uchar>*>(ctx);
+}
+
+bool submitEncoded(AsyncWriter* writer, const std::string& path, std::vector<uchar>* buffer)
+{
+    if (async_writer_submit(
+            writer, path.c_str(), buffer->data(), buffer->size(), releaseBuffer, buffer) != 0) {
+        delete buffer;
+        return false;
+    }
+    return true;
+}
+
+DebugDumper::DebugDumper(AsyncWriter* writer, int slots)
+    : writer_(writer),
+      slots_(slots > 0 ? slots : 1),
+      head_(0),
+      count_(0),
+      encoding_(false),
+      stop_(false),
+      dumped_(0),
+      dropped_(0),
+      failed_(0),
+      encodeMs_(0)
+{
+    thread_ = std::thread(&DebugDumper::encodeLoop, this);
+}
+
+DebugDumper::~DebugDumper()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    ready_.notify_one();
+    thread_.join();
+    printStats();
+}
+
+bool DebugDumper::dump(const std::string& path, const cv::Mat& img)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ == slots_.size()) {
+        dropped_++;
+        return false;
+    }
+    // 拷贝到槽位自己的缓冲(尺寸相同则复用), 调用方返回后可以随意修改 img
+    Slot& slot = slots_[(head_ + count_) % slots_.size()];
+    img.copyTo(slot.image);
+    slot.path = path;
+    count_++;
+    ready_.notify_one();
+    return true;
+}
+
+void DebugDumper::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (count_ > 0 || encoding_) idle_.wait(lock);
+}
+
+void DebugDumper::encodeLoop()
+{
+    cv::Mat     image;
+    std::string path;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            encoding_ = false;
+            if (count_ == 0) idle_.notify_all();
+            while (count_ == 0 && !stop_) ready_.wait(lock);
+            if (count_ == 0) return;   // stop_ 且队列已空
+
+            // 换出槽位中的图像, 槽位拿到上一张的缓冲, 编码期间不占锁
+            Slot& slot = slots_[head_];
+            cv::swap(image, slot.image);
+            path.swap(slot.path);
+            head_ = (head_ + 1) % slots_.size();
+            count_--;
+            encoding_ = true;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<int> params;
+        size_t           lastDot = path.find_last_of('.');
+        std::string      ext     = lastDot == std::string::npos ? "" : path.substr(lastDot);
+        if (ext == ".jpg" || ext == ".jpeg") {
+            params.push_back(cv::IMWRITE_JPEG_QUALITY);
+            params.push_back(kJpegQuality);
+        }
+        else if (ext == ".png") {
+            params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+            params.push_back(kPngCompression);
+        }
+
+        // 缓冲交给写线程, 写完后由它释放
+        std::vector<uchar>* buffer = new std::vector<uchar>();
+        bool                ok     = !ext.empty() && cv::imencode(ext, image, *buffer, params);
+        if (ok) {
+            ok = submitEncoded(writer_, path, buffer);
+        }
+        else {
+            delete buffer;
+        }
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        encodeMs_ += elapsed.count();
+        if (ok) {
+            dumped_++;
+        }
+        else {
+            failed_++;
+        }
+    }
+}
+
+void DebugDumper::printStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    printf("debug dumps: %ld written, %ld dropped (queue full), %ld failed, encode %.2f ms/dump\n",
+           dumped_,
+           dropped_,
+           failed_,
+           dumped_ + failed_ ? encodeMs_ / (dumped_ + failed_) : 0.0);
+}
@@ -0,0 +1,67 @@
+#ifndef DEBUG_DUMP_HPP
+#define DEBUG_DUMP_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "async_writer.h"
+
+// 把编码好的文件内容交给 writer 写到 path, 并接管 buffer: 写完后由写线程释放,
+// 入队失败时立即释放. 返回是否入队成功
+bool submitEncoded(AsyncWriter* writer, const std::string& path, std::vector<uchar>* buffer);
+
+// 调试图片的后台编码: dump() 只把图像拷进固定数量的槽位就返回, JPEG/PNG 编码在后台线程做,
+// 编码结果交给 AsyncWriter 落盘. 槽位用完(编码跟不上)时直接丢弃这次转储并计数, 调用方
+// 从不等待编码. 槽位里的 Mat 循环复用, 尺寸不变时转储不分配内存.
+// 编码使用快速参数: JPEG 质量 80(不做 optimize/progressive), PNG 压缩级别 1.
+class DebugDumper
+{
+public:
+    // slots: 排队上限(同时也是占用内存的上限, slots 张图)
+    DebugDumper(AsyncWriter* writer, int slots);
+    // 编码并提交已排队的转储, 打印统计
+    ~DebugDumper();
+
+    // 按扩展名(.jpg/.png/...)编码写到 path. 返回 false 表示队列满已丢弃
+    bool dump(const std::string& path, const cv::Mat& img);
+    // 等待已排队的转储全部编码并提交给写线程
+    void flush();
+
+    void printStats() const;
+
+private:
+    DebugDumper(const DebugDumper&);
+    DebugDumper& operator=(const DebugDumper&);
+
+    struct Slot
+    {
+        cv::Mat     image;
+        std::string path;
+    };
+
+    void encodeLoop();
+
+    AsyncWriter*      writer_;
+    std::vector<Slot> slots_;
+    size_t            head_;       // 最早排队的槽位
+    size_t            count_;      // 排队中的槽位数
+    bool              encoding_;   // 编码线程正在处理一张图
+    bool              stop_;
+
+    long   dumped_;
+    long   dropped_;
+    long   failed_;
+    double encodeMs_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable ready_;
+    std::condition_variable idle_;
+    std::thread             thread_;
+};
+
+#endif   // DEBUG_DUMP_HPP
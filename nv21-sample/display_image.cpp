@@ -1,7 +1,45 @@
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 
+#include "async_writer.h"
+#include "debug_dump.hpp"
+#include "nv21_container.h"
+#include "thread_pool.h"
+
+// 所有输出文件都交给异步写线程, main 退出前销毁(等待写完并打印统计)
+static AsyncWriter* g_writer = NULL;
+// 调试/预览图片在后台编码, 编码跟不上时丢弃; 先于 g_writer 销毁
+static DebugDumper* g_dumper = NULL;
+// 排队等待编码的调试图片上限
+static const int kDumpSlots = 4;
+
+// 接管 buffer, 写完后由写线程释放
+static bool writeFileAsync(const std::string& path, std::vector<uchar>* buffer)
+{
+    return submitEncoded(g_writer, path, buffer);
+}
+
+// 代替 cv::imwrite: 在当前线程按扩展名编码, 落盘交给写线程
+static bool imwriteAsync(const std::string& path, const cv::Mat& img)
+{
+    size_t lastDot = path.find_last_of('.');
+    if (lastDot == std::string::npos) return false;
+
+    std::vector<uchar>* buffer = new std::vector<uchar>();
+    if (!cv::imencode(path.substr(lastDot), img, *buffer)) {
+        delete buffer;
+        return false;
+    }
+    return writeFileAsync(path, buffer);
+}
+
 // 裁剪 NV21 数据
 bool cropNV21(const cv::Mat& nv21, cv::Mat& croppedNv21, int width, int height, int cropX,
               int cropY, int cropWidth, int cropHeight, const std::string& debugDir,
@@ -28,13 +66,16 @@ bool cropNV21(const cv::Mat& nv21, cv::Mat& croppedNv21, int width, int height,
     cv::Rect roi(cropX, cropY, cropWidth, cropHeight);
 
     // Draw rectangle for visualization
-    cv::Mat bgrWithRoi = bgr.clone();
-    cv::rectangle(bgrWithRoi, roi, cv::Scalar(0, 0, 255), 2);   // red box
+    cv::Mat bgrWithRoi;
+    if (!debugDir.empty() || showDebugWindows) {
+        bgrWithRoi = bgr.clone();
+        cv::rectangle(bgrWithRoi, roi, cv::Scalar(0, 0, 255), 2);   // red box
+    }
 
-    // Debug: save images
+    // Debug: save images (只拷贝进转储队列, 编码在后台)
     if (!debugDir.empty()) {
-        cv::imwrite(debugDir + "/input_bgr.jpg", bgr);
-        cv::imwrite(debugDir + "/input_bgr_with_roi.jpg", bgrWithRoi);
+        g_dumper->dump(debugDir + "/input_bgr.jpg", bgr);
+        g_dumper->dump(debugDir + "/input_bgr_with_roi.jpg", bgrWithRoi);
     }
 
     if (showDebugWindows) {
@@ -46,7 +87,7 @@ bool cropNV21(const cv::Mat& nv21, cv::Mat& croppedNv21, int width, int height,
     cv::Mat croppedBGR = bgr(roi);
 
     if (!debugDir.empty()) {
-        cv::imwrite(debugDir + "/cropped_bgr.jpg", croppedBGR);
+        g_dumper->dump(debugDir + "/cropped_bgr.jpg", croppedBGR);
     }
 
     if (showDebugWindows) {
@@ -107,25 +148,44 @@ cv::Mat nv21ToBGR(const unsigned char* nv21Data, int width, int height)
     return bgrImage;
 }
 
-// 将 I420 格式转换为 NV21 格式
-void I420ToNV21(const uint8_t* i420, uint8_t* nv21, int width, int height)
+struct I420ToNV21Band
 {
-    int            frameSize = width * height;
-    const uint8_t* yPlane    = i420;
-    const uint8_t* uPlane    = i420 + frameSize;
-    const uint8_t* vPlane    = i420 + frameSize + (frameSize / 4);
+    const uint8_t* i420;
+    uint8_t*       nv21;
+    int            width;
+    int            height;
+};
+
+// 转换 [row, rowEnd) 色度行及对应的两行 Y
+static void I420ToNV21Rows(void* arg, int row, int rowEnd)
+{
+    const I420ToNV21Band* band      = static_cast<const I420ToNV21Band*>(arg);
+    int                   width     = band->width;
+    int                   frameSize = width * band->height;
+    const uint8_t*        uPlane    = band->i420 + frameSize;
+    const uint8_t*        vPlane    = band->i420 + frameSize + (frameSize / 4);
 
-    // 复制 Y 分量
-    memcpy(nv21, yPlane, frameSize);
+    // 复制 Y 分量, 奇数高度的最后一行归最后一个行带
+    int yEnd = rowEnd == band->height / 2 ? band->height : rowEnd * 2;
+    memcpy(band->nv21 + row * 2 * width, band->i420 + row * 2 * width, (yEnd - row * 2) * width);
 
     // 交错 VU
-    uint8_t* vuPlane = nv21 + frameSize;
-    for (int i = 0; i < frameSize / 4; ++i) {
-        *vuPlane++ = vPlane[i];   // V
-        *vuPlane++ = uPlane[i];   // U
+    for (; row < rowEnd; ++row) {
+        uint8_t* vuPlane = band->nv21 + frameSize + row * width;
+        for (int i = row * width / 2; i < (row + 1) * width / 2; ++i) {
+            *vuPlane++ = vPlane[i];   // V
+            *vuPlane++ = uPlane[i];   // U
+        }
     }
 }
 
+// 将 I420 格式转换为 NV21 格式, 行带分给线程池
+static void I420ToNV21(const uint8_t* i420, uint8_t* nv21, int width, int height)
+{
+    I420ToNV21Band band = {i420, nv21, width, height};
+    thread_pool_parallel_for(NULL, 0, height / 2, 8, I420ToNV21Rows, &band);
+}
+
 std::string removeFileExtension(const std::string& filePath)
 {
     size_t lastDot = filePath.find_last_of('.');
@@ -144,58 +204,173 @@ std::string getFileExtension(const std::string& filePath)
     return filePath.substr(lastDot + 1);   // 包含点的扩展名
 }
 
-std::string convertbgr2yuv(std::string bgrFilePath)
+std::string baseName(const std::string& filePath)
+{
+    size_t lastSlash = filePath.find_last_of('/');
+    return lastSlash == std::string::npos ? filePath : filePath.substr(lastSlash + 1);
+}
+
+// 图片转 NV21 的参数
+struct TranscodeOptions
+{
+    int         width;
+    int         height;
+    std::string outDir;        // 为空时输出放在源图旁边
+    bool        keepResized;   // 额外写出缩放后的图片(xxx_WxH.jpg/png)
+    bool        splitRows;     // I420 -> NV21 拆行带交给线程池, 单张转换时使用
+};
+
+// 读图、缩放、转 NV21 并交给写线程, 输出 xxx_WxH.nv21. 缩放图和 I420 缓冲按线程复用,
+// 批量转换时每个工作线程各处理一张图, I420 -> NV21 不再拆行带(splitRows 为 false)
+static bool transcodeImage(const std::string& path, const TranscodeOptions& opt,
+                           std::string* nv21Path)
 {
-    cv::Mat bgrImage = cv::imread(bgrFilePath, cv::IMREAD_COLOR);
+    thread_local cv::Mat resized, yuvI420;
+
+    cv::Mat bgrImage = cv::imread(path, cv::IMREAD_COLOR);
     if (bgrImage.empty()) {
-        std::cerr << "无法读取图片: " << bgrFilePath << std::endl;
-        return std::string("");
-    }
-    int width  = 640;
-    int height = 480;
-
-    std::string filename      = removeFileExtension(bgrFilePath);
-    std::string fileExtension = getFileExtension(bgrFilePath);
-
-    cv::Mat bgrImage_640x480;
-    bgrImage_640x480 = cv::Mat::zeros(height, width, CV_8UC3);
-    cv::resize(bgrImage, bgrImage_640x480, bgrImage_640x480.size());
-    std::string outputPath = filename.append("_")
-                                 .append(std::to_string(width))
-                                 .append("x")
-                                 .append(std::to_string(height))
-                                 .append(".")
-                                 .append(fileExtension);
-    cv::imwrite(outputPath, bgrImage_640x480);
-    std::cout << "outputPath: " << outputPath << std::endl;
+        std::cerr << "无法读取图片: " << path << std::endl;
+        return false;
+    }
+    cv::resize(bgrImage, resized, cv::Size(opt.width, opt.height));
+
+    std::string stem = removeFileExtension(opt.outDir.empty() ? path
+                                                              : opt.outDir + "/" + baseName(path));
+    stem.append("_")
+        .append(std::to_string(opt.width))
+        .append("x")
+        .append(std::to_string(opt.height));
+    if (opt.keepResized) {
+        std::string resizedPath = stem + "." + getFileExtension(path);
+        imwriteAsync(resizedPath, resized);
+        std::cout << "outputPath: " << resizedPath << std::endl;
+    }
 
     // 转换为 YUV I420 格式
-    cv::Mat yuvI420;
-    cv::cvtColor(bgrImage_640x480, yuvI420, cv::COLOR_BGR2YUV_I420);
-
-    // 分配 NV21 数据缓冲区
-    long                 nv21Size = width * height * 3 / 2;
-    std::vector<uint8_t> nv21Data(nv21Size);
+    cv::cvtColor(resized, yuvI420, cv::COLOR_BGR2YUV_I420);
 
-    I420ToNV21(yuvI420.data, nv21Data.data(), width, height);
+    // 缓冲交给写线程, 由它在写完后释放
+    std::vector<uchar>* nv21Data =
+        new std::vector<uchar>((size_t)opt.width * opt.height * 3 / 2);
+    if (opt.splitRows) {
+        I420ToNV21(yuvI420.data, nv21Data->data(), opt.width, opt.height);
+    }
+    else {
+        I420ToNV21Band band = {yuvI420.data, nv21Data->data(), opt.width, opt.height};
+        I420ToNV21Rows(&band, 0, opt.height / 2);
+    }
 
-    outputPath = removeFileExtension(bgrFilePath)
-                     .append("_")
-                     .append(std::to_string(width))
-                     .append("x")
-                     .append(std::to_string(height))
-                     .append(".nv21");
+    std::string outputPath = stem + ".nv21";
+    if (!writeFileAsync(outputPath, nv21Data)) return false;
+    if (nv21Path) *nv21Path = outputPath;
+    return true;
+}
 
-    // 保存 NV21 到文件
-    std::ofstream outFile(outputPath, std::ios::binary);
-    outFile.write(reinterpret_cast<char*>(nv21Data.data()), nv21Size);
-    outFile.close();
+std::string convertbgr2yuv(std::string bgrFilePath)
+{
+    TranscodeOptions opt = {640, 480, "", true, true};
+    std::string      outputPath;
+    if (!transcodeImage(bgrFilePath, opt, &outputPath)) return std::string("");
 
     std::cout << "转换完成，保存到: " << outputPath << std::endl;
-
     return outputPath;
 }
 
+static bool isImageFile(const std::string& path)
+{
+    std::string ext = getFileExtension(path);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp" || ext == "webp";
+}
+
+// 目录(不递归)下的图片, 或文件列表中每行一个路径
+static bool collectImages(const std::string& input, std::vector<std::string>* files)
+{
+    struct stat st;
+    if (stat(input.c_str(), &st) != 0) return false;
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(input.c_str());
+        if (!dir) return false;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            std::string name = entry->d_name;
+            if (isImageFile(name)) files->push_back(input + "/" + name);
+        }
+        closedir(dir);
+        std::sort(files->begin(), files->end());
+        return true;
+    }
+
+    std::ifstream list(input);
+    std::string   line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (!line.empty()) files->push_back(line);
+    }
+    return true;
+}
+
+struct BatchJob
+{
+    const std::vector<std::string>* files;
+    const TranscodeOptions*         opt;
+    std::atomic<long>               failed;
+};
+
+static void transcodeBand(void* arg, int begin, int end)
+{
+    BatchJob* job = static_cast<BatchJob*>(arg);
+    for (int i = begin; i < end; i++) {
+        if (!transcodeImage((*job->files)[i], *job->opt, NULL)) job->failed++;
+    }
+}
+
+// 一次 parallel_for 提交的图片数, 限制任务队列的大小并定期报告进度
+static const int kBatchChunk = 4096;
+
+// 批量转换: 线程池中每个任务处理一张图(解码、缩放、转换), 落盘交给写线程.
+// 并行度在图片之间, OpenCV 自己的线程关掉, 避免和线程池抢核
+static int convertBatch(const std::string& input, const TranscodeOptions& opt)
+{
+    std::vector<std::string> files;
+    if (!collectImages(input, &files) || files.empty()) {
+        std::cerr << "没有找到图片: " << input << std::endl;
+        return -1;
+    }
+    if (!opt.outDir.empty()) mkdir(opt.outDir.c_str(), 0755);
+
+    cv::setNumThreads(1);
+    ThreadPool* pool = thread_pool_default();
+    std::cout << "批量转换 " << files.size() << " 张图片 -> " << opt.width << "x" << opt.height
+              << " NV21, " << thread_pool_size(pool) << " 线程" << std::endl;
+
+    BatchJob job;
+    job.files  = &files;
+    job.opt    = &opt;
+    job.failed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    int  total = (int)files.size();
+    for (int begin = 0; begin < total; begin += kBatchChunk) {
+        int end = std::min(begin + kBatchChunk, total);
+        thread_pool_parallel_for(pool, begin, end, 1, transcodeBand, &job);
+        if (end < total) {
+            double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                             .count();
+            printf("  %d/%d, %.1f images/s\n", end, total, end / sec);
+        }
+    }
+    async_writer_flush(g_writer);
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%d image(s), %ld failed, %.2f s, %.1f images/s\n",
+           total,
+           job.failed.load(),
+           sec,
+           sec > 0 ? total / sec : 0.0);
+    return job.failed.load() == total ? -1 : 0;
+}
+
 // xxx_640x480.nv21
 void displayNV21File(std::string& nv21FilePath)
 {
@@ -228,8 +403,8 @@ void displayNV21File(std::string& nv21FilePath)
     std::string outputPng =
         outputPath.substr(0, outputPath.find_last_of("_")).append("_out").append(".png");
     // 保存为 PNG
-    if (!cv::imwrite(outputPng, bgrImage)) {
-        std::cerr << "无法保存 PNG 文件: " << outputPng << std::endl;
+    if (!g_dumper->dump(outputPng, bgrImage)) {
+        std::cerr << "转储队列已满, 跳过 PNG 文件: " << outputPng << std::endl;
     }
     else {
         std::cout << "保存 PNG 文件: " << outputPng << std::endl;
@@ -239,30 +414,112 @@ void displayNV21File(std::string& nv21FilePath)
     cv::imshow("NV21 Image", bgrImage);
 }
 
+// xxx.nv21c, 尺寸取自容器索引, 按帧号直接定位(帧数据在 mmap 中, 不拷贝)
+void displayNV21Container(const std::string& containerPath, long frameIndex)
+{
+    Nv21Container* container = nv21_container_open(containerPath.c_str());
+    if (!container) {
+        std::cerr << "无法打开容器: " << containerPath << std::endl;
+        return;
+    }
+
+    Nv21ContainerFrame frame;
+    const uint8_t*     data = nv21_container_frame(container, frameIndex, &frame);
+    if (!data || frame.fourcc != NV21_CONTAINER_FOURCC_NV21) {
+        std::cerr << "帧 " << frameIndex << " 不存在, 共 "
+                  << nv21_container_frame_count(container) << " 帧" << std::endl;
+        nv21_container_close(container);
+        return;
+    }
+    std::cout << "帧 " << frameIndex << "/" << nv21_container_frame_count(container) << ": "
+              << frame.width << "x" << frame.height << std::endl;
+
+    cv::Mat bgrImage = nv21ToBGR(data, frame.width, frame.height);
+    nv21_container_close(container);
+
+    std::string outputPng = removeFileExtension(containerPath)
+                                .append("_")
+                                .append(std::to_string(frameIndex))
+                                .append("_out.png");
+    if (!g_dumper->dump(outputPng, bgrImage)) {
+        std::cerr << "转储队列已满, 跳过 PNG 文件: " << outputPng << std::endl;
+    }
+    else {
+        std::cout << "保存 PNG 文件: " << outputPng << std::endl;
+    }
+
+    cv::imshow("NV21 Image", bgrImage);
+}
+
 int main(int argc, char* argv[])
 {
 
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <file_path>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <file_path> [frame]" << std::endl;
         std::cerr << "file_path supported: \n"
-                  << " xxx.png \n xxx.jpg \n xxx_widthxheight.nv21 " << std::endl;
+                  << " xxx.png \n xxx.jpg \n xxx_widthxheight.nv21 \n xxx.nv21c (frame, default 0)"
+                  << std::endl;
+        std::cerr << "       " << argv[0]
+                  << " --batch <dir | list.txt> [--size=WxH] [--out-dir=dir] [--keep-resized]"
+                  << std::endl;
         return -1;
     }
 
     std::string inputPath = argv[1];
     std::string ext       = getFileExtension(inputPath);
     std::string nv21Path;
+    g_writer = async_writer_create(0, 0);
+
+    if (inputPath == "--batch") {
+        TranscodeOptions opt = {640, 480, "", false, false};
+        std::string      input;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.compare(0, 7, "--size=") == 0) {
+                sscanf(arg.c_str() + 7, "%dx%d", &opt.width, &opt.height);
+            }
+            else if (arg.compare(0, 10, "--out-dir=") == 0) {
+                opt.outDir = arg.substr(10);
+            }
+            else if (arg == "--keep-resized") {
+                opt.keepResized = true;
+            }
+            else {
+                input = arg;
+            }
+        }
+        int result = -1;
+        if (input.empty() || opt.width <= 0 || opt.height <= 0 || (opt.width & 1) ||
+            (opt.height & 1)) {
+            std::cerr << "需要输入目录或文件列表, 尺寸为正偶数" << std::endl;
+        }
+        else {
+            result = convertBatch(input, opt);
+        }
+        async_writer_destroy(g_writer);
+        return result;
+    }
+    g_dumper = new DebugDumper(g_writer, kDumpSlots);
     if (ext == "jpg" || ext == "png") {
         std::cout << "开始转换: " << ext << "---->"
                   << "nv21" << std::endl;
         nv21Path = convertbgr2yuv(inputPath);
+        // displayNV21File 要读回刚写的 nv21 文件
+        async_writer_flush(g_writer);
     }
     else if (ext == "nv21") {
         nv21Path = inputPath;
     }
 
-    displayNV21File(nv21Path);
+    if (ext == "nv21c") {
+        displayNV21Container(inputPath, argc > 2 ? atol(argv[2]) : 0);
+    }
+    else {
+        displayNV21File(nv21Path);
+    }
 
     cv::waitKey(0);
+    delete g_dumper;
+    async_writer_destroy(g_writer);
     return 0;
 }
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include "async_writer.h"
+#include "detector.hpp"
+#include "nv21_affine_dispatch.h"
+#include "nv21_container.h"
+#include "nv21_image.h"
+#include "perf_regions.h"
+
+// NV21 进, 对齐的人脸 NV21 小图出, 整个流程不经过 BGR:
+//   1. 检测: Y 平面直接包成 CV_8UC1 的 Mat(不拷贝), 交给 facedetect-sample 的
+//      DetectorContext 做缩小、均衡化和人脸/眼睛级联检测
+//   2. 对齐: 由两眼中心(眼睛没检到时按人脸框的经验位置估计)求相似变换,
+//      把两眼映射到模板位置
+//   3. 裁剪: 相似变换的逆矩阵交给 affine_transform_dispatch, 从原始帧直接采样
+//      Y 和 VU 生成 224x224 的 NV21 小图. --gray 时给灰度识别用, 经 NV21LazyWarp
+//      只计算 Y 平面, 色度完全跳过
+// 最后报告端到端的 faces/s 以及检测、对齐各自的耗时.
+
+typedef std::chrono::steady_clock Clock;
+
+// 对齐模板: 两眼中心在输出图中的位置(相对边长), 即常用的 112x112 人脸模板放大到输出尺寸
+static const float kLeftEyeX  = 0.3419f;
+static const float kRightEyeX = 0.6565f;
+static const float kEyeY      = 0.4612f;
+
+// Haar 正脸框中两眼中心的经验位置(相对人脸框)
+static const float kBoxEyeX0 = 0.30f;
+static const float kBoxEyeX1 = 0.70f;
+static const float kBoxEyeY  = 0.38f;
+
+// 逐帧读取 NV21: .nv21c 容器直接指向 mmap 中的帧, 裸文件按固定尺寸顺序读入缓冲区
+typedef struct
+{
+    Nv21Container*       container;
+    FILE*                fp;
+    std::vector<uint8_t> buffer;
+    int                  width;
+    int                  height;
+    int64_t              next;
+} FrameSource;
+
+static bool openSource(FrameSource* src, const std::string& path, int width, int height)
+{
+    src->container = NULL;
+    src->fp        = NULL;
+    src->next      = 0;
+    if (nv21_container_probe(path.c_str())) {
+        src->container = nv21_container_open(path.c_str());
+        return src->container != NULL;
+    }
+    if (width <= 0 || height <= 0 || (width & 1) || (height & 1)) return false;
+    src->fp = fopen(path.c_str(), "rb");
+    if (!src->fp) return false;
+    src->width  = width;
+    src->height = height;
+    src->buffer.resize((size_t)width * height * 3 / 2);
+    return true;
+}
+
+static void closeSource(FrameSource* src)
+{
+    if (src->container) nv21_container_close(src->container);
+    if (src->fp) fclose(src->fp);
+}
+
+// frame 只是指向数据的视图, 下一次调用之前有效
+static bool nextFrame(FrameSource* src, NV21Image* frame)
+{
+    if (src->container) {
+        Nv21ContainerFrame info;
+        const uint8_t*     data;
+        do {
+            data = nv21_container_frame(src->container, src->next++, &info);
+            if (!data) return false;
+        } while (info.fourcc != NV21_CONTAINER_FOURCC_NV21);
+        frame->width  = info.width;
+        frame->height = info.height;
+        frame->y      = const_cast<uint8_t*>(data);
+    }
+    else {
+        if (fread(src->buffer.data(), 1, src->buffer.size(), src->fp) != src->buffer.size()) {
+            return false;
+        }
+        src->next++;
+        frame->width  = src->width;
+        frame->height = src->height;
+        frame->y      = src->buffer.data();
+    }
+    frame->vu = frame->y + (size_t)frame->width * frame->height;
+    return true;
+}
+
+// 两眼中心(原图坐标). face 是检测图坐标, eyes 相对人脸框, scale 为检测图缩小倍数.
+// 取人脸上半部中水平距离最远的两个眼睛框, 不足两个时按经验位置估计, 返回是否用了检测结果
+static bool eyeCenters(const cv::Rect& face, const std::vector<cv::Rect>& eyes, double scale,
+                       cv::Point2f* left, cv::Point2f* right)
+{
+    int first = -1, last = -1;
+    for (size_t i = 0; i < eyes.size(); i++) {
+        float cy = eyes[i].y + eyes[i].height * 0.5f;
+        if (cy > face.height * 0.6f) continue;   // 鼻孔、嘴角之类的误检
+        if (first < 0 || eyes[i].x < eyes[first].x) first = (int)i;
+        if (last < 0 || eyes[i].x > eyes[last].x) last = (int)i;
+    }
+
+    bool detected = first >= 0 && first != last && eyes[last].x - eyes[first].x > face.width / 5;
+    if (detected) {
+        const cv::Rect& l = eyes[first];
+        const cv::Rect& r = eyes[last];
+        *left  = cv::Point2f(face.x + l.x + l.width * 0.5f, face.y + l.y + l.height * 0.5f);
+        *right = cv::Point2f(face.x + r.x + r.width * 0.5f, face.y + r.y + r.height * 0.5f);
+    }
+    else {
+        *left  = cv::Point2f(face.x + face.width * kBoxEyeX0, face.y + face.height * kBoxEyeY);
+        *right = cv::Point2f(face.x + face.width * kBoxEyeX1, face.y + face.height * kBoxEyeY);
+    }
+    *left  = cv::Point2f(left->x * (float)scale, left->y * (float)scale);
+    *right = cv::Point2f(right->x * (float)scale, right->y * (float)scale);
+    return detected;
+}
+
+// 把源图两眼 (l, r) 映射到模板两眼 (tl, tr) 的相似变换, 返回它的逆(输出坐标 -> 源坐标),
+// 即 affine_transform 使用的反向映射矩阵.
+// 以复数表示: src = l + z * (dst - tl), z = (r - l) / (tr - tl)
+static AffineMatrix similarityFromEyes(cv::Point2f l, cv::Point2f r, cv::Point2f tl,
+                                       cv::Point2f tr)
+{
+    float sx = r.x - l.x, sy = r.y - l.y;
+    float dx = tr.x - tl.x, dy = tr.y - tl.y;
+    float norm = dx * dx + dy * dy;
+    float p    = (sx * dx + sy * dy) / norm;   // z 的实部: scale * cos
+    float q    = (sy * dx - sx * dy) / norm;   // z 的虚部: scale * sin
+
+    AffineMatrix mat;
+    mat.a = p;
+    mat.b = -q;
+    mat.c = l.x - p * tl.x + q * tl.y;
+    mat.d = q;
+    mat.e = p;
+    mat.f = l.y - q * tl.x - p * tl.y;
+    return mat;
+}
+
+static void usage(const char* prog)
+{
+    std::cout << "Usage: " << prog << " [options] <input.nv21c | input.nv21>\n"
+              << "  --size=<width>x<height>     尺寸, 裸 .nv21 文件(可含多帧)必填\n"
+              << "  --cascade=<path>            人脸级联\n"
+              << "  --nested-cascade=<path>     眼睛级联, 为空时按人脸框估计眼睛位置\n"
+              << "  --scale=<n>                 检测图缩小倍数, 默认 2\n"
+              << "  --crop=<n>                  对齐小图边长, 默认 224\n"
+              << "  --out-dir=<dir>             写出 face_<帧号>_<序号>_<n>x<n>.nv21\n"
+              << "  --gray                      只输出对齐后的 Y 平面(.gray), 不计算色度\n"
+              << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+    cv::CommandLineParser parser(
+        argc,
+        argv,
+        "{help h||}"
+        "{cascade|data/haarcascades/haarcascade_frontalface_alt.xml|}"
+        "{nested-cascade|data/haarcascades/haarcascade_eye_tree_eyeglasses.xml|}"
+        "{size||}{scale|2|}{crop|224|}{out-dir||}{gray||}{@input||}");
+    std::string input = parser.get<std::string>("@input");
+    if (parser.has("help") || input.empty()) {
+        usage(argv[0]);
+        return parser.has("help") ? 0 : -1;
+    }
+    double      scale   = std::max(parser.get<double>("scale"), 1.0);
+    int         crop    = parser.get<int>("crop") & ~1;
+    std::string outDir  = parser.get<std::string>("out-dir");
+    bool        grayOut = parser.has("gray");
+    int         width = 0, height = 0;
+    if (parser.has("size")) {
+        sscanf(parser.get<std::string>("size").c_str(), "%dx%d", &width, &height);
+    }
+    if (!parser.check() || crop <= 0) {
+        parser.printErrors();
+        return -1;
+    }
+
+    cv::CascadeClassifier cascade, nestedCascade;
+    if (!cascade.load(cv::samples::findFile(parser.get<std::string>("cascade")))) {
+        std::cerr << "无法加载人脸级联" << std::endl;
+        return -1;
+    }
+    if (!nestedCascade.load(
+            cv::samples::findFileOrKeep(parser.get<std::string>("nested-cascade")))) {
+        std::cerr << "没有眼睛级联, 按人脸框估计眼睛位置" << std::endl;
+    }
+
+    FrameSource source;
+    if (!openSource(&source, input, width, height)) {
+        std::cerr << "无法打开 " << input << " (裸 .nv21 需要 --size=WxH, 宽高为偶数)"
+                  << std::endl;
+        return -1;
+    }
+
+    AsyncWriter* writer = outDir.empty() ? NULL : async_writer_create(0, 0);
+    NV21Image*   aligned = create_nv21(crop, crop);
+    cv::Point2f  templateLeft(kLeftEyeX * crop, kEyeY * crop);
+    cv::Point2f  templateRight(kRightEyeX * crop, kEyeY * crop);
+
+    DetectorContext detector(scale, false);
+    long            frames = 0, faces = 0, eyeAligned = 0;
+    double          detectSec = 0, alignSec = 0;
+    Clock::time_point start = Clock::now();
+
+    NV21Image frame;
+    while (nextFrame(&source, &frame)) {
+        Clock::time_point t0 = Clock::now();
+        // Y 平面就是检测需要的灰度图
+        cv::Mat                gray(frame.height, frame.width, CV_8UC1, frame.y);
+        const DetectionResult& result = detector.detect(gray, cascade, nestedCascade);
+        Clock::time_point      t1     = Clock::now();
+
+        for (size_t i = 0; i < result.faces.size(); i++) {
+            cv::Point2f left, right;
+            eyeAligned +=
+                eyeCenters(result.faces[i], result.nested[i], result.scale, &left, &right);
+            AffineMatrix mat = similarityFromEyes(left, right, templateLeft, templateRight);
+
+            PERF_SCOPE("align");
+            if (grayOut) {
+                // 灰度识别只取 Y, VU 从不被访问, 也就不会计算
+                NV21LazyWarp warp;
+                nv21_lazy_warp_init(&warp, aligned, &frame, mat, NV21_WARP_AFFINE_TRANSFORM);
+                nv21_lazy_warp_y(&warp);
+            }
+            else {
+                affine_transform_dispatch(aligned, &frame, mat);
+            }
+            if (writer) {
+                char path[1024];
+                snprintf(path,
+                         sizeof(path),
+                         "%s/face_%06ld_%02d_%dx%d.%s",
+                         outDir.c_str(),
+                         frames,
+                         (int)i,
+                         crop,
+                         crop,
+                         grayOut ? "gray" : "nv21");
+                if (grayOut) {
+                    async_writer_submit_copy(writer, path, aligned->y, (size_t)crop * crop);
+                }
+                else {
+                    write_nv21_file_async(writer, aligned, path);
+                }
+            }
+        }
+        Clock::time_point t2 = Clock::now();
+
+        detectSec += std::chrono::duration<double>(t1 - t0).count();
+        alignSec += std::chrono::duration<double>(t2 - t1).count();
+        faces += (long)result.faces.size();
+        frames++;
+    }
+    if (writer) async_writer_flush(writer);
+    double totalSec = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("%ld frame(s), %ld face(s) (%ld aligned by detected eyes), %.2f s\n",
+           frames,
+           faces,
+           eyeAligned,
+           totalSec);
+    printf("end-to-end: %.1f faces/s, %.1f frames/s\n",
+           totalSec > 0 ? faces / totalSec : 0.0,
+           totalSec > 0 ? frames / totalSec : 0.0);
+    printf("detect %.2f ms/frame, align %.3f ms/face\n",
+           frames ? detectSec * 1000 / frames : 0.0,
+           faces ? alignSec * 1000 / faces : 0.0);
+
+    free_nv21(aligned);
+    if (writer) async_writer_destroy(writer);
+    closeSource(&source);
+    return 0;
+}
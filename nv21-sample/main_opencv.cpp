@@ -2,12 +2,61 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 
+#include "nv21_image.h"
+#include "perf_regions.h"
+#include "thread_pool.h"
+
 using namespace cv;
 using namespace std;
 
+struct WarpAffineBand
+{
+    const Mat* src;
+    Mat*       dst;
+    Mat        M;
+    Scalar     borderValue;
+};
+
+// 输出第 [row, rowEnd) 行: 把正向矩阵的 y 平移减去 row, 等价于只算这一段输出
+static void warpAffineRows(void* arg, int row, int rowEnd)
+{
+    const WarpAffineBand* band = static_cast<const WarpAffineBand*>(arg);
+
+    Mat M = band->M.clone();
+    M.at<double>(1, 2) -= row;
+
+    Mat dstRows = band->dst->rowRange(row, rowEnd);
+    warpAffine(*band->src,
+               dstRows,
+               M,
+               dstRows.size(),
+               INTER_LINEAR,
+               BORDER_CONSTANT,
+               band->borderValue);
+}
+
+// OpenCV 编译时关闭了 TBB/OpenMP/pthreads 后端, warpAffine 是单线程的, 这里按行带自己并行
+static void warpAffineParallel(const Mat& src, Mat& dst, const Mat& M, Size dsize,
+                               Scalar borderValue)
+{
+    dst.create(dsize, src.type());
+
+    WarpAffineBand band;
+    band.src         = &src;
+    band.dst         = &dst;
+    band.borderValue = borderValue;
+    M.convertTo(band.M, CV_64F);
+    thread_pool_parallel_for(NULL, 0, dsize.height, 16, warpAffineRows, &band);
+}
+
+// planes 为 NV21_PLANE_* 的组合, 只写请求的平面. 色度要先上采样到全尺寸再变换、再下采样,
+// 比亮度更贵, 只要灰度的调用方传 NV21_PLANE_Y
 void nv21_affine_transform(const uint8_t* src_nv21, int src_width, int src_height,
-                           uint8_t* dst_nv21, int dst_width, int dst_height, const Mat& affine_mat)
+                           uint8_t* dst_nv21, int dst_width, int dst_height, const Mat& affine_mat,
+                           int planes)
 {
+    PERF_SCOPE("nv21_affine_transform");
+
     int src_y_size = src_width * src_height;
     int dst_y_size = dst_width * dst_height;
 
@@ -15,35 +64,25 @@ void nv21_affine_transform(const uint8_t* src_nv21, int src_width, int src_heigh
     Mat src_y(src_height, src_width, CV_8UC1, (void*)src_nv21);
     Mat src_vu(src_height / 2, src_width / 2, CV_8UC2, (void*)(src_nv21 + src_y_size));
 
-    // 仿射变换 Y
-    Mat dst_y;
-    warpAffine(src_y,
-               dst_y,
-               affine_mat,
-               Size(dst_width, dst_height),
-               INTER_LINEAR,
-               BORDER_CONSTANT,
-               Scalar(0));
+    // 仿射变换 Y, 直接写进输出缓冲
+    if (planes & NV21_PLANE_Y) {
+        Mat dst_y(dst_height, dst_width, CV_8UC1, dst_nv21);
+        warpAffineParallel(src_y, dst_y, affine_mat, Size(dst_width, dst_height), Scalar(0));
+    }
+    if (!(planes & NV21_PLANE_VU)) return;
 
     // 仿射变换 UV（注意：UV 是 subsampled，需要 scale 坐标）
     Mat src_vu_up;
     resize(src_vu, src_vu_up, Size(src_width, src_height), 0, 0, INTER_LINEAR);
 
     Mat dst_vu_up;
-    warpAffine(src_vu_up,
-               dst_vu_up,
-               affine_mat,
-               Size(dst_width, dst_height),
-               INTER_LINEAR,
-               BORDER_CONSTANT,
-               Scalar(128, 128));
+    warpAffineParallel(src_vu_up, dst_vu_up, affine_mat, Size(dst_width, dst_height),
+                       Scalar(128, 128));
 
     // 下采样 VU（从 dst_vu_up → dst_vu）
     Mat dst_vu;
     resize(dst_vu_up, dst_vu, Size(dst_width / 2, dst_height / 2), 0, 0, INTER_LINEAR);
 
-    // 合并输出
-    memcpy(dst_nv21, dst_y.data, dst_y.total());
     memcpy(dst_nv21 + dst_y_size, dst_vu.data, dst_vu.total() * 2);
 }
 
@@ -119,8 +158,14 @@ int main()
     cout << "affine_mat: " << affine_mat << endl;
 
     // === 执行仿射变换 ===
-    nv21_affine_transform(
-        src_nv21.data(), src_width, src_height, dst_nv21.data(), dst_width, dst_height, affine_mat);
+    nv21_affine_transform(src_nv21.data(),
+                          src_width,
+                          src_height,
+                          dst_nv21.data(),
+                          dst_width,
+                          dst_height,
+                          affine_mat,
+                          NV21_PLANE_ALL);
 
     // === 写出结果 ===
     ofstream fout(out_path, ios::binary);
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "perf_regions.h"
+#include "thread_pool.h"
+
 // 定义 NV21 图像结构体
 typedef struct
 {
@@ -111,25 +114,31 @@ void sample_uv(const unsigned char* src_uv, int src_width, int src_height, float
     *u_out     = src_uv[offset + 1];   // U
 }
 
-void affine_transform(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
+typedef struct
 {
-    AffineMatrix inv;
-    if (!invert_affine_matrix(&mat, &inv)) {
-        // 不可逆变换
-        return;
-    }
+    NV21Image*       dst;
+    const NV21Image* src;
+    AffineMatrix     inv;
+} WarpBand;
+
+// 处理 [y_begin, y_end) 行, 行带起点为偶数, 色度行只属于一个行带
+static void affine_transform_rows(void* arg, int y_begin, int y_end)
+{
+    const WarpBand*     band = (const WarpBand*)arg;
+    NV21Image*          dst  = band->dst;
+    const NV21Image*    src  = band->src;
+    const AffineMatrix* inv  = &band->inv;
 
     int dst_w = dst->width;
-    int dst_h = dst->height;
     int src_w = src->width;
     int src_h = src->height;
 
     // 处理 Y 分量
-    for (int y_dst = 0; y_dst < dst_h; ++y_dst) {
+    for (int y_dst = y_begin; y_dst < y_end; ++y_dst) {
         for (int x_dst = 0; x_dst < dst_w; ++x_dst) {
             // 计算源图像坐标
-            float x_src = inv.m[0][0] * x_dst + inv.m[0][1] * y_dst + inv.m[0][2];
-            float y_src = inv.m[1][0] * x_dst + inv.m[1][1] * y_dst + inv.m[1][2];
+            float x_src = inv->m[0][0] * x_dst + inv->m[0][1] * y_dst + inv->m[0][2];
+            float y_src = inv->m[1][0] * x_dst + inv->m[1][1] * y_dst + inv->m[1][2];
 
             dst->y_plane[y_dst * dst_w + x_dst] =
                 bilinear_sample(src->y_plane, src_w, src_h, x_src, y_src);
@@ -137,10 +146,10 @@ void affine_transform(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
     }
 
     // 处理 UV 分量（每 2x2 像素一个块）
-    for (int y = 0; y < dst_h; y += 2) {
+    for (int y = y_begin; y < y_end; y += 2) {
         for (int x = 0; x < dst_w; x += 2) {
-            float x_src = inv.m[0][0] * x + inv.m[0][1] * y + inv.m[0][2];
-            float y_src = inv.m[1][0] * x + inv.m[1][1] * y + inv.m[1][2];
+            float x_src = inv->m[0][0] * x + inv->m[0][1] * y + inv->m[0][2];
+            float y_src = inv->m[1][0] * x + inv->m[1][1] * y + inv->m[1][2];
 
             unsigned char v, u;
             sample_uv(src->uv_plane, src_w, src_h, x_src, y_src, &v, &u);
@@ -152,6 +161,23 @@ void affine_transform(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
     }
 }
 
+#define BAND_ROWS 16
+
+void affine_transform(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
+{
+    WarpBand band;
+    band.dst = dst;
+    band.src = src;
+    if (!invert_affine_matrix(&mat, &band.inv)) {
+        // 不可逆变换
+        return;
+    }
+
+    PERF_SCOPE_BEGIN(scope, "affine_transform");
+    thread_pool_parallel_for(NULL, 0, dst->height, BAND_ROWS, affine_transform_rows, &band);
+    PERF_SCOPE_END(scope);
+}
+
 int main()
 {
     // 创建源和目标 NV21 图像（假设图像大小为 640x480）
@@ -0,0 +1,472 @@
+#include "nv21_affine_dispatch.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nv21_simd.h"
+#include "perf_regions.h"
+
+#define AFFINE_EPS      1e-4f
+#define SCALE_BITS      8
+#define SCALE_ONE       (1 << SCALE_BITS)
+
+static int near_value(float v, float target)
+{
+    return fabsf(v - target) < AFFINE_EPS;
+}
+
+static int near_integer(float v)
+{
+    return fabsf(v - floorf(v + 0.5f)) < AFFINE_EPS;
+}
+
+// floor(v / 2), 对负数也向下取整
+static int floor_half(int v)
+{
+    return v >= 0 ? v / 2 : -((1 - v) / 2);
+}
+
+AffineKind classify_affine_matrix(const AffineMatrix* mat)
+{
+    int int_offset = near_integer(mat->c) && near_integer(mat->f);
+
+    if (near_value(mat->b, 0) && near_value(mat->d, 0)) {
+        if (int_offset && near_value(mat->a, 1) && near_value(mat->e, 1)) {
+            return AFFINE_KIND_TRANSLATION;
+        }
+        if (int_offset && near_value(mat->a, -1) && near_value(mat->e, -1)) {
+            return AFFINE_KIND_ROTATE_180;
+        }
+        if (mat->a > 0 && mat->e > 0) return AFFINE_KIND_AXIS_SCALE;
+        return AFFINE_KIND_GENERAL;
+    }
+
+    if (int_offset && near_value(mat->a, 0) && near_value(mat->e, 0)) {
+        if (near_value(mat->b, -1) && near_value(mat->d, 1)) return AFFINE_KIND_ROTATE_90;
+        if (near_value(mat->b, 1) && near_value(mat->d, -1)) return AFFINE_KIND_ROTATE_270;
+    }
+    return AFFINE_KIND_GENERAL;
+}
+
+const char* affine_kind_name(AffineKind kind)
+{
+    switch (kind) {
+    case AFFINE_KIND_TRANSLATION: return "translation";
+    case AFFINE_KIND_AXIS_SCALE: return "axis-scale";
+    case AFFINE_KIND_ROTATE_90: return "rotate-90";
+    case AFFINE_KIND_ROTATE_180: return "rotate-180";
+    case AFFINE_KIND_ROTATE_270: return "rotate-270";
+    default: return "general";
+    }
+}
+
+// 目标图四个角都落在源图内(与 affine_transform 的边界判断一致)
+static int maps_inside(const NV21Image* dst, const NV21Image* src, const AffineMatrix* mat)
+{
+    int xs[2] = {0, dst->width - 1};
+    int ys[2] = {0, dst->height - 1};
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            float src_x = mat->a * xs[i] + mat->b * ys[j] + mat->c;
+            float src_y = mat->d * xs[i] + mat->e * ys[j] + mat->f;
+            if (src_x < 0 || src_x >= src->width || src_y < 0 || src_y >= src->height) return 0;
+        }
+    }
+    return 1;
+}
+
+// 整数平移: 每行一次 memcpy, 越界部分填充背景
+static void translate_nv21(NV21Image* dst, const NV21Image* src, int tx, int ty)
+{
+    int dw = dst->width, dh = dst->height;
+    int sw = src->width, sh = src->height;
+
+    // 有效列区间 [x0, x1)
+    int x0 = CLAMP(-tx, 0, dw);
+    int x1 = CLAMP(sw - tx, x0, dw);
+
+    for (int y = 0; y < dh; y++) {
+        uint8_t* out = dst->y + y * dw;
+        int      sy  = y + ty;
+        if (sy < 0 || sy >= sh) {
+            memset(out, 0, dw);
+            continue;
+        }
+        memset(out, 0, x0);
+        memcpy(out + x0, src->y + sy * sw + x0 + tx, x1 - x0);
+        memset(out + x1, 0, dw - x1);
+    }
+
+    // VU: 只有偶数坐标的 Y 在界内时才写, 源 VU 对下标为 round(src_x / 2)
+    int i0 = (x0 + 1) / 2;
+    int i1 = (x1 + 1) / 2;
+    int cx = floor_half(tx + 1);
+    int cy = floor_half(ty + 1);
+    int im = CLAMP(sw / 2 - cx, i0, i1);   // i < im 时不需要右边界钳位
+
+    for (int j = 0; j < dh / 2; j++) {
+        uint8_t* out = dst->vu + j * dw;
+        int      sy  = 2 * j + ty;
+        if (sy < 0 || sy >= sh) {
+            memset(out, 128, dw);
+            continue;
+        }
+
+        const uint8_t* row = src->vu + CLAMP(j + cy, 0, sh / 2 - 1) * sw;
+        memset(out, 128, 2 * i0);
+        memcpy(out + 2 * i0, row + 2 * (i0 + cx), 2 * (im - i0));
+        for (int i = im; i < i1; i++) {
+            memcpy(out + 2 * i, row + 2 * (sw / 2 - 1), 2);
+        }
+        memset(out + 2 * i1, 128, dw - 2 * i1);
+    }
+}
+
+// 查找表和行缓冲按线程缓存, 只在需要更大时重新分配, 线程退出时释放
+typedef struct
+{
+    uint8_t* data;
+    size_t   size;
+} ScaleBuffer;
+
+static pthread_key_t  scale_buffer_key;
+static pthread_once_t scale_buffer_once = PTHREAD_ONCE_INIT;
+
+static void free_scale_buffer(void* arg)
+{
+    ScaleBuffer* buf = (ScaleBuffer*)arg;
+    free(buf->data);
+    free(buf);
+}
+
+static void create_scale_buffer_key(void)
+{
+    pthread_key_create(&scale_buffer_key, free_scale_buffer);
+}
+
+// 失败返回 NULL
+static uint8_t* scale_buffer(size_t size)
+{
+    pthread_once(&scale_buffer_once, create_scale_buffer_key);
+    ScaleBuffer* buf = (ScaleBuffer*)pthread_getspecific(scale_buffer_key);
+    if (!buf) {
+        buf = (ScaleBuffer*)calloc(1, sizeof(ScaleBuffer));
+        if (!buf) return NULL;
+        if (pthread_setspecific(scale_buffer_key, buf) != 0) {
+            free(buf);
+            return NULL;
+        }
+    }
+    if (buf->size < size) {
+        uint8_t* data = (uint8_t*)realloc(buf->data, size);
+        if (!data) return NULL;
+        buf->data = data;
+        buf->size = size;
+    }
+    return buf->data;
+}
+
+// 垂直插值: tmp[x] = s0[x] * (SCALE_ONE - wy) + s1[x] * wy, x 取 [x0, x1]. 结果不超过 255 << 8
+static void scale_row_vertical(uint16_t* tmp, const uint8_t* s0, const uint8_t* s1, int x0, int x1,
+                               int wy)
+{
+    int x = x0;
+#if defined(NV21_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w0   = _mm_set1_epi16((short)(SCALE_ONE - wy));
+    const __m128i w1   = _mm_set1_epi16((short)wy);
+    for (; x + 16 <= x1 + 1; x += 16) {
+        __m128i a  = _mm_loadu_si128((const __m128i*)(s0 + x));
+        __m128i b  = _mm_loadu_si128((const __m128i*)(s1 + x));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+        _mm_storeu_si128((__m128i*)(tmp + x), lo);
+        _mm_storeu_si128((__m128i*)(tmp + x + 8), hi);
+    }
+#endif
+    for (; x <= x1; x++) tmp[x] = (uint16_t)(s0[x] * (SCALE_ONE - wy) + s1[x] * wy);
+}
+
+#if defined(NV21_HAVE_SSE2)
+// tmp[x0], tmp[x0 + 1] 拼成一个 32 位数, 低 16 位为左边的像素
+static inline int load_pair(const uint16_t* p)
+{
+    int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+#endif
+
+// 水平插值: out[x] = (tmp[x0] * (SCALE_ONE - wx) + tmp[x0 + 1] * wx) >> 16, 与通用路径一样截断取整.
+// xwgt 每个像素一对 (SCALE_ONE - wx, wx). tmp 超出 int16 范围, SSE2 先减去 32768 再用 pmaddwd
+// 做两项乘加, 最后补回 32768 * SCALE_ONE(两个权重之和恒为 SCALE_ONE), 结果与标量一致
+static void scale_row_horizontal(uint8_t* out, const uint16_t* tmp, const int* xofs,
+                                 const int16_t* xwgt, int dw)
+{
+    int x = 0;
+#if defined(NV21_HAVE_SSE2)
+    const __m128i flip = _mm_set1_epi16((short)0x8000);
+    const __m128i bias = _mm_set1_epi32(32768 * SCALE_ONE);
+    for (; x + 8 <= dw; x += 8) {
+        __m128i sum[2];
+        for (int k = 0; k < 2; k++) {
+            const int* ofs   = xofs + x + 4 * k;
+            __m128i    pairs = _mm_setr_epi32(load_pair(tmp + ofs[0]),
+                                           load_pair(tmp + ofs[1]),
+                                           load_pair(tmp + ofs[2]),
+                                           load_pair(tmp + ofs[3]));
+            __m128i    w     = _mm_loadu_si128((const __m128i*)(xwgt + 2 * (x + 4 * k)));
+            sum[k] = _mm_add_epi32(_mm_madd_epi16(_mm_xor_si128(pairs, flip), w), bias);
+            sum[k] = _mm_srli_epi32(sum[k], 2 * SCALE_BITS);
+        }
+        __m128i v = _mm_packs_epi32(sum[0], sum[1]);
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(v, v));
+    }
+#endif
+    for (; x < dw; x++) {
+        int x0 = xofs[x];
+        out[x] = (uint8_t)((tmp[x0] * xwgt[2 * x] + tmp[x0 + 1] * xwgt[2 * x + 1]) >>
+                           (2 * SCALE_BITS));
+    }
+}
+
+// 轴对齐缩放: 先按行做垂直插值(连续访存), 再查表做水平插值, 两步都有 SSE2 实现.
+// 调用前已保证目标图完全映射在源图内. 缓冲分配失败返回 -1, 由调用方走通用路径
+static int scale_nv21(NV21Image* dst, const NV21Image* src, const AffineMatrix* mat)
+{
+    int dw = dst->width, dh = dst->height;
+    int sw = src->width, sh = src->height;
+
+    // 所有查找表和行缓冲放在一块按线程缓存的内存里. tmp 多留一个元素, 见下面的右边界
+    size_t table_size = (size_t)dw * 2 * sizeof(int) + (size_t)dw * 2 * sizeof(int16_t) +
+                        (size_t)(sw + 1) * sizeof(uint16_t);
+    uint8_t* table = scale_buffer(table_size);
+    if (!table) return -1;
+    int*      xofs   = (int*)table;
+    int*      uv_col = xofs + dw;
+    int16_t*  xwgt   = (int16_t*)(uv_col + dw);
+    uint16_t* tmp    = (uint16_t*)(xwgt + 2 * dw);
+
+    for (int x = 0; x < dw; x++) {
+        float sx        = mat->a * x + mat->c;
+        int   wx        = (int)((sx - (int)sx) * SCALE_ONE + 0.5f);
+        xofs[x]         = (int)sx;
+        xwgt[2 * x]     = (int16_t)(SCALE_ONE - wx);
+        xwgt[2 * x + 1] = (int16_t)wx;
+        if (x % 2 == 0) uv_col[x / 2] = CLAMP((int)(sx / 2 + 0.5f), 0, sw / 2 - 1);
+    }
+    int xmin = xofs[0];
+    int xmax = CLAMP(xofs[dw - 1] + 1, 0, sw - 1);
+
+    for (int y = 0; y < dh; y++) {
+        float sy = mat->e * y + mat->f;
+        int   y0 = (int)sy;
+        int   y1 = CLAMP(y0 + 1, 0, sh - 1);
+        int   wy = (int)((sy - y0) * SCALE_ONE + 0.5f);
+
+        scale_row_vertical(tmp, src->y + y0 * sw, src->y + y1 * sw, xmin, xmax, wy);
+        // 右边界钳位: 只有 xmax 被钳到 sw - 1 时 x0 + 1 才会读到 tmp[xmax + 1]
+        tmp[xmax + 1] = tmp[xmax];
+        scale_row_horizontal(dst->y + y * dw, tmp, xofs, xwgt, dw);
+    }
+
+    for (int j = 0; j < dh / 2; j++) {
+        float          sy  = mat->e * (2 * j) + mat->f;
+        const uint8_t* row = src->vu + CLAMP((int)(sy / 2 + 0.5f), 0, sh / 2 - 1) * sw;
+        uint8_t*       out = dst->vu + j * dw;
+        for (int i = 0; i < dw / 2; i++) {
+            out[2 * i]     = row[2 * uv_col[i]];
+            out[2 * i + 1] = row[2 * uv_col[i] + 1];
+        }
+    }
+    return 0;
+}
+
+static void copy_element(uint8_t* dst, int dst_stride, const uint8_t* src, int src_stride, int row0,
+                         int drow, int col0, int dcol, int elem, int x, int y)
+{
+    memcpy(dst + y * dst_stride + x * elem,
+           src + (row0 + drow * x) * src_stride + (col0 + dcol * y) * elem,
+           elem);
+}
+
+// dst(x, y) = src(row0 + drow * x, col0 + dcol * y), drow / dcol 为 ±1, 元素为 elem 字节.
+// 以 16x16 字节块(或 8x8 的 16 位块)为单位转置, 再把 4x4 个块组成 64 字节宽的大块遍历,
+// 使每条源缓存行在 L1 中被 4 个相邻块用完.
+static void transpose_plane(uint8_t* dst, int dst_stride, int w, int h, const uint8_t* src,
+                            int src_stride, int row0, int drow, int col0, int dcol, int elem)
+{
+    const int block = elem == 1 ? 16 : 8;
+    const int tile  = 4 * block;
+    const int wb    = w - w % block;
+    const int hb    = h - h % block;
+
+    // 块内源行步长, 以及 dcol < 0 时结果行倒序写回
+    ptrdiff_t src_step = (ptrdiff_t)drow * src_stride;
+    ptrdiff_t dst_step = dcol > 0 ? dst_stride : -(ptrdiff_t)dst_stride;
+
+    for (int ty = 0; ty < hb; ty += tile) {
+        int ye = ty + tile < hb ? ty + tile : hb;
+        for (int tx = 0; tx < wb; tx += tile) {
+            int xe = tx + tile < wb ? tx + tile : wb;
+            for (int y0 = ty; y0 < ye; y0 += block) {
+                int      col     = dcol > 0 ? col0 + y0 : col0 - y0 - (block - 1);
+                uint8_t* out_row = dst + (dcol > 0 ? y0 : y0 + block - 1) * dst_stride;
+                for (int x0 = tx; x0 < xe; x0 += block) {
+                    const uint8_t* in  = src + (row0 + drow * x0) * src_stride + col * elem;
+                    uint8_t*       out = out_row + x0 * elem;
+                    if (elem == 1) {
+                        transpose_u8_16x16(in, src_step, out, dst_step);
+                    }
+                    else {
+                        transpose_u16_8x8(in, src_step, out, dst_step);
+                    }
+                }
+            }
+        }
+    }
+
+    // 右侧和底部不足一块的部分
+    for (int y = 0; y < h; y++) {
+        for (int x = (y < hb ? wb : 0); x < w; x++) {
+            copy_element(dst, dst_stride, src, src_stride, row0, drow, col0, dcol, elem, x, y);
+        }
+    }
+}
+
+// c0 + step * t (t 属于 [0, n), step 为 ±1) 落在 [0, limit) 内的 t 区间 [*lo, *hi)
+static void valid_span(int c0, int step, int n, int limit, int* lo, int* hi)
+{
+    if (step > 0) {
+        *lo = CLAMP(-c0, 0, n);
+        *hi = CLAMP(limit - c0, *lo, n);
+    }
+    else {
+        *lo = CLAMP(c0 - limit + 1, 0, n);
+        *hi = CLAMP(c0 + 1, *lo, n);
+    }
+}
+
+// VU 对下标触到边界钳位的部分(奇数平移时最多首尾各一行/列)逐对处理,
+// 跳过已由快速路径写好的 [i0, i1) x [j0, j1)
+static void rotate_uv_clamped(NV21Image* dst, const NV21Image* src, int ia, int ib, int cx, int id,
+                              int ie, int cy, int i0, int i1, int j0, int j1)
+{
+    int sw = src->width, sh = src->height;
+    for (int j = 0; j < dst->height / 2; j++) {
+        uint8_t* out = dst->vu + j * dst->width;
+        for (int i = 0; i < dst->width / 2; i++) {
+            if (j >= j0 && j < j1 && i >= i0 && i < i1) {
+                i = i1 - 1;
+                continue;
+            }
+            int pc = CLAMP(cx + ia * i + ib * j, 0, sw / 2 - 1);
+            int pr = CLAMP(cy + id * i + ie * j, 0, sh / 2 - 1);
+            memcpy(out + 2 * i, src->vu + pr * sw + 2 * pc, 2);
+        }
+    }
+}
+
+// 直角旋转: 源坐标是目标坐标的整数线性函数. 180 度为逐行反转, 90/270 度为分块转置.
+// 调用前已保证目标图完全映射在源图内.
+static void rotate_nv21(NV21Image* dst, const NV21Image* src, const AffineMatrix* mat)
+{
+    int dw = dst->width, dh = dst->height;
+    int sw = src->width, sh = src->height;
+
+    int ia = (int)lrintf(mat->a), ib = (int)lrintf(mat->b), ic = (int)lrintf(mat->c);
+    int id = (int)lrintf(mat->d), ie = (int)lrintf(mat->e), jf = (int)lrintf(mat->f);
+
+    // VU 对下标: round(src_x / 2), 推导同 translate_nv21
+    int cx = floor_half(ic + 1);
+    int cy = floor_half(jf + 1);
+
+    int uv_w = dw / 2, uv_h = dh / 2;
+    int i0, i1, j0, j1;
+
+    if (ia == -1) {
+        for (int y = 0; y < dh; y++) {
+            reverse_copy_u8(dst->y + y * dw, src->y + (jf - y) * sw + ic - (dw - 1), dw);
+        }
+
+        valid_span(cx, -1, uv_w, sw / 2, &i0, &i1);
+        valid_span(cy, -1, uv_h, sh / 2, &j0, &j1);
+        for (int j = j0; j < j1; j++) {
+            reverse_copy_u16(dst->vu + j * dw + 2 * i0,
+                             src->vu + (cy - j) * sw + 2 * (cx - (i1 - 1)),
+                             i1 - i0);
+        }
+    }
+    else {
+        transpose_plane(dst->y, dw, dw, dh, src->y, sw, jf, id, ic, ib, 1);
+
+        valid_span(cy, id, uv_w, sh / 2, &i0, &i1);
+        valid_span(cx, ib, uv_h, sw / 2, &j0, &j1);
+        transpose_plane(dst->vu + j0 * dw + 2 * i0,
+                        dw,
+                        i1 - i0,
+                        j1 - j0,
+                        src->vu,
+                        sw,
+                        cy + id * i0,
+                        id,
+                        cx + ib * j0,
+                        ib,
+                        2);
+    }
+
+    rotate_uv_clamped(dst, src, ia, ib, cx, id, ie, cy, i0, i1, j0, j1);
+}
+
+// 把容差内的 0 / ±1 系数和整数平移吸附成精确值, 避免 create_rotation_matrix 的舍入误差
+// 让边界像素落到源图外
+static void snap_matrix(AffineMatrix* mat)
+{
+    float* v[6] = {&mat->a, &mat->b, &mat->c, &mat->d, &mat->e, &mat->f};
+    for (int i = 0; i < 6; i++) {
+        if (near_integer(*v[i])) *v[i] = floorf(*v[i] + 0.5f);
+    }
+}
+
+AffineKind affine_transform_dispatch(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
+{
+    PERF_SCOPE_BEGIN(scope, "affine_transform_dispatch");
+
+    AffineKind kind = classify_affine_matrix(&mat);
+    if (kind != AFFINE_KIND_GENERAL && kind != AFFINE_KIND_AXIS_SCALE) snap_matrix(&mat);
+
+    // 奇数尺寸的 VU 布局与通用路径不同, 直接走通用路径
+    if (dst->width % 2 != 0 || dst->height % 2 != 0) kind = AFFINE_KIND_GENERAL;
+
+    switch (kind) {
+    case AFFINE_KIND_TRANSLATION:
+        translate_nv21(dst, src, (int)lrintf(mat.c), (int)lrintf(mat.f));
+        break;
+    case AFFINE_KIND_AXIS_SCALE:
+        // 缓冲分配失败时同样退回通用路径
+        if (!maps_inside(dst, src, &mat) || scale_nv21(dst, src, &mat) != 0) {
+            kind = AFFINE_KIND_GENERAL;
+        }
+        break;
+    case AFFINE_KIND_ROTATE_90:
+    case AFFINE_KIND_ROTATE_180:
+    case AFFINE_KIND_ROTATE_270:
+        if (maps_inside(dst, src, &mat)) {
+            rotate_nv21(dst, src, &mat);
+        }
+        else {
+            kind = AFFINE_KIND_GENERAL;
+        }
+        break;
+    default: break;
+    }
+
+    if (kind == AFFINE_KIND_GENERAL) affine_transform(dst, src, mat);
+
+    PERF_SCOPE_END(scope);
+    return kind;
+}
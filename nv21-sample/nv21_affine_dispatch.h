@@ -0,0 +1,33 @@
+#ifndef NV21_AFFINE_DISPATCH_H
+#define NV21_AFFINE_DISPATCH_H
+
+#include "nv21_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 反向映射矩阵的分类, 角度与 create_rotation_matrix 的 theta 一致
+typedef enum
+{
+    AFFINE_KIND_TRANSLATION,   // 整数平移: 逐行 memcpy
+    AFFINE_KIND_AXIS_SCALE,    // 轴对齐缩放(+平移): 可分离双线性
+    AFFINE_KIND_ROTATE_90,     // 直角旋转(+整数平移): 分块转置
+    AFFINE_KIND_ROTATE_180,
+    AFFINE_KIND_ROTATE_270,
+    AFFINE_KIND_GENERAL,       // 其余: affine_transform
+} AffineKind;
+
+AffineKind  classify_affine_matrix(const AffineMatrix* mat);
+const char* affine_kind_name(AffineKind kind);
+
+// 与 affine_transform 语义相同(反向映射, 越界 Y=0 / VU=128), 按矩阵类型选择专用实现.
+// 平移与直角旋转结果与通用路径逐字节一致, 轴对齐缩放使用 8 位定点权重, 误差不超过 1.
+// 返回实际使用的实现类型.
+AffineKind affine_transform_dispatch(NV21Image* dst, const NV21Image* src, AffineMatrix mat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // NV21_AFFINE_DISPATCH_H
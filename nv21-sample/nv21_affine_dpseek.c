@@ -3,140 +3,325 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-#define CLAMP(v, min, max) ((v) < (min) ? (min) : ((v) > (max) ? (max) : (v)))
-
-typedef struct
+#include <time.h>
+
+#include "nv21_affine_dispatch.h"
+#include "nv21_container.h"
+#include "nv21_image.h"
+#include "nv21_pyramid.h"
+#include "nv21_ring.h"
+#include "nv21_simd.h"
+#include "nv21_slice_warp.h"
+#include "yuv_warp.h"
+
+// 从共享内存环形缓冲逐帧取 NV21, 原地做仿射变换(不拷贝输入), 统计从生产者发布到开始处理的延迟.
+// 指定 out_dir 时每帧的裁剪结果都交给 writer 异步写出, 处理循环不等磁盘
+static int consume_ring(const char* name, NV21Image* dst, AffineMatrix param, int use_dispatch,
+                        AsyncWriter* writer, const char* out_dir, const char* out_path)
 {
-    uint8_t* y;    // 亮度分量
-    uint8_t* vu;   // 色度分量(VU交错)
-    int      width;
-    int      height;
-} NV21Image;
-
-typedef struct
-{
-    float a, b, c;   // 线性变换参数
-    float d, e, f;   // 平移参数
-} AffineMatrix;
+    // 生产者可能还没启动, 等它创建
+    Nv21Ring* ring = NULL;
+    for (int i = 0; i < 500 && !ring; i++) {
+        ring = nv21_ring_open(name);
+        if (!ring) {
+            struct timespec ts = {0, 10 * 1000 * 1000};
+            nanosleep(&ts, NULL);
+        }
+    }
+    if (!ring) {
+        printf("open ring %s failed\n", name);
+        return -1;
+    }
+    printf("ring %s: %dx%d, %d slots\n",
+           name,
+           nv21_ring_width(ring),
+           nv21_ring_height(ring),
+           nv21_ring_slot_count(ring));
+
+    long     frames       = 0;
+    uint64_t latency_sum  = 0;
+    uint64_t latency_max  = 0;
+    uint64_t process_sum  = 0;
+    uint64_t expected_seq = 0;
+    long     gaps         = 0;
+
+    while (nv21_ring_wait_readable(ring, -1) > 0) {
+        Nv21RingFrame  info;
+        const uint8_t* data = nv21_ring_peek(ring, &info);
+        uint64_t       t0   = nv21_ring_now_ns();
+
+        // 直接引用共享内存中的 Y/VU 平面
+        NV21Image src = {(uint8_t*)data,
+                         (uint8_t*)data + (size_t)info.width * info.height,
+                         info.width,
+                         info.height};
+        if (use_dispatch) {
+            affine_transform_dispatch(dst, &src, param);
+        }
+        else {
+            affine_transform(dst, &src, param);
+        }
+        nv21_ring_release(ring);
+
+        if (out_dir) {
+            char crop_path[1204];
+            snprintf(crop_path,
+                     sizeof(crop_path),
+                     "%s/crop_%06llu_%dx%d.nv21",
+                     out_dir,
+                     (unsigned long long)info.sequence,
+                     dst->width,
+                     dst->height);
+            write_nv21_file_async(writer, dst, crop_path);
+        }
 
-NV21Image* create_nv21(int w, int h)
-{
-    NV21Image* img = malloc(sizeof(NV21Image));
-    img->y         = malloc(w * h);
-    img->vu        = malloc(w * h / 2);
-    img->width     = w;
-    img->height    = h;
-    return img;
+        uint64_t latency = t0 - info.timestamp_ns;
+        latency_sum += latency;
+        if (latency > latency_max) latency_max = latency;
+        process_sum += nv21_ring_now_ns() - t0;
+        if (info.sequence != expected_seq) gaps++;
+        expected_seq = info.sequence + 1;
+        frames++;
+    }
+    nv21_ring_close(ring);
+
+    if (frames > 0) {
+        printf("ring frames: %ld, sequence gaps: %ld, ingest latency avg %.1f us max %.1f us, "
+               "warp avg %.1f us\n",
+               frames,
+               gaps,
+               latency_sum / 1e3 / frames,
+               latency_max / 1e3,
+               process_sum / 1e3 / frames);
+        write_nv21_file_async(writer, dst, out_path);
+    }
+    return 0;
 }
 
-void free_nv21(NV21Image* img)
+typedef struct
 {
-    free(img->y);
-    free(img->vu);
-    free(img);
-}
-
-int read_nv21_file(NV21Image* img, const char* filename)
+    uint64_t start_ns;   // 这一帧开始读出的时刻
+    int      total_rows;
+    int      rows_done;
+    uint64_t first_ns;   // 以下均相对 start_ns
+    uint64_t half_ns;
+    uint64_t done_ns;
+} SliceTimeline;
+
+static void on_slice_rows(void* ctx, int y_begin, int y_end)
 {
-    FILE* fp = fopen(filename, "rb");
-    if (fp != NULL) {
-        fread(img->y, img->width * img->height, 1, fp);
-        fread(img->vu, img->width * img->height / 2, 1, fp);
-        fclose(fp);
-        printf("read nv21file: %s  \n", filename);
-        return 0;
+    SliceTimeline* timeline = (SliceTimeline*)ctx;
+    uint64_t       now      = nv21_ring_now_ns() - timeline->start_ns;
+    if (timeline->rows_done == 0) timeline->first_ns = now;
+    if (timeline->rows_done * 2 < timeline->total_rows &&
+        (timeline->rows_done + y_end - y_begin) * 2 >= timeline->total_rows) {
+        timeline->half_ns = now;
     }
-    return -1;
+    timeline->rows_done += y_end - y_begin;
+    timeline->done_ns = now;
 }
 
-int write_nv21_file(NV21Image* img, const char* filename)
+// 模拟卷帘读出: 源图的行在 readout_ms 内均匀到达, 分 slices 段交付, 每段到达后立即喂给分段
+// 变换, 记录目标行输出的时刻. 再与等整帧读完才做 affine_transform 的做法对比, 并核对结果一致
+static int run_slices(NV21Image* dst, const NV21Image* src, AffineMatrix param, int slices,
+                      double readout_ms)
 {
-    FILE* fp = fopen(filename, "wb");
-    if (fp) {
-        fwrite(img->y, img->width * img->height, 1, fp);
-        fwrite(img->vu, img->width * img->height / 2, 1, fp);
-        fclose(fp);
-        printf("write nv21file: %s  \n", filename);
-        return 0;
+    NV21Image*     live = create_nv21(src->width, src->height);   // 逐段写入的读出缓冲区
+    NV21Image*     ref  = create_nv21(dst->width, dst->height);
+    NV21SliceWarp* warp = nv21_slice_warp_create(dst, live, param);
+    if (!warp) {
+        free_nv21(live);
+        free_nv21(ref);
+        return -1;
     }
-    return -1;
-}
-
-AffineMatrix matrix_multiply(AffineMatrix m1, AffineMatrix m2)
-{
-    return (AffineMatrix){.a = m1.a * m2.a + m1.b * m2.d,
-                          .b = m1.a * m2.b + m1.b * m2.e,
-                          .c = m1.a * m2.c + m1.b * m2.f + m1.c,
-                          .d = m1.d * m2.a + m1.e * m2.d,
-                          .e = m1.d * m2.b + m1.e * m2.e,
-                          .f = m1.d * m2.c + m1.e * m2.f + m1.f};
-}
-
-AffineMatrix create_rotation_matrix(float theta)
-{
-    float rad = theta * M_PI / 180.0f;
-    return (AffineMatrix){cos(rad), -sin(rad), 0, sin(rad), cos(rad), 0};
-}
 
-AffineMatrix create_translation_matrix(float tx, float ty)
-{
-    return (AffineMatrix){1, 0, tx, 0, 1, ty};
-}
+    uint64_t      readout_ns = (uint64_t)(readout_ms * 1e6);
+    SliceTimeline timeline   = {nv21_ring_now_ns(), dst->height, 0, 0, 0, 0};
+    int           rows_ready = 0;
+    for (int i = 0; i < slices; i++) {
+        int rows_end = (int)((int64_t)src->height * (i + 1) / slices) & ~1;
+        if (i == slices - 1) rows_end = src->height;
+        if (rows_end <= rows_ready) continue;
+
+        // 这一段最后一行读出的时刻
+        uint64_t arrive = timeline.start_ns + readout_ns * rows_end / src->height;
+        uint64_t now    = nv21_ring_now_ns();
+        if (arrive > now) {
+            struct timespec ts = {(time_t)((arrive - now) / 1000000000),
+                                  (long)((arrive - now) % 1000000000)};
+            nanosleep(&ts, NULL);
+        }
+        memcpy(live->y + (size_t)rows_ready * src->width,
+               src->y + (size_t)rows_ready * src->width,
+               (size_t)(rows_end - rows_ready) * src->width);
+        memcpy(live->vu + (size_t)rows_ready / 2 * src->width,
+               src->vu + (size_t)rows_ready / 2 * src->width,
+               (size_t)(rows_end - rows_ready) / 2 * src->width);
+        rows_ready = rows_end;
+        nv21_slice_warp_feed(warp, rows_ready, on_slice_rows, &timeline);
+    }
 
-AffineMatrix create_scale_matrix(float sx, float sy)
-{
-    return (AffineMatrix){sx, 0, 0, 0, sy, 0};
+    // 整帧方式: 读出结束后才开始变换
+    uint64_t t0 = nv21_ring_now_ns();
+    affine_transform(ref, live, param);
+    uint64_t warp_ns = nv21_ring_now_ns() - t0;
+
+    size_t y_size    = (size_t)dst->width * dst->height;
+    int    identical =
+        memcmp(dst->y, ref->y, y_size) == 0 && memcmp(dst->vu, ref->vu, y_size / 2) == 0;
+    printf("slice warp, %d slice(s) over a %.1f ms readout: first rows at %.2f ms, "
+           "half at %.2f ms, all at %.2f ms\n",
+           slices,
+           readout_ms,
+           timeline.first_ns / 1e6,
+           timeline.half_ns / 1e6,
+           timeline.done_ns / 1e6);
+    printf("full-frame warp: all rows at %.2f ms (readout + %.2f ms), output %s\n",
+           (readout_ns + warp_ns) / 1e6,
+           warp_ns / 1e6,
+           identical ? "identical" : "DIFFERS");
+
+    nv21_slice_warp_destroy(warp);
+    free_nv21(live);
+    free_nv21(ref);
+    return identical ? 0 : -1;
 }
 
-AffineMatrix create_centered_scale(float sx, float sy, int w, int h)
+static uint64_t time_warps(int iters, YuvLayout layout, YuvImage* dst, const YuvImage* src,
+                           AffineMatrix mat, int fixed)
 {
-    AffineMatrix move_back  = create_translation_matrix(-w / 2, -h / 2);
-    AffineMatrix scale      = create_scale_matrix(sx, sy);
-    AffineMatrix move_front = create_translation_matrix(w / 2, h / 2);
-    return matrix_multiply(move_front, matrix_multiply(scale, move_back));
+    uint64_t t0 = nv21_ring_now_ns();
+    for (int i = 0; i < iters; i++) {
+        if (fixed) {
+            yuv_warp(layout, dst, src, mat);
+        }
+        else {
+            yuv_warp_generic(layout, dst, src, mat);
+        }
+    }
+    return nv21_ring_now_ns() - t0;
 }
 
-// 裁剪 NV21 图像
-NV21Image* crop_nv21(const NV21Image* src, int left, int top, int crop_w, int crop_h)
+// 布局模板内核对比: 通用 C 实现(affine_transform)、模板通用尺寸版本、模板固定尺寸版本,
+// 并把源图转成 NV12/I420 走对应的特化, 核对各路输出与 affine_transform 一致
+static int bench_layouts(NV21Image* dst, const NV21Image* src, AffineMatrix param, int iters)
 {
-    // 检查裁剪范围是否合法
-    if (left < 0 || top < 0 || left + crop_w > src->width || top + crop_h > src->height) {
-        printf("裁剪范围超出源图像范围！\n");
-        return NULL;
+    size_t     y_size   = (size_t)dst->width * dst->height;
+    size_t     src_size = (size_t)src->width * src->height;
+    NV21Image* out      = create_nv21(dst->width, dst->height);
+    uint8_t*   planar   = (uint8_t*)malloc(src_size * 3 / 2 + y_size * 3 / 2);
+    if (!out || !planar) {
+        free_nv21(out);
+        free(planar);
+        return -1;
     }
 
-    // 强制坐标和尺寸为偶数（关键步骤）
-    left   = (left / 2) * 2;
-    top    = (top / 2) * 2;
-    crop_w = (crop_w / 2) * 2;
-    crop_h = (crop_h / 2) * 2;
-
-    // 分配新的 NV21 图像结构
-    NV21Image* cropped = create_nv21(crop_w, crop_h);
-
-    if (!cropped) {
-        printf("裁剪图像内存分配失败！\n");
-        return NULL;
+    uint64_t t0 = nv21_ring_now_ns();
+    for (int i = 0; i < iters; i++) affine_transform(dst, src, param);
+    uint64_t c_ns = nv21_ring_now_ns() - t0;
+
+    YuvImage yuv_src = yuv_image_from_nv21(src);
+    YuvImage yuv_out = yuv_image_from_nv21(out);
+    uint64_t generic_ns = time_warps(iters, YUV_LAYOUT_NV21, &yuv_out, &yuv_src, param, 0);
+    int      same_generic =
+        memcmp(out->y, dst->y, y_size) == 0 && memcmp(out->vu, dst->vu, y_size / 2) == 0;
+    uint64_t fixed_ns   = time_warps(iters, YUV_LAYOUT_NV21, &yuv_out, &yuv_src, param, 1);
+    int      same_fixed =
+        memcmp(out->y, dst->y, y_size) == 0 && memcmp(out->vu, dst->vu, y_size / 2) == 0;
+
+    // 同一帧转成 I420: 输出的 U/V 平面应与 NV21 结果的 VU 拆开后一致
+    uint8_t* u_src = planar;
+    uint8_t* v_src = u_src + src_size / 4;
+    uint8_t* u_dst = v_src + src_size / 4;
+    uint8_t* v_dst = u_dst + y_size / 4;
+    for (size_t i = 0; i < src_size / 4; i++) {
+        v_src[i] = src->vu[i * 2];
+        u_src[i] = src->vu[i * 2 + 1];
     }
-
-    // 裁剪 Y 平面
-    for (int row = 0; row < crop_h; row++) {
-        memcpy(cropped->y + row * crop_w, src->y + (top + row) * src->width + left, crop_w);
+    YuvImage i420_src = {{src->y, u_src, v_src}, src->width, src->height};
+    YuvImage i420_dst = {{out->y, u_dst, v_dst}, dst->width, dst->height};
+    uint64_t i420_ns  = time_warps(iters, YUV_LAYOUT_I420, &i420_dst, &i420_src, param, 1);
+    int      same_i420 = memcmp(out->y, dst->y, y_size) == 0;
+    for (size_t i = 0; i < y_size / 4; i++) {
+        same_i420 &= v_dst[i] == dst->vu[i * 2] && u_dst[i] == dst->vu[i * 2 + 1];
     }
 
-    // 裁剪 VU 平面
-    for (int row = 0; row < crop_h / 2; row++) {
-        memcpy(cropped->vu + row * crop_w, src->vu + ((top / 2) + row) * src->width + left, crop_w);
+    printf("warp %dx%d, %d iteration(s):\n", dst->width, dst->height, iters);
+    printf("  affine_transform (C)        %8.1f us\n", c_ns / 1e3 / iters);
+    printf("  NV21 template, generic size %8.1f us  %s\n",
+           generic_ns / 1e3 / iters,
+           same_generic ? "identical" : "DIFFERS");
+    printf("  NV21 template, fixed size   %8.1f us  %s  (%.2fx generic, %.2fx C)\n",
+           fixed_ns / 1e3 / iters,
+           same_fixed ? "identical" : "DIFFERS",
+           (double)generic_ns / fixed_ns,
+           (double)c_ns / fixed_ns);
+    printf("  I420 template, fixed size   %8.1f us  %s\n",
+           i420_ns / 1e3 / iters,
+           same_i420 ? "identical" : "DIFFERS");
+
+    free(planar);
+    free_nv21(out);
+    return same_generic && same_fixed && same_i420 ? 0 : -1;
+}
+
+// 惰性变换与整帧内核对比: 先只取 Y 计时, 再清掉 VU 后按需补算色度,
+// 两个平面都与整帧内核的结果逐字节核对
+static int check_lazy(NV21Image* dst, const NV21Image* src, AffineMatrix param, int iters)
+{
+    size_t     y_size = (size_t)dst->width * dst->height;
+    NV21Image* ref    = create_nv21(dst->width, dst->height);
+    if (!ref) return -1;
+
+    static const char* names[] = {"affine_transform", "warp_affine"};
+    int                ok      = 1;
+    printf("lazy warp %dx%d -> %dx%d, %d iteration(s):\n",
+           src->width,
+           src->height,
+           dst->width,
+           dst->height,
+           iters);
+    for (int k = 0; k < 2; k++) {
+        NV21WarpKernel kernel = k == 0 ? NV21_WARP_AFFINE_TRANSFORM : NV21_WARP_WARP_AFFINE;
+
+        uint64_t t0 = nv21_ring_now_ns();
+        for (int i = 0; i < iters; i++) {
+            if (kernel == NV21_WARP_WARP_AFFINE) {
+                warp_affine(src, ref, &param);
+            }
+            else {
+                affine_transform(ref, src, param);
+            }
+        }
+        uint64_t full_ns = nv21_ring_now_ns() - t0;
+
+        NV21LazyWarp warp;
+        t0 = nv21_ring_now_ns();
+        for (int i = 0; i < iters; i++) {
+            nv21_lazy_warp_init(&warp, dst, src, param, kernel);
+            nv21_lazy_warp_y(&warp);
+        }
+        uint64_t y_ns = nv21_ring_now_ns() - t0;
+
+        memset(dst->vu, 0, y_size / 2);
+        int same = memcmp(dst->y, ref->y, y_size) == 0 &&
+                   memcmp(nv21_lazy_warp_vu(&warp), ref->vu, y_size / 2) == 0;
+        printf("  %-16s all planes %8.1f us, luma only %8.1f us (chroma %.0f%%)  %s\n",
+               names[k],
+               full_ns / 1e3 / iters,
+               y_ns / 1e3 / iters,
+               full_ns > y_ns ? 100.0 * (full_ns - y_ns) / full_ns : 0.0,
+               same ? "identical" : "DIFFERS");
+        ok &= same;
     }
 
-    return cropped;
+    free_nv21(ref);
+    return ok ? 0 : -1;
 }
 
-// 镜像处理[6,8](@ref)
-void mirror_nv21(NV21Image* img)
+// 原来的逐字节镜像, 作为翻转结果的参照和速度基线
+static void mirror_scalar(NV21Image* img)
 {
-    // Y分量镜像
     for (int y = 0; y < img->height; y++) {
         uint8_t* row = img->y + y * img->width;
         for (int left = 0, right = img->width - 1; left < right; left++, right--) {
@@ -145,10 +330,8 @@ void mirror_nv21(NV21Image* img)
             row[right]  = tmp;
         }
     }
-
-    // UV分量镜像[8](@ref)
-    uint8_t* uv = img->vu;
     for (int y = 0; y < img->height / 2; y++) {
+        uint8_t* uv = img->vu + y * img->width;
         for (int left = 0, right = img->width - 2; left < right; left += 2, right -= 2) {
             uint8_t tmp_v = uv[left];
             uint8_t tmp_u = uv[left + 1];
@@ -157,151 +340,169 @@ void mirror_nv21(NV21Image* img)
             uv[right]     = tmp_v;
             uv[right + 1] = tmp_u;
         }
-        uv += img->width;
     }
 }
 
-uint8_t bilinear_interpolate_y(const NV21Image* src, float x, float y)
-{
-    int   x0 = (int)x, y0 = (int)y;
-    int   x1 = x0 + 1, y1 = y0 + 1;
-    float dx = x - x0, dy = y - y0;
-
-    x0 = CLAMP(x0, 0, src->width - 1);
-    y0 = CLAMP(y0, 0, src->height - 1);
-    x1 = CLAMP(x1, 0, src->width - 1);
-    y1 = CLAMP(y1, 0, src->height - 1);
-
-    uint8_t v00 = src->y[y0 * src->width + x0];
-    uint8_t v01 = src->y[y0 * src->width + x1];
-    uint8_t v10 = src->y[y1 * src->width + x0];
-    uint8_t v11 = src->y[y1 * src->width + x1];
-
-    return (uint8_t)(v00 * (1 - dx) * (1 - dy) + v01 * dx * (1 - dy) + v10 * (1 - dx) * dy +
-                     v11 * dx * dy);
-}
-
-
-void process_uv_component(uint8_t* dst_uv, const NV21Image* src, float x, float y)
-{
-    int src_x   = CLAMP((int)(x / 2 + 0.5f), 0, src->width / 2 - 1);
-    int src_y   = CLAMP((int)(y / 2 + 0.5f), 0, src->height / 2 - 1);
-    int src_idx = src_y * (src->width / 2) * 2 + src_x * 2;
-    dst_uv[0]   = src->vu[src_idx];       // V
-    dst_uv[1]   = src->vu[src_idx + 1];   // U
-}
-
-
-void affine_transform(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
+// 逐像素按定义核对翻转结果: 目标 (x, y) 取自源 (x', y')
+static int check_flip(const NV21Image* out, const NV21Image* in, int flip)
 {
-    memset(dst->y, 0, dst->width * dst->height);          // 初始化为黑色背景
-    memset(dst->vu, 128, dst->width * dst->height / 2);   // UV填充灰色
-
-    for (int y = 0; y < dst->height; y++) {
-        for (int x = 0; x < dst->width; x++) {
-            float src_x = mat.a * x + mat.b * y + mat.c;
-            float src_y = mat.d * x + mat.e * y + mat.f;
-
-            if (src_x >= 0 && src_x < src->width && src_y >= 0 && src_y < src->height) {
-                // Y分量处理
-                dst->y[y * dst->width + x] = bilinear_interpolate_y(src, src_x, src_y);
-
-                // UV分量处理（每2x2块）
-                if (x % 2 == 0 && y % 2 == 0) {
-                    int uv_idx = (y / 2) * (dst->width / 2) * 2 + (x / 2) * 2;
-                    process_uv_component(dst->vu + uv_idx, src, src_x, src_y);
-                }
-            }
+    int w = in->width, h = in->height;
+    for (int y = 0; y < h; y++) {
+        int sy = (flip & NV21_FLIP_VERTICAL) ? h - 1 - y : y;
+        for (int x = 0; x < w; x++) {
+            int sx = (flip & NV21_FLIP_HORIZONTAL) ? w - 1 - x : x;
+            if (out->y[y * w + x] != in->y[sy * w + sx]) return 0;
         }
     }
+    for (int y = 0; y < h / 2; y++) {
+        int sy = (flip & NV21_FLIP_VERTICAL) ? h / 2 - 1 - y : y;
+        for (int x = 0; x < w / 2; x++) {
+            int sx = (flip & NV21_FLIP_HORIZONTAL) ? w / 2 - 1 - x : x;
+            if (memcmp(out->vu + y * w + 2 * x, in->vu + sy * w + 2 * sx, 2) != 0) return 0;
+        }
+    }
+    return 1;
 }
 
-
-// 双线性插值
-uint8_t bilinear_interp(float x, float y, const uint8_t* img, int width, int height)
-{
-    int x0 = (int)floor(x);
-    int y0 = (int)floor(y);
-    int x1 = x0 + 1;
-    int y1 = y0 + 1;
-
-    // 边界处理
-    x0 = (x0 < 0) ? 0 : (x0 >= width ? width - 1 : x0);
-    y0 = (y0 < 0) ? 0 : (y0 >= height ? height - 1 : y0);
-    x1 = (x1 < 0) ? 0 : (x1 >= width ? width - 1 : x1);
-    y1 = (y1 < 0) ? 0 : (y1 >= height ? height - 1 : y1);
-
-    float dx = x - x0;
-    float dy = y - y0;
-
-    // 四个相邻像素值
-    uint8_t val00 = img[y0 * width + x0];
-    uint8_t val01 = img[y0 * width + x1];
-    uint8_t val10 = img[y1 * width + x0];
-    uint8_t val11 = img[y1 * width + x1];
-
-    // 插值计算
-    float val = (1 - dx) * (1 - dy) * val00 + dx * (1 - dy) * val01 + (1 - dx) * dy * val10 +
-                dx * dy * val11;
-
-    return (uint8_t)(val + 0.5f);
-}
-
-// YUV仿射变换核心函数
-void warp_affine(const NV21Image* src, NV21Image* dst, const AffineMatrix* mat)
+// 1080p 帧的原地翻转: 逐字节镜像、单线程 SIMD、flip_nv21(行带并行)与整帧 memcpy 对比
+static int bench_flips(int iters)
 {
-    // Y分量处理
-    for (int y = 0; y < dst->height; ++y) {
-        for (int x = 0; x < dst->width; ++x) {
-            // 反向映射
-            float src_x = mat->a * x + mat->b * y + mat->c;
-            float src_y = mat->d * x + mat->e * y + mat->f;
-
-            // 边界检查
-            if (src_x < 0 || src_x >= src->width || src_y < 0 || src_y >= src->height) {
-                dst->y[y * dst->width + x] = 0;
-                continue;
-            }
-
-            // 双线性插值
-            dst->y[y * dst->width + x] =
-                bilinear_interp(src_x, src_y, src->y, src->width, src->height);
-        }
+    const int  w    = 1920, h = 1080;
+    size_t     size = (size_t)w * h * 3 / 2;
+    NV21Image* in   = create_nv21(w, h);
+    NV21Image* img  = create_nv21(w, h);
+    uint8_t*   copy = (uint8_t*)malloc(size);
+    for (size_t i = 0; i < (size_t)w * h; i++) in->y[i] = (uint8_t)rand();
+    for (size_t i = 0; i < (size_t)w * h / 2; i++) in->vu[i] = (uint8_t)rand();
+
+    uint64_t t0 = nv21_ring_now_ns();
+    for (int i = 0; i < iters; i++) {
+        memcpy(copy, in->y, (size_t)w * h);
+        memcpy(copy + (size_t)w * h, in->vu, (size_t)w * h / 2);
     }
-
-    // UV分量处理（NV21格式）
-    for (int y = 0; y < dst->height / 2; ++y) {
-        for (int x = 0; x < dst->width; x += 2) {
-            float src_x = mat->a * (x * 2) + mat->b * (y * 2) + mat->c;
-            float src_y = mat->d * (x * 2) + mat->e * (y * 2) + mat->f;
-
-            // 计算UV坐标（NV21的UV分量是交错存储的）
-            int uv_x = (int)(src_x / 2);
-            int uv_y = (int)(src_y / 2);
-
-            // 边界检查
-            if (uv_x < 0 || uv_x >= src->width / 2 || uv_y < 0 || uv_y >= src->height / 2) {
-                dst->vu[y * dst->width + x]     = 128;   // 中性灰色
-                dst->vu[y * dst->width + x + 1] = 128;
-                continue;
-            }
-
-            // 直接采样（可改为插值）
-            int src_index                   = uv_y * src->width + 2 * uv_x;
-            dst->vu[y * dst->width + x]     = src->vu[src_index];       // V分量
-            dst->vu[y * dst->width + x + 1] = src->vu[src_index + 1];   // U分量
+    uint64_t memcpy_ns = nv21_ring_now_ns() - t0;
+
+    memcpy(img->y, in->y, (size_t)w * h);
+    memcpy(img->vu, in->vu, (size_t)w * h / 2);
+    t0 = nv21_ring_now_ns();
+    for (int i = 0; i < iters; i++) mirror_scalar(img);
+    uint64_t scalar_ns = nv21_ring_now_ns() - t0;
+
+    printf("flip %dx%d NV21, %d iteration(s):\n", w, h, iters);
+    printf("  memcpy (frame copy)         %8.1f us\n", memcpy_ns / 1e3 / iters);
+    printf("  byte-wise mirror            %8.1f us\n", scalar_ns / 1e3 / iters);
+
+    static const char* names[] = {"", "horizontal", "vertical", "both"};
+    int                ok      = 1;
+    for (int flip = NV21_FLIP_HORIZONTAL; flip <= NV21_FLIP_BOTH; flip++) {
+        int h_flip = flip & NV21_FLIP_HORIZONTAL, v_flip = flip & NV21_FLIP_VERTICAL;
+
+        // 迭代次数为偶数时图像回到原样, 奇数次后与一次翻转相同
+        memcpy(img->y, in->y, (size_t)w * h);
+        memcpy(img->vu, in->vu, (size_t)w * h / 2);
+        t0 = nv21_ring_now_ns();
+        for (int i = 0; i < iters; i++) {
+            flip_plane(img->y, w, h, w, 1, h_flip, v_flip);
+            flip_plane(img->vu, w / 2, h / 2, w, 2, h_flip, v_flip);
         }
+        uint64_t simd_ns   = nv21_ring_now_ns() - t0;
+        int      same_simd = check_flip(img, in, iters % 2 ? flip : 0);
+
+        memcpy(img->y, in->y, (size_t)w * h);
+        memcpy(img->vu, in->vu, (size_t)w * h / 2);
+        t0 = nv21_ring_now_ns();
+        for (int i = 0; i < iters; i++) flip_nv21(img, flip);
+        uint64_t pool_ns   = nv21_ring_now_ns() - t0;
+        int      same_pool = check_flip(img, in, iters % 2 ? flip : 0);
+
+        printf("  %-10s SIMD 1 thread %8.1f us  %s  (%.2fx memcpy)\n",
+               names[flip],
+               simd_ns / 1e3 / iters,
+               same_simd ? "correct" : "WRONG",
+               (double)simd_ns / memcpy_ns);
+        printf("  %-10s flip_nv21     %8.1f us  %s\n",
+               names[flip],
+               pool_ns / 1e3 / iters,
+               same_pool ? "correct" : "WRONG");
+        ok &= same_simd && same_pool;
     }
+
+    free(copy);
+    free_nv21(img);
+    free_nv21(in);
+    return ok ? 0 : -1;
 }
 
 // 示例主函数
-int main()
+// 用法: affine_sample_dpseek [--pyramid] [--dispatch] [--rotate=90|180|270] [--ring=<name>]
+//                            [--out-dir=<dir>] [--input=<file.nv21c> [--frame=N]]
+//                            [--slices=N [--readout-ms=T]] [--layout-bench[=N]]
+//                            [--flip-bench[=N]] [--lazy-check[=N]]
+//   --pyramid   按正向矩阵(与 nv21_affine.c / main_opencv.cpp 一致)求逆, 从金字塔最接近的层取样
+//   --dispatch  按矩阵类型分派到平移/缩放/直角旋转的专用实现
+//   --rotate    额外把整帧旋转后输出(走分派路径)
+//   --ring      从 nv21_ring_producer 创建的共享内存环形缓冲取帧, 代替读取文件
+//   --out-dir   与 --ring 一起使用, 把每一帧的裁剪结果写到该目录(异步批量写)
+//   --input     从 .nv21c 容器取第 --frame 帧(默认 0)作为输入, 尺寸取自容器, 代替固定的 640x480
+//   --slices    模拟卷帘读出(整帧读出耗时 --readout-ms, 默认 33.3), 源图分 N 段到达, 用分段变换
+//               边到达边输出, 报告目标行的输出时刻
+//   --layout-bench  对比通用 C 内核与按布局/固定尺寸特化的模板内核(默认 200 次), 并核对结果
+//   --flip-bench    1080p 帧原地水平/垂直/180 度翻转与 memcpy 对比(默认 200 次), 并核对结果
+//   --lazy-check    惰性变换只取 Y 与整帧变换的耗时对比(默认 200 次), 并核对 Y/VU 与整帧结果一致
+int main(int argc, char* argv[])
 {
     int ret = -1;
 
+    int         use_pyramid  = 0;
+    int         use_dispatch = 0;
+    int         rotate_deg   = 0;
+    const char* ring_name    = NULL;
+    const char* out_dir      = NULL;
+    const char* input_name   = NULL;
+    int64_t     frame_index  = 0;
+    int         slices       = 0;
+    double      readout_ms   = 33.3;
+    int         bench_iters  = 0;
+    int         flip_iters   = 0;
+    int         lazy_iters   = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pyramid") == 0) use_pyramid = 1;
+        if (strcmp(argv[i], "--dispatch") == 0) use_dispatch = 1;
+        if (strncmp(argv[i], "--rotate=", 9) == 0) rotate_deg = atoi(argv[i] + 9);
+        if (strncmp(argv[i], "--ring=", 7) == 0) ring_name = argv[i] + 7;
+        if (strncmp(argv[i], "--out-dir=", 10) == 0) out_dir = argv[i] + 10;
+        if (strncmp(argv[i], "--input=", 8) == 0) input_name = argv[i] + 8;
+        if (strncmp(argv[i], "--frame=", 8) == 0) frame_index = atoll(argv[i] + 8);
+        if (strncmp(argv[i], "--slices=", 9) == 0) slices = atoi(argv[i] + 9);
+        if (strncmp(argv[i], "--readout-ms=", 13) == 0) readout_ms = atof(argv[i] + 13);
+        if (strcmp(argv[i], "--layout-bench") == 0) bench_iters = 200;
+        if (strncmp(argv[i], "--layout-bench=", 15) == 0) bench_iters = atoi(argv[i] + 15);
+        if (strcmp(argv[i], "--flip-bench") == 0) flip_iters = 200;
+        if (strncmp(argv[i], "--flip-bench=", 13) == 0) flip_iters = atoi(argv[i] + 13);
+        if (strcmp(argv[i], "--lazy-check") == 0) lazy_iters = 200;
+        if (strncmp(argv[i], "--lazy-check=", 13) == 0) lazy_iters = atoi(argv[i] + 13);
+    }
+    if (flip_iters > 0) return bench_flips(flip_iters) == 0 ? 0 : -1;
+
     int src_width  = 640;
     int src_height = 480;
 
+    // 容器中的帧直接按索引定位, 尺寸记录在索引里
+    Nv21Container*     container = NULL;
+    Nv21ContainerFrame input_frame;
+    const uint8_t*     input_data = NULL;
+    if (input_name) {
+        container = nv21_container_open(input_name);
+        if (container) input_data = nv21_container_frame(container, frame_index, &input_frame);
+        if (!input_data || input_frame.fourcc != NV21_CONTAINER_FOURCC_NV21) {
+            printf("read frame %lld of %s failed\n", (long long)frame_index, input_name);
+            nv21_container_close(container);
+            return -1;
+        }
+        src_width  = (int)input_frame.width;
+        src_height = (int)input_frame.height;
+    }
+
     int dst_width  = 640;
     int dst_height = 480;
 
@@ -311,6 +512,9 @@ int main()
     NV21Image* src = create_nv21(src_width, src_height);
     NV21Image* dst = create_nv21(dst_crop_width, dst_crop_height);
 
+    // 所有输出文件都经由 writer 写出, 退出前 async_writer_destroy 等待写完
+    AsyncWriter* writer = async_writer_create(0, 0);
+
     char inputFile[] = "../data/examples_from_paper/prn_example_face";
     char outputFile[] = "../data/examples_from_paper/c_prn_example_face";
     char outputCropFile[] = "../data/examples_from_paper/c_prn_example_face_crop";
@@ -341,13 +545,34 @@ int main()
             dst_crop_width,
             dst_crop_height);
 
-    ret = read_nv21_file(src, input_path);
-    if (ret != 0) {
-        return ret;
+    AffineMatrix param = {0.55722648, 0.12144679, -73.8135971, -0.12144679, 0.55722648, 3.02248176};
+
+    if (ring_name) {
+        nv21_container_close(container);
+        ret = consume_ring(ring_name, dst, param, use_dispatch, writer, out_dir, out_crop_path);
+        goto free_src_dst;
     }
 
+    if (container) {
+        memcpy(src->y, input_data, (size_t)src->width * src->height);
+        memcpy(src->vu,
+               input_data + (size_t)src->width * src->height,
+               (size_t)src->width * src->height / 2);
+        nv21_container_close(container);
+        printf("read frame %lld of %s: %dx%d\n",
+               (long long)frame_index,
+               input_name,
+               src->width,
+               src->height);
+        ret = 0;
+    }
+    else {
+        ret = read_nv21_file(src, input_path);
+    }
+    if (ret != 0) {
+        goto free_src_dst;
+    }
 
-    AffineMatrix param = {0.55722648, 0.12144679, -73.8135971, -0.12144679, 0.55722648, 3.02248176};
 
     // AffineMatrix param = {0.881481,   0.000000,    -36.529630,  -0.000000,   0.881481,   -9.288889};
 
@@ -385,12 +610,73 @@ int main()
     //     -0.12144679, 0.55722648, 3.02248176};
 
     // 执行仿射变换
-    affine_transform(dst, src, param);
+    if (bench_iters > 0) {
+        if (bench_layouts(dst, src, param, bench_iters) != 0) {
+            ret = -1;
+            goto free_src_dst;
+        }
+    }
+    else if (lazy_iters > 0) {
+        if (check_lazy(dst, src, param, lazy_iters) != 0) {
+            ret = -1;
+            goto free_src_dst;
+        }
+    }
+    else if (slices > 0) {
+        if (run_slices(dst, src, param, slices, readout_ms) != 0) {
+            ret = -1;
+            goto free_src_dst;
+        }
+    }
+    else if (use_pyramid) {
+        AffineMatrix inv;
+        if (!invert_affine_matrix(&param, &inv)) {
+            goto free_src_dst;
+        }
+
+        // 金字塔每帧只建一次, 同一帧的多个裁剪都复用它
+        NV21Pyramid* pyr = create_nv21_pyramid(src->width, src->height, NV21_PYRAMID_MAX_LEVELS);
+        if (!pyr) {
+            printf("金字塔内存分配失败！\n");
+            goto free_src_dst;
+        }
+        build_nv21_pyramid(pyr, src);
+        printf("pyramid levels: %d, selected level: %d\n",
+               pyr->num_levels,
+               select_pyramid_level(pyr, inv));
+        affine_transform_pyramid(dst, pyr, inv);
+        free_nv21_pyramid(pyr);
+    }
+    else if (use_dispatch) {
+        printf("affine kind: %s\n", affine_kind_name(affine_transform_dispatch(dst, src, param)));
+    }
+    else {
+        affine_transform(dst, src, param);
+    }
+
+    if (rotate_deg == 90 || rotate_deg == 180 || rotate_deg == 270) {
+        // 反向映射: 目标坐标旋转 rotate_deg 度后平移回源图范围内
+        int        rot_w = rotate_deg == 180 ? src->width : src->height;
+        int        rot_h = rotate_deg == 180 ? src->height : src->width;
+        NV21Image* rot   = create_nv21(rot_w, rot_h);
+
+        AffineMatrix mat = create_rotation_matrix((float)rotate_deg);
+        mat.c            = rotate_deg == 270 ? 0 : src->width - 1;
+        mat.f            = rotate_deg == 90 ? 0 : src->height - 1;
+
+        AffineKind kind = affine_transform_dispatch(rot, src, mat);
+        printf("rotate %d: %s\n", rotate_deg, affine_kind_name(kind));
+
+        char rot_path[1204];
+        sprintf(rot_path, "%s_rot%d_%dx%d.nv21", outputFile, rotate_deg, rot_w, rot_h);
+        write_nv21_file_async(writer, rot, rot_path);
+        free_nv21(rot);
+    }
     // warp_affine(src, dst, &combined);
 
    int offset_left = tanf(angle) * dst_crop_height;
 
-    ret = write_nv21_file(dst, out_crop_path);
+    ret = write_nv21_file_async(writer, dst, out_crop_path);
 
     // 执行裁剪（左上角(100,50)，尺寸400x300）
     // NV21Image* dst2_cropped = NULL;
@@ -409,6 +695,7 @@ exit:
     // free_nv21(dst2_cropped);
 
 free_src_dst:
+    async_writer_destroy(writer);
     free_nv21(src);
     free_nv21(dst);
 
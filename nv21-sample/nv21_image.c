@@ -0,0 +1,491 @@
+#include "nv21_image.h"
+#include "nv21_simd.h"
+#include "perf_regions.h"
+#include "thread_pool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 分配失败返回 NULL
+NV21Image* create_nv21(int w, int h)
+{
+    NV21Image* img = malloc(sizeof(NV21Image));
+    if (!img) return NULL;
+    img->y      = malloc((size_t)w * h);
+    img->vu     = malloc((size_t)w * h / 2);
+    img->width  = w;
+    img->height = h;
+    if (!img->y || !img->vu) {
+        free_nv21(img);
+        return NULL;
+    }
+    return img;
+}
+
+void free_nv21(NV21Image* img)
+{
+    free(img->y);
+    free(img->vu);
+    free(img);
+}
+
+int read_nv21_file(NV21Image* img, const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (fp != NULL) {
+        fread(img->y, img->width * img->height, 1, fp);
+        fread(img->vu, img->width * img->height / 2, 1, fp);
+        fclose(fp);
+        printf("read nv21file: %s  \n", filename);
+        return 0;
+    }
+    return -1;
+}
+
+int write_nv21_file(NV21Image* img, const char* filename)
+{
+    FILE* fp = fopen(filename, "wb");
+    if (fp) {
+        fwrite(img->y, img->width * img->height, 1, fp);
+        fwrite(img->vu, img->width * img->height / 2, 1, fp);
+        fclose(fp);
+        printf("write nv21file: %s  \n", filename);
+        return 0;
+    }
+    return -1;
+}
+
+int write_nv21_file_async(AsyncWriter* writer, const NV21Image* img, const char* filename)
+{
+    size_t y_size = (size_t)img->width * img->height;
+    return async_writer_submit_copy2(writer, filename, img->y, y_size, img->vu, y_size / 2);
+}
+
+AffineMatrix matrix_multiply(AffineMatrix m1, AffineMatrix m2)
+{
+    return (AffineMatrix){.a = m1.a * m2.a + m1.b * m2.d,
+                          .b = m1.a * m2.b + m1.b * m2.e,
+                          .c = m1.a * m2.c + m1.b * m2.f + m1.c,
+                          .d = m1.d * m2.a + m1.e * m2.d,
+                          .e = m1.d * m2.b + m1.e * m2.e,
+                          .f = m1.d * m2.c + m1.e * m2.f + m1.f};
+}
+
+// 计算仿射矩阵的逆, 不可逆时返回 0
+int invert_affine_matrix(const AffineMatrix* mat, AffineMatrix* inv)
+{
+    float det = mat->a * mat->e - mat->b * mat->d;
+    if (fabsf(det) < 1e-6f) return 0;
+
+    float inv_det = 1.0f / det;
+
+    inv->a = mat->e * inv_det;
+    inv->b = -mat->b * inv_det;
+    inv->c = (mat->b * mat->f - mat->c * mat->e) * inv_det;
+    inv->d = -mat->d * inv_det;
+    inv->e = mat->a * inv_det;
+    inv->f = (mat->c * mat->d - mat->a * mat->f) * inv_det;
+    return 1;
+}
+
+AffineMatrix create_rotation_matrix(float theta)
+{
+    float rad = theta * M_PI / 180.0f;
+    return (AffineMatrix){cos(rad), -sin(rad), 0, sin(rad), cos(rad), 0};
+}
+
+AffineMatrix create_translation_matrix(float tx, float ty)
+{
+    return (AffineMatrix){1, 0, tx, 0, 1, ty};
+}
+
+AffineMatrix create_scale_matrix(float sx, float sy)
+{
+    return (AffineMatrix){sx, 0, 0, 0, sy, 0};
+}
+
+AffineMatrix create_centered_scale(float sx, float sy, int w, int h)
+{
+    AffineMatrix move_back  = create_translation_matrix(-w / 2, -h / 2);
+    AffineMatrix scale      = create_scale_matrix(sx, sy);
+    AffineMatrix move_front = create_translation_matrix(w / 2, h / 2);
+    return matrix_multiply(move_front, matrix_multiply(scale, move_back));
+}
+
+typedef struct
+{
+    NV21Image*       dst;
+    const NV21Image* src;
+    int              left;
+    int              top;
+} CropBand;
+
+// 裁剪 [row_begin, row_end) 行及对应的 VU 行, 行带起点为偶数
+static void crop_rows(void* arg, int row_begin, int row_end)
+{
+    const CropBand*  band = (const CropBand*)arg;
+    NV21Image*       dst  = band->dst;
+    const NV21Image* src  = band->src;
+
+    // 裁剪 Y 平面
+    for (int row = row_begin; row < row_end; row++) {
+        memcpy(dst->y + row * dst->width,
+               src->y + (band->top + row) * src->width + band->left,
+               dst->width);
+    }
+
+    // 裁剪 VU 平面
+    for (int row = row_begin / 2; row < row_end / 2; row++) {
+        memcpy(dst->vu + row * dst->width,
+               src->vu + ((band->top / 2) + row) * src->width + band->left,
+               dst->width);
+    }
+}
+
+// 裁剪 NV21 图像
+NV21Image* crop_nv21(const NV21Image* src, int left, int top, int crop_w, int crop_h)
+{
+    // 检查裁剪范围是否合法
+    if (left < 0 || top < 0 || left + crop_w > src->width || top + crop_h > src->height) {
+        printf("裁剪范围超出源图像范围！\n");
+        return NULL;
+    }
+
+    // 强制坐标和尺寸为偶数（关键步骤）
+    left   = (left / 2) * 2;
+    top    = (top / 2) * 2;
+    crop_w = (crop_w / 2) * 2;
+    crop_h = (crop_h / 2) * 2;
+
+    // 分配新的 NV21 图像结构
+    NV21Image* cropped = create_nv21(crop_w, crop_h);
+
+    if (!cropped) {
+        printf("裁剪图像内存分配失败！\n");
+        return NULL;
+    }
+
+    PERF_SCOPE_BEGIN(scope, "crop_nv21");
+
+    CropBand band = {cropped, src, left, top};
+    thread_pool_parallel_for(NULL, 0, crop_h, NV21_BAND_ROWS, crop_rows, &band);
+
+    PERF_SCOPE_END(scope);
+    return cropped;
+}
+
+typedef struct
+{
+    uint8_t* data;
+    int      rows;
+    int      stride;
+    int      n;      // 每行元素个数
+    int      elem;   // 元素字节数
+    int      flip;
+} FlipBand;
+
+// 垂直翻转时 [begin, end) 是上半部分的行号, 与下半部分对称的行成对处理
+static void flip_rows(void* arg, int begin, int end)
+{
+    const FlipBand* band     = (const FlipBand*)arg;
+    int             vertical = band->flip & NV21_FLIP_VERTICAL;
+
+    for (int row = begin; row < end; row++) {
+        flip_row_pair(band->data + (size_t)row * band->stride,
+                      band->data + (size_t)(vertical ? band->rows - 1 - row : row) * band->stride,
+                      band->n,
+                      band->elem,
+                      band->flip & NV21_FLIP_HORIZONTAL,
+                      vertical);
+    }
+}
+
+static void flip_plane_parallel(uint8_t* data, int rows, int stride, int n, int elem, int flip)
+{
+    FlipBand band = {data, rows, stride, n, elem, flip};
+    int      end  = (flip & NV21_FLIP_VERTICAL) ? (rows + 1) / 2 : rows;
+    thread_pool_parallel_for(NULL, 0, end, NV21_BAND_ROWS, flip_rows, &band);
+}
+
+void flip_nv21(NV21Image* img, int flip)
+{
+    if (!(flip & NV21_FLIP_BOTH)) return;
+    PERF_SCOPE_BEGIN(scope,
+                     flip == NV21_FLIP_HORIZONTAL ? "mirror_nv21"
+                     : flip == NV21_FLIP_VERTICAL ? "flip_nv21_vertical"
+                                                  : "flip_nv21_both");
+    flip_plane_parallel(img->y, img->height, img->width, img->width, 1, flip);
+    // VU 行跨度与 Y 相同, 每行 width / 2 个 VU 对
+    flip_plane_parallel(img->vu, img->height / 2, img->width, img->width / 2, 2, flip);
+    PERF_SCOPE_END(scope);
+}
+
+// 镜像处理[6,8](@ref)
+void mirror_nv21(NV21Image* img)
+{
+    flip_nv21(img, NV21_FLIP_HORIZONTAL);
+}
+
+uint8_t bilinear_interpolate_y(const NV21Image* src, float x, float y)
+{
+    int   x0 = (int)x, y0 = (int)y;
+    int   x1 = x0 + 1, y1 = y0 + 1;
+    float dx = x - x0, dy = y - y0;
+
+    x0 = CLAMP(x0, 0, src->width - 1);
+    y0 = CLAMP(y0, 0, src->height - 1);
+    x1 = CLAMP(x1, 0, src->width - 1);
+    y1 = CLAMP(y1, 0, src->height - 1);
+
+    uint8_t v00 = src->y[y0 * src->width + x0];
+    uint8_t v01 = src->y[y0 * src->width + x1];
+    uint8_t v10 = src->y[y1 * src->width + x0];
+    uint8_t v11 = src->y[y1 * src->width + x1];
+
+    return (uint8_t)(v00 * (1 - dx) * (1 - dy) + v01 * dx * (1 - dy) + v10 * (1 - dx) * dy +
+                     v11 * dx * dy);
+}
+
+
+void process_uv_component(uint8_t* dst_uv, const NV21Image* src, float x, float y)
+{
+    int src_x   = CLAMP((int)(x / 2 + 0.5f), 0, src->width / 2 - 1);
+    int src_y   = CLAMP((int)(y / 2 + 0.5f), 0, src->height / 2 - 1);
+    int src_idx = src_y * (src->width / 2) * 2 + src_x * 2;
+    dst_uv[0]   = src->vu[src_idx];       // V
+    dst_uv[1]   = src->vu[src_idx + 1];   // U
+}
+
+
+typedef struct
+{
+    NV21Image*       dst;
+    const NV21Image* src;
+    AffineMatrix     mat;
+    int              planes;   // NV21_PLANE_* 位
+} WarpBand;
+
+static void affine_transform_rows(void* arg, int y_begin, int y_end)
+{
+    const WarpBand*    band    = (const WarpBand*)arg;
+    NV21Image*         dst     = band->dst;
+    const NV21Image*   src     = band->src;
+    const AffineMatrix mat     = band->mat;
+    int                with_y  = band->planes & NV21_PLANE_Y;
+    int                with_vu = band->planes & NV21_PLANE_VU;
+
+    // 只要色度时只访问偶数行的偶数列
+    for (int y = y_begin; y < y_end; y++) {
+        int vu_row = with_vu && y % 2 == 0;
+        if (!with_y && !vu_row) continue;
+        for (int x = 0; x < dst->width; x += with_y ? 1 : 2) {
+            float src_x = mat.a * x + mat.b * y + mat.c;
+            float src_y = mat.d * x + mat.e * y + mat.f;
+
+            if (src_x >= 0 && src_x < src->width && src_y >= 0 && src_y < src->height) {
+                // Y分量处理
+                if (with_y) dst->y[y * dst->width + x] = bilinear_interpolate_y(src, src_x, src_y);
+
+                // UV分量处理（每2x2块）
+                if (vu_row && x % 2 == 0) {
+                    int uv_idx = (y / 2) * (dst->width / 2) * 2 + (x / 2) * 2;
+                    process_uv_component(dst->vu + uv_idx, src, src_x, src_y);
+                }
+            }
+        }
+    }
+}
+
+static void affine_transform_range_planes(NV21Image* dst, const NV21Image* src, AffineMatrix mat,
+                                          int y_begin, int y_end, int planes)
+{
+    int vu_begin = y_begin / 2;
+    int vu_end   = (y_end + 1) / 2;
+    if (planes & NV21_PLANE_Y) {
+        memset(dst->y + (size_t)y_begin * dst->width, 0, (size_t)(y_end - y_begin) * dst->width);
+    }
+    if (planes & NV21_PLANE_VU) {
+        memset(dst->vu + (size_t)vu_begin * dst->width,
+               128,
+               (size_t)(vu_end - vu_begin) * dst->width);
+    }
+
+    // 按行带并行, 色度只在偶数行写, 行带起点为偶数, 各行带输出互不重叠
+    WarpBand band = {dst, src, mat, planes};
+    thread_pool_parallel_for(NULL, y_begin, y_end, NV21_BAND_ROWS, affine_transform_rows, &band);
+}
+
+void affine_transform_range(NV21Image* dst, const NV21Image* src, AffineMatrix mat, int y_begin,
+                            int y_end)
+{
+    affine_transform_range_planes(dst, src, mat, y_begin, y_end, NV21_PLANE_ALL);
+}
+
+void affine_transform_planes(NV21Image* dst, const NV21Image* src, AffineMatrix mat, int planes)
+{
+    PERF_SCOPE_BEGIN(scope,
+                     planes == NV21_PLANE_ALL ? "affine_transform"
+                     : planes == NV21_PLANE_Y ? "affine_transform_y"
+                                              : "affine_transform_vu");
+    // 背景: Y 黑色, UV 灰色
+    affine_transform_range_planes(dst, src, mat, 0, dst->height, planes);
+    PERF_SCOPE_END(scope);
+}
+
+void affine_transform(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
+{
+    affine_transform_planes(dst, src, mat, NV21_PLANE_ALL);
+}
+
+
+// 双线性插值
+uint8_t bilinear_interp(float x, float y, const uint8_t* img, int width, int height)
+{
+    int x0 = (int)floor(x);
+    int y0 = (int)floor(y);
+    int x1 = x0 + 1;
+    int y1 = y0 + 1;
+
+    // 边界处理
+    x0 = (x0 < 0) ? 0 : (x0 >= width ? width - 1 : x0);
+    y0 = (y0 < 0) ? 0 : (y0 >= height ? height - 1 : y0);
+    x1 = (x1 < 0) ? 0 : (x1 >= width ? width - 1 : x1);
+    y1 = (y1 < 0) ? 0 : (y1 >= height ? height - 1 : y1);
+
+    float dx = x - x0;
+    float dy = y - y0;
+
+    // 四个相邻像素值
+    uint8_t val00 = img[y0 * width + x0];
+    uint8_t val01 = img[y0 * width + x1];
+    uint8_t val10 = img[y1 * width + x0];
+    uint8_t val11 = img[y1 * width + x1];
+
+    // 插值计算
+    float val = (1 - dx) * (1 - dy) * val00 + dx * (1 - dy) * val01 + (1 - dx) * dy * val10 +
+                dx * dy * val11;
+
+    return (uint8_t)(val + 0.5f);
+}
+
+static void warp_affine_y_rows(void* arg, int y_begin, int y_end)
+{
+    const WarpBand*     band = (const WarpBand*)arg;
+    NV21Image*          dst  = band->dst;
+    const NV21Image*    src  = band->src;
+    const AffineMatrix* mat  = &band->mat;
+
+    // Y分量处理
+    for (int y = y_begin; y < y_end; ++y) {
+        for (int x = 0; x < dst->width; ++x) {
+            // 反向映射
+            float src_x = mat->a * x + mat->b * y + mat->c;
+            float src_y = mat->d * x + mat->e * y + mat->f;
+
+            // 边界检查
+            if (src_x < 0 || src_x >= src->width || src_y < 0 || src_y >= src->height) {
+                dst->y[y * dst->width + x] = 0;
+                continue;
+            }
+
+            // 双线性插值
+            dst->y[y * dst->width + x] =
+                bilinear_interp(src_x, src_y, src->y, src->width, src->height);
+        }
+    }
+
+}
+
+static void warp_affine_vu_rows(void* arg, int y_begin, int y_end)
+{
+    const WarpBand*     band = (const WarpBand*)arg;
+    NV21Image*          dst  = band->dst;
+    const NV21Image*    src  = band->src;
+    const AffineMatrix* mat  = &band->mat;
+
+    // UV分量处理（NV21格式）
+    for (int y = y_begin; y < y_end; ++y) {
+        for (int x = 0; x < dst->width; x += 2) {
+            float src_x = mat->a * (x * 2) + mat->b * (y * 2) + mat->c;
+            float src_y = mat->d * (x * 2) + mat->e * (y * 2) + mat->f;
+
+            // 计算UV坐标（NV21的UV分量是交错存储的）
+            int uv_x = (int)(src_x / 2);
+            int uv_y = (int)(src_y / 2);
+
+            // 边界检查
+            if (uv_x < 0 || uv_x >= src->width / 2 || uv_y < 0 || uv_y >= src->height / 2) {
+                dst->vu[y * dst->width + x]     = 128;   // 中性灰色
+                dst->vu[y * dst->width + x + 1] = 128;
+                continue;
+            }
+
+            // 直接采样（可改为插值）
+            int src_index                   = uv_y * src->width + 2 * uv_x;
+            dst->vu[y * dst->width + x]     = src->vu[src_index];       // V分量
+            dst->vu[y * dst->width + x + 1] = src->vu[src_index + 1];   // U分量
+        }
+    }
+}
+
+// YUV仿射变换核心函数
+void warp_affine(const NV21Image* src, NV21Image* dst, const AffineMatrix* mat)
+{
+    warp_affine_planes(src, dst, mat, NV21_PLANE_ALL);
+}
+
+void warp_affine_planes(const NV21Image* src, NV21Image* dst, const AffineMatrix* mat, int planes)
+{
+    PERF_SCOPE_BEGIN(scope,
+                     planes == NV21_PLANE_ALL ? "warp_affine"
+                     : planes == NV21_PLANE_Y ? "warp_affine_y"
+                                              : "warp_affine_vu");
+
+    WarpBand band = {dst, src, *mat, planes};
+    if (planes & NV21_PLANE_Y) {
+        thread_pool_parallel_for(NULL, 0, dst->height, NV21_BAND_ROWS, warp_affine_y_rows, &band);
+    }
+    if (planes & NV21_PLANE_VU) {
+        thread_pool_parallel_for(
+            NULL, 0, dst->height / 2, NV21_BAND_ROWS / 2, warp_affine_vu_rows, &band);
+    }
+
+    PERF_SCOPE_END(scope);
+}
+
+void nv21_lazy_warp_init(NV21LazyWarp* warp, NV21Image* dst, const NV21Image* src, AffineMatrix mat,
+                         NV21WarpKernel kernel)
+{
+    warp->dst    = dst;
+    warp->src    = src;
+    warp->mat    = mat;
+    warp->kernel = kernel;
+    warp->ready  = 0;
+}
+
+const NV21Image* nv21_lazy_warp_planes(NV21LazyWarp* warp, int planes)
+{
+    int missing = planes & NV21_PLANE_ALL & ~warp->ready;
+    if (missing) {
+        if (warp->kernel == NV21_WARP_WARP_AFFINE) {
+            warp_affine_planes(warp->src, warp->dst, &warp->mat, missing);
+        }
+        else {
+            affine_transform_planes(warp->dst, warp->src, warp->mat, missing);
+        }
+        warp->ready |= missing;
+    }
+    return warp->dst;
+}
+
+const uint8_t* nv21_lazy_warp_y(NV21LazyWarp* warp)
+{
+    return nv21_lazy_warp_planes(warp, NV21_PLANE_Y)->y;
+}
+
+const uint8_t* nv21_lazy_warp_vu(NV21LazyWarp* warp)
+{
+    return nv21_lazy_warp_planes(warp, NV21_PLANE_VU)->vu;
+}
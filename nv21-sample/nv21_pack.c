@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nv21_container.h"
+
+// 把裸 .nv21 文件打包成带索引的 .nv21c 容器, 或列出容器中的帧
+// 用法:
+//   nv21_pack <out.nv21c> <width>x<height> a.nv21 [b.nv21 ...] [<width>x<height> c.nv21 ...]
+//     裸文件可以包含多帧(连续存放), 按顺序逐帧追加. 第一个尺寸是容器的默认尺寸,
+//     之后出现的尺寸参数作用于它后面的文件, 所以一个容器里可以混合不同尺寸
+//   nv21_pack --list <in.nv21c>
+static void usage(const char* prog)
+{
+    printf("usage: %s <out.nv21c> <width>x<height> file.nv21 ... "
+           "[<width>x<height> file.nv21 ...]\n"
+           "       %s --list <in.nv21c>\n",
+           prog,
+           prog);
+}
+
+// "640x480" 形式的整个参数才算尺寸
+static int parse_size(const char* arg, int* width, int* height)
+{
+    int end = 0;
+    return sscanf(arg, "%dx%d%n", width, height, &end) == 2 && arg[end] == '\0' && *width > 0 &&
+           *height > 0;
+}
+
+static int list_container(const char* path)
+{
+    Nv21Container* container = nv21_container_open(path);
+    if (!container) {
+        printf("open %s failed (not a %s container?)\n", path, NV21_CONTAINER_EXT);
+        return -1;
+    }
+
+    int64_t count = nv21_container_frame_count(container);
+    printf("%s: %lld frame(s), default %dx%d\n",
+           path,
+           (long long)count,
+           nv21_container_width(container),
+           nv21_container_height(container));
+    for (int64_t i = 0; i < count; i++) {
+        Nv21ContainerFrame frame;
+        if (!nv21_container_frame(container, i, &frame)) {
+            printf("  #%lld: out of range\n", (long long)i);
+            continue;
+        }
+        printf("  #%lld: %ux%u  offset %llu  size %llu  ts %llu\n",
+               (long long)i,
+               frame.width,
+               frame.height,
+               (unsigned long long)frame.offset,
+               (unsigned long long)frame.size,
+               (unsigned long long)frame.timestamp_ns);
+    }
+    nv21_container_close(container);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--list") == 0) {
+        return list_container(argv[2]);
+    }
+    if (argc < 4) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    int width  = 0;
+    int height = 0;
+    if (!parse_size(argv[2], &width, &height)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    Nv21ContainerWriter* writer = nv21_container_create(argv[1], width, height);
+    if (!writer) {
+        printf("create %s %dx%d failed\n", argv[1], width, height);
+        return -1;
+    }
+
+    uint8_t* frame  = NULL;
+    long     frames = 0;
+    for (int i = 3; i < argc; i++) {
+        if (parse_size(argv[i], &width, &height)) continue;
+
+        FILE* fp = fopen(argv[i], "rb");
+        if (!fp) {
+            printf("open %s failed\n", argv[i]);
+            continue;
+        }
+        size_t y_size = (size_t)width * height;
+        frame         = (uint8_t*)realloc(frame, y_size * 3 / 2);
+        while (fread(frame, 1, y_size * 3 / 2, fp) == y_size * 3 / 2) {
+            if (nv21_container_append(writer, frame, frame + y_size, width, height, 0) < 0) break;
+            frames++;
+        }
+        fclose(fp);
+    }
+    free(frame);
+
+    int ret = nv21_container_finish(writer);
+    printf("packed %ld frame(s) into %s\n", frames, argv[1]);
+    return ret;
+}
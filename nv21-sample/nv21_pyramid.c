@@ -0,0 +1,124 @@
+#include "nv21_pyramid.h"
+#include "perf_regions.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+NV21Pyramid* create_nv21_pyramid(int width, int height, int max_levels)
+{
+    NV21Pyramid* pyr = calloc(1, sizeof(NV21Pyramid));
+    if (!pyr) return NULL;
+
+    if (max_levels > NV21_PYRAMID_MAX_LEVELS) max_levels = NV21_PYRAMID_MAX_LEVELS;
+    if (max_levels < 1) max_levels = 1;
+
+    pyr->width      = width;
+    pyr->height     = height;
+    pyr->num_levels = 1;
+
+    int w = width, h = height;
+    for (int level = 1; level < max_levels; level++) {
+        // 保持偶数尺寸, 色度平面才能按 2x2 对齐
+        w = (w / 2) & ~1;
+        h = (h / 2) & ~1;
+        if (w < NV21_PYRAMID_MIN_SIZE || h < NV21_PYRAMID_MIN_SIZE) break;
+
+        pyr->levels[level] = create_nv21(w, h);
+        if (!pyr->levels[level]) {
+            // 释放已建好的层
+            free_nv21_pyramid(pyr);
+            return NULL;
+        }
+        pyr->num_levels++;
+    }
+    return pyr;
+}
+
+void free_nv21_pyramid(NV21Pyramid* pyr)
+{
+    if (!pyr) return;
+    for (int level = 1; level < pyr->num_levels; level++) {
+        free_nv21(pyr->levels[level]);
+    }
+    free(pyr);
+}
+
+// 2x2 盒式滤波下采样一层
+static void downsample_nv21(NV21Image* dst, const NV21Image* src)
+{
+    // Y 分量
+    for (int y = 0; y < dst->height; y++) {
+        const uint8_t* s0 = src->y + (2 * y) * src->width;
+        const uint8_t* s1 = s0 + src->width;
+        uint8_t*       d  = dst->y + y * dst->width;
+        for (int x = 0; x < dst->width; x++) {
+            d[x] = (uint8_t)((s0[2 * x] + s0[2 * x + 1] + s1[2 * x] + s1[2 * x + 1] + 2) >> 2);
+        }
+    }
+
+    // VU 分量, 按 VU 对分别平均
+    for (int y = 0; y < dst->height / 2; y++) {
+        const uint8_t* s0 = src->vu + (2 * y) * src->width;
+        const uint8_t* s1 = s0 + src->width;
+        uint8_t*       d  = dst->vu + y * dst->width;
+        for (int x = 0; x < dst->width; x += 2) {
+            int sx   = 2 * x;
+            d[x]     = (uint8_t)((s0[sx] + s0[sx + 2] + s1[sx] + s1[sx + 2] + 2) >> 2);
+            d[x + 1] = (uint8_t)((s0[sx + 1] + s0[sx + 3] + s1[sx + 1] + s1[sx + 3] + 2) >> 2);
+        }
+    }
+}
+
+int build_nv21_pyramid(NV21Pyramid* pyr, const NV21Image* src)
+{
+    if (src->width != pyr->width || src->height != pyr->height) {
+        printf("pyramid size %dx%d != frame size %dx%d\n",
+               pyr->width,
+               pyr->height,
+               src->width,
+               src->height);
+        return -1;
+    }
+
+    PERF_SCOPE_BEGIN(scope, "build_nv21_pyramid");
+
+    pyr->base = src;
+    for (int level = 1; level < pyr->num_levels; level++) {
+        downsample_nv21(pyr->levels[level], nv21_pyramid_level(pyr, level - 1));
+    }
+
+    PERF_SCOPE_END(scope);
+    return 0;
+}
+
+const NV21Image* nv21_pyramid_level(const NV21Pyramid* pyr, int level)
+{
+    return level == 0 ? pyr->base : pyr->levels[level];
+}
+
+int select_pyramid_level(const NV21Pyramid* pyr, AffineMatrix mat)
+{
+    // 每个目标像素覆盖的源像素边长
+    float scale = sqrtf(fabsf(mat.a * mat.e - mat.b * mat.d));
+    if (scale <= 1.0f) return 0;
+
+    int level = (int)floorf(log2f(scale) + 0.5f);
+    return CLAMP(level, 0, pyr->num_levels - 1);
+}
+
+void affine_transform_pyramid(NV21Image* dst, const NV21Pyramid* pyr, AffineMatrix mat)
+{
+    int level = select_pyramid_level(pyr, mat);
+    if (level > 0) {
+        // 第 level 层坐标: x_l = (x_0 + 0.5) / 2^level - 0.5
+        float s = (float)(1 << level);
+        mat.a /= s;
+        mat.b /= s;
+        mat.c = (mat.c + 0.5f) / s - 0.5f;
+        mat.d /= s;
+        mat.e /= s;
+        mat.f = (mat.f + 0.5f) / s - 0.5f;
+    }
+    affine_transform(dst, nv21_pyramid_level(pyr, level), mat);
+}
@@ -0,0 +1,42 @@
+#ifndef NV21_PYRAMID_H
+#define NV21_PYRAMID_H
+
+#include "nv21_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NV21_PYRAMID_MAX_LEVELS 8
+#define NV21_PYRAMID_MIN_SIZE   16   // 短边小于该值时不再继续下采样
+
+// NV21 图像金字塔: 第 0 层为原图(不拥有), 之后每层 2x2 盒式滤波下采样一次.
+// 缓冲区在创建时按尺寸一次分配, 之后每帧调用 build_nv21_pyramid 复用.
+typedef struct
+{
+    const NV21Image* base;
+    NV21Image*       levels[NV21_PYRAMID_MAX_LEVELS];   // levels[0] 不使用
+    int              num_levels;
+    int              width;
+    int              height;
+} NV21Pyramid;
+
+NV21Pyramid* create_nv21_pyramid(int width, int height, int max_levels);
+void         free_nv21_pyramid(NV21Pyramid* pyr);
+
+// 每帧调用一次, src 尺寸必须与创建时一致
+int build_nv21_pyramid(NV21Pyramid* pyr, const NV21Image* src);
+
+const NV21Image* nv21_pyramid_level(const NV21Pyramid* pyr, int level);
+
+// 按矩阵(反向映射)的缩放量选择最接近的层
+int select_pyramid_level(const NV21Pyramid* pyr, AffineMatrix mat);
+
+// 与 affine_transform 相同的反向映射语义, 但从最接近缩放量的金字塔层取样
+void affine_transform_pyramid(NV21Image* dst, const NV21Pyramid* pyr, AffineMatrix mat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // NV21_PYRAMID_H
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nv21_container.h"
+#include "nv21_ring.h"
+
+// 把 .nv21 文件或 .nv21c 容器回放到共享内存环形缓冲, 用于本地测试消费者
+// 用法: nv21_ring_producer <ring> <width>x<height> [--slots=N] [--fps=F] [--loop=N] [--start=N]
+//                          a.nv21 [b.nv21c ...]
+//   一个裸文件可以包含多帧(连续存放), 按顺序逐帧发布
+//   容器按索引取帧, 尺寸与环不一致的帧跳过
+//   --fps   按固定帧率发布, 默认不限速(消费者跟不上时阻塞等待空槽位)
+//   --loop  整个文件列表回放的次数, 默认 1
+//   --start 容器从第 N 帧开始回放(直接查索引定位, 不从头读)
+static void usage(const char* prog)
+{
+    printf("usage: %s <ring> <width>x<height> [--slots=N] [--fps=F] [--loop=N] [--start=N] "
+           "file.nv21|file.nv21c ...\n",
+           prog);
+}
+
+typedef struct
+{
+    Nv21Ring* ring;
+    size_t    frame_size;
+    uint64_t  period_ns;
+    uint64_t  next_ns;
+    long      published;
+} Producer;
+
+// 等空槽位并返回, 消费者已关闭时返回 NULL
+static uint8_t* next_slot(Producer* p)
+{
+    if (nv21_ring_wait_writable(p->ring, -1) < 0) {
+        printf("consumer closed\n");
+        return NULL;
+    }
+    return nv21_ring_acquire(p->ring);
+}
+
+static void publish(Producer* p)
+{
+    if (p->period_ns) {
+        uint64_t now = nv21_ring_now_ns();
+        if (p->next_ns > now) {
+            struct timespec ts = {(time_t)((p->next_ns - now) / 1000000000ull),
+                                  (long)((p->next_ns - now) % 1000000000ull)};
+            nanosleep(&ts, NULL);
+        }
+        p->next_ns += p->period_ns;
+    }
+    nv21_ring_publish(p->ring);
+    p->published++;
+}
+
+// 裸文件: 直接读进共享内存槽位, 不经过中间缓冲. 返回 -1 表示消费者已关闭
+static int play_raw(Producer* p, const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        printf("open %s failed\n", path);
+        return 0;
+    }
+
+    int ret = 0;
+    for (;;) {
+        uint8_t* slot = next_slot(p);
+        if (!slot) {
+            ret = -1;
+            break;
+        }
+        if (fread(slot, 1, p->frame_size, fp) != p->frame_size) break;
+        publish(p);
+    }
+    fclose(fp);
+    return ret;
+}
+
+// 容器: 帧数据已经在 mmap 里, 拷贝一次进槽位
+static int play_container(Producer* p, const char* path, int64_t start)
+{
+    Nv21Container* container = nv21_container_open(path);
+    if (!container) {
+        printf("open %s failed\n", path);
+        return 0;
+    }
+
+    int     ret     = 0;
+    int     width   = nv21_ring_width(p->ring);
+    int     height  = nv21_ring_height(p->ring);
+    int64_t skipped = 0;
+    for (int64_t i = start; i < nv21_container_frame_count(container); i++) {
+        Nv21ContainerFrame frame;
+        const uint8_t*     data = nv21_container_frame(container, i, &frame);
+        if (!data || frame.fourcc != NV21_CONTAINER_FOURCC_NV21 || (int)frame.width != width ||
+            (int)frame.height != height) {
+            skipped++;
+            continue;
+        }
+
+        uint8_t* slot = next_slot(p);
+        if (!slot) {
+            ret = -1;
+            break;
+        }
+        memcpy(slot, data, p->frame_size);
+        publish(p);
+    }
+    if (skipped) {
+        printf("%s: skipped %lld frame(s) not %dx%d\n", path, (long long)skipped, width, height);
+    }
+    nv21_container_close(container);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const char* name   = argv[1];
+    int         width  = 0;
+    int         height = 0;
+    if (sscanf(argv[2], "%dx%d", &width, &height) != 2) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    int     slots = 8;
+    double  fps   = 0;
+    int     loops = 1;
+    int64_t start = 0;
+    int     first = 3;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strncmp(argv[first], "--slots=", 8) == 0) slots = atoi(argv[first] + 8);
+        if (strncmp(argv[first], "--fps=", 6) == 0) fps = atof(argv[first] + 6);
+        if (strncmp(argv[first], "--loop=", 7) == 0) loops = atoi(argv[first] + 7);
+        if (strncmp(argv[first], "--start=", 8) == 0) start = atoll(argv[first] + 8);
+    }
+    if (first >= argc) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    Nv21Ring* ring = nv21_ring_create(name, width, height, slots);
+    if (!ring) {
+        printf("create ring %s %dx%d x%d failed\n", name, width, height, slots);
+        return -1;
+    }
+    printf("ring %s: %dx%d, %d slots\n", name, width, height, slots);
+
+    uint64_t period_ns = fps > 0 ? (uint64_t)(1e9 / fps) : 0;
+    Producer p         = {ring, (size_t)width * height * 3 / 2, period_ns, nv21_ring_now_ns(), 0};
+    int      stop      = 0;
+
+    for (int loop = 0; loop < loops && !stop; loop++) {
+        for (int i = first; i < argc && !stop; i++) {
+            if (nv21_container_probe(argv[i])) {
+                stop = play_container(&p, argv[i], start) < 0;
+            }
+            else {
+                stop = play_raw(&p, argv[i]) < 0;
+            }
+        }
+    }
+
+    printf("published %ld frame(s)\n", p.published);
+    nv21_ring_close(ring);
+    nv21_ring_unlink(name);
+    return 0;
+}
@@ -0,0 +1,299 @@
+#ifndef NV21_SIMD_H
+#define NV21_SIMD_H
+
+// 分块转置/行反转/翻转用到的 SIMD 小工具, 非 SSE2 平台退化为标量实现
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#    define NV21_HAVE_SSE2 1
+#endif
+#if defined(__SSSE3__)
+#    include <tmmintrin.h>
+#    define NV21_HAVE_SSSE3 1
+#endif
+
+#if defined(NV21_HAVE_SSE2)
+// 16 个字节整体反转. 有 SSSE3 时一条 pshufb, 否则 32 位反转 + 16 位对内交换 + 字节交换
+static inline __m128i reverse_u8x16(__m128i v)
+{
+#    if defined(NV21_HAVE_SSSE3)
+    return _mm_shuffle_epi8(v, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+#    else
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+#    endif
+}
+
+// 8 个 16 位元素整体反转(VU 对内顺序不变)
+static inline __m128i reverse_u16x8(__m128i v)
+{
+#    if defined(NV21_HAVE_SSSE3)
+    return _mm_shuffle_epi8(v, _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+#    else
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+#    endif
+}
+#endif
+
+// 16x16 字节块转置: 源第 k 行在 src + k * src_step, 结果第 m 行写到 dst + m * dst_step.
+// 步长可以为负, 用于直角旋转时的行/列反向.
+static inline void transpose_u8_16x16(const uint8_t* src, ptrdiff_t src_step, uint8_t* dst,
+                                      ptrdiff_t dst_step)
+{
+#if defined(NV21_HAVE_SSE2)
+    // 全部放在寄存器里: 4 轮 (i, i+8) 交织即为转置
+#    define LOAD(i) __m128i a##i = _mm_loadu_si128((const __m128i*)(src + (i)*src_step))
+#    define INTERLEAVE(x, y)                                                                       \
+        y##0  = _mm_unpacklo_epi8(x##0, x##8);                                                     \
+        y##1  = _mm_unpackhi_epi8(x##0, x##8);                                                     \
+        y##2  = _mm_unpacklo_epi8(x##1, x##9);                                                     \
+        y##3  = _mm_unpackhi_epi8(x##1, x##9);                                                     \
+        y##4  = _mm_unpacklo_epi8(x##2, x##10);                                                    \
+        y##5  = _mm_unpackhi_epi8(x##2, x##10);                                                    \
+        y##6  = _mm_unpacklo_epi8(x##3, x##11);                                                    \
+        y##7  = _mm_unpackhi_epi8(x##3, x##11);                                                    \
+        y##8  = _mm_unpacklo_epi8(x##4, x##12);                                                    \
+        y##9  = _mm_unpackhi_epi8(x##4, x##12);                                                    \
+        y##10 = _mm_unpacklo_epi8(x##5, x##13);                                                    \
+        y##11 = _mm_unpackhi_epi8(x##5, x##13);                                                    \
+        y##12 = _mm_unpacklo_epi8(x##6, x##14);                                                    \
+        y##13 = _mm_unpackhi_epi8(x##6, x##14);                                                    \
+        y##14 = _mm_unpacklo_epi8(x##7, x##15);                                                    \
+        y##15 = _mm_unpackhi_epi8(x##7, x##15)
+#    define STORE(i) _mm_storeu_si128((__m128i*)(dst + (i)*dst_step), a##i)
+
+    LOAD(0); LOAD(1); LOAD(2);  LOAD(3);  LOAD(4);  LOAD(5);  LOAD(6);  LOAD(7);
+    LOAD(8); LOAD(9); LOAD(10); LOAD(11); LOAD(12); LOAD(13); LOAD(14); LOAD(15);
+
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7, b8, b9, b10, b11, b12, b13, b14, b15;
+    INTERLEAVE(a, b);
+    INTERLEAVE(b, a);
+    INTERLEAVE(a, b);
+    INTERLEAVE(b, a);
+
+    STORE(0); STORE(1); STORE(2);  STORE(3);  STORE(4);  STORE(5);  STORE(6);  STORE(7);
+    STORE(8); STORE(9); STORE(10); STORE(11); STORE(12); STORE(13); STORE(14); STORE(15);
+
+#    undef LOAD
+#    undef INTERLEAVE
+#    undef STORE
+#else
+    for (int m = 0; m < 16; m++) {
+        for (int k = 0; k < 16; k++) dst[m * dst_step + k] = src[k * src_step + m];
+    }
+#endif
+}
+
+// 8x8 的 16 位块转置(NV21 的 VU 对), 参数含义同 transpose_u8_16x16
+static inline void transpose_u16_8x8(const uint8_t* src, ptrdiff_t src_step, uint8_t* dst,
+                                     ptrdiff_t dst_step)
+{
+#if defined(NV21_HAVE_SSE2)
+#    define LOAD(i) __m128i a##i = _mm_loadu_si128((const __m128i*)(src + (i)*src_step))
+#    define INTERLEAVE(x, y)                                                                       \
+        y##0 = _mm_unpacklo_epi16(x##0, x##4);                                                     \
+        y##1 = _mm_unpackhi_epi16(x##0, x##4);                                                     \
+        y##2 = _mm_unpacklo_epi16(x##1, x##5);                                                     \
+        y##3 = _mm_unpackhi_epi16(x##1, x##5);                                                     \
+        y##4 = _mm_unpacklo_epi16(x##2, x##6);                                                     \
+        y##5 = _mm_unpackhi_epi16(x##2, x##6);                                                     \
+        y##6 = _mm_unpacklo_epi16(x##3, x##7);                                                     \
+        y##7 = _mm_unpackhi_epi16(x##3, x##7)
+#    define STORE(i, v) _mm_storeu_si128((__m128i*)(dst + (i)*dst_step), v##i)
+
+    LOAD(0); LOAD(1); LOAD(2); LOAD(3); LOAD(4); LOAD(5); LOAD(6); LOAD(7);
+
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+    INTERLEAVE(a, b);
+    INTERLEAVE(b, a);
+    INTERLEAVE(a, b);
+
+    STORE(0, b); STORE(1, b); STORE(2, b); STORE(3, b);
+    STORE(4, b); STORE(5, b); STORE(6, b); STORE(7, b);
+
+#    undef LOAD
+#    undef INTERLEAVE
+#    undef STORE
+#else
+    for (int m = 0; m < 8; m++) {
+        for (int k = 0; k < 8; k++) {
+            memcpy(dst + m * dst_step + 2 * k, src + k * src_step + 2 * m, 2);
+        }
+    }
+#endif
+}
+
+// dst[i] = src[n - 1 - i], 按字节反转一行
+static inline void reverse_copy_u8(uint8_t* dst, const uint8_t* src, int n)
+{
+    int i = 0;
+#if defined(NV21_HAVE_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + n - 16 - i));
+        _mm_storeu_si128((__m128i*)(dst + i), reverse_u8x16(v));
+    }
+#endif
+    for (; i < n; i++) dst[i] = src[n - 1 - i];
+}
+
+// 按 16 位反转一行, n 为 16 位元素个数(NV21 的 VU 对整体反转, 对内顺序不变)
+static inline void reverse_copy_u16(uint8_t* dst, const uint8_t* src, int n)
+{
+    int i = 0;
+#if defined(NV21_HAVE_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 2 * (n - 8 - i)));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), reverse_u16x8(v));
+    }
+#endif
+    for (; i < n; i++) memcpy(dst + 2 * i, src + 2 * (n - 1 - i), 2);
+}
+
+// 原地按字节反转一行: 两端各取 16 字节, 反转后互换位置, 一遍完成; 中间不足 32 字节的部分逐字节交换
+static inline void reverse_inplace_u8(uint8_t* row, int n)
+{
+    int lo = 0, hi = n;   // 未处理的区间 [lo, hi)
+#if defined(NV21_HAVE_SSE2)
+    for (; hi - lo >= 32; lo += 16, hi -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row + lo));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row + hi - 16));
+        _mm_storeu_si128((__m128i*)(row + lo), reverse_u8x16(b));
+        _mm_storeu_si128((__m128i*)(row + hi - 16), reverse_u8x16(a));
+    }
+#endif
+    for (hi--; lo < hi; lo++, hi--) {
+        uint8_t tmp = row[lo];
+        row[lo]     = row[hi];
+        row[hi]     = tmp;
+    }
+}
+
+// 原地按 16 位反转一行, n 为 16 位元素个数
+static inline void reverse_inplace_u16(uint8_t* row, int n)
+{
+    int lo = 0, hi = n;
+#if defined(NV21_HAVE_SSE2)
+    for (; hi - lo >= 16; lo += 8, hi -= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(row + 2 * lo));
+        __m128i b = _mm_loadu_si128((const __m128i*)(row + 2 * (hi - 8)));
+        _mm_storeu_si128((__m128i*)(row + 2 * lo), reverse_u16x8(b));
+        _mm_storeu_si128((__m128i*)(row + 2 * (hi - 8)), reverse_u16x8(a));
+    }
+#endif
+    for (hi--; lo < hi; lo++, hi--) {
+        uint8_t tmp[2];
+        memcpy(tmp, row + 2 * lo, 2);
+        memcpy(row + 2 * lo, row + 2 * hi, 2);
+        memcpy(row + 2 * hi, tmp, 2);
+    }
+}
+
+// 两行互换, 同时各自按字节反转(180 度旋转的一对行), a 与 b 不重叠
+static inline void reverse_swap_u8(uint8_t* a, uint8_t* b, int n)
+{
+    int i = 0;
+#if defined(NV21_HAVE_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + n - 16 - i));
+        _mm_storeu_si128((__m128i*)(a + i), reverse_u8x16(vb));
+        _mm_storeu_si128((__m128i*)(b + n - 16 - i), reverse_u8x16(va));
+    }
+#endif
+    for (; i < n; i++) {
+        uint8_t tmp  = a[i];
+        a[i]         = b[n - 1 - i];
+        b[n - 1 - i] = tmp;
+    }
+}
+
+// 同 reverse_swap_u8, 按 16 位反转, n 为 16 位元素个数
+static inline void reverse_swap_u16(uint8_t* a, uint8_t* b, int n)
+{
+    int i = 0;
+#if defined(NV21_HAVE_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + 2 * i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + 2 * (n - 8 - i)));
+        _mm_storeu_si128((__m128i*)(a + 2 * i), reverse_u16x8(vb));
+        _mm_storeu_si128((__m128i*)(b + 2 * (n - 8 - i)), reverse_u16x8(va));
+    }
+#endif
+    uint8_t* p = a + 2 * i;
+    uint8_t* q = b + 2 * (n - 1 - i);
+    for (; i < n; i++, p += 2, q -= 2) {
+        uint8_t tmp[2];
+        memcpy(tmp, p, 2);
+        memcpy(p, q, 2);
+        memcpy(q, tmp, 2);
+    }
+}
+
+// 两行互换, n 为字节数, a 与 b 不重叠
+static inline void swap_rows_u8(uint8_t* a, uint8_t* b, int n)
+{
+    int i = 0;
+#if defined(NV21_HAVE_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(a + i), vb);
+        _mm_storeu_si128((__m128i*)(b + i), va);
+    }
+#endif
+    for (; i < n; i++) {
+        uint8_t tmp = a[i];
+        a[i]        = b[i];
+        b[i]        = tmp;
+    }
+}
+
+// 翻转中的一步: vertical 时 a/b 为上下对称的一对行(奇数行数的中间行 a == b), 否则只处理 a.
+// n 为元素个数, elem 为元素字节数(1: Y/灰度, 2: VU 对)
+static inline void flip_row_pair(uint8_t* a, uint8_t* b, int n, int elem, int horizontal,
+                                 int vertical)
+{
+    if (!vertical || a == b) {
+        if (!horizontal) return;
+        if (elem == 2) {
+            reverse_inplace_u16(a, n);
+        }
+        else {
+            reverse_inplace_u8(a, n);
+        }
+    }
+    else if (!horizontal) {
+        swap_rows_u8(a, b, n * elem);
+    }
+    else if (elem == 2) {
+        reverse_swap_u16(a, b, n);
+    }
+    else {
+        reverse_swap_u8(a, b, n);
+    }
+}
+
+// 单线程原地翻转一个平面(行跨度 stride 字节), 每个元素只读写一次
+static inline void flip_plane(uint8_t* data, int width, int height, ptrdiff_t stride, int elem,
+                              int horizontal, int vertical)
+{
+    int rows = vertical ? (height + 1) / 2 : height;
+    for (int y = 0; y < rows; y++) {
+        flip_row_pair(data + y * stride,
+                      data + (vertical ? height - 1 - y : y) * stride,
+                      width,
+                      elem,
+                      horizontal,
+                      vertical);
+    }
+}
+
+#endif   // NV21_SIMD_H
@@ -0,0 +1,113 @@
+#include "nv21_slice_warp.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "perf_regions.h"
+
+struct NV21SliceWarp
+{
+    NV21Image*       dst;
+    const NV21Image* src;
+    AffineMatrix     mat;
+    int              pairs;       // 目标行对数
+    int*             need;        // need[p]: 行对 p 需要的源行数
+    int*             order;       // 行对按 need 升序(相同时按行号)
+    int              next;        // order 中下一个未输出的位置
+    int              rows_done;
+};
+
+// 目标行 y 用到的源行数. 采样位置 src_y 沿一行线性变化, 取两端的较大者;
+// 双线性还要用到下一行, 色度取 (int)(src_y / 2 + 0.5) 行, 再各留一行浮点余量
+static int row_need(const AffineMatrix* mat, int y, int dst_width, int src_height)
+{
+    float y0 = mat->d * 0 + mat->e * y + mat->f;
+    float y1 = mat->d * (dst_width - 1) + mat->e * y + mat->f;
+    float lo = y0 < y1 ? y0 : y1;
+    float hi = y0 < y1 ? y1 : y0;
+
+    // 整行都落在源图上方或下方, 只有背景色
+    if (hi < -1.0f || lo >= src_height + 1.0f) return 0;
+    if (hi >= src_height) return src_height;
+
+    int luma   = (int)floorf(hi) + 3;
+    int chroma = ((int)floorf(hi / 2 + 0.5f) + 1) * 2 + 2;
+    int need   = luma > chroma ? luma : chroma;
+    return CLAMP(need, 0, src_height);
+}
+
+NV21SliceWarp* nv21_slice_warp_create(NV21Image* dst, const NV21Image* src, AffineMatrix mat)
+{
+    NV21SliceWarp* warp = (NV21SliceWarp*)calloc(1, sizeof(NV21SliceWarp));
+    if (!warp) return NULL;
+
+    warp->dst   = dst;
+    warp->src   = src;
+    warp->mat   = mat;
+    warp->pairs = (dst->height + 1) / 2;
+    warp->need  = (int*)malloc(sizeof(int) * warp->pairs);
+    warp->order = (int*)malloc(sizeof(int) * warp->pairs);
+    if (!warp->need || !warp->order) {
+        nv21_slice_warp_destroy(warp);
+        return NULL;
+    }
+
+    // need 在 [0, src->height] 内, 计数排序(稳定, 相同 need 保持行号顺序)
+    int* start = (int*)calloc(src->height + 2, sizeof(int));
+    if (!start) {
+        nv21_slice_warp_destroy(warp);
+        return NULL;
+    }
+    for (int p = 0; p < warp->pairs; p++) {
+        int need0 = row_need(&mat, p * 2, dst->width, src->height);
+        int need1 = p * 2 + 1 < dst->height ? row_need(&mat, p * 2 + 1, dst->width, src->height)
+                                            : 0;
+        warp->need[p] = need0 > need1 ? need0 : need1;
+        start[warp->need[p] + 1]++;
+    }
+    for (int n = 1; n <= src->height + 1; n++) start[n] += start[n - 1];
+    for (int p = 0; p < warp->pairs; p++) warp->order[start[warp->need[p]]++] = p;
+    free(start);
+    return warp;
+}
+
+void nv21_slice_warp_destroy(NV21SliceWarp* warp)
+{
+    if (!warp) return;
+    free(warp->need);
+    free(warp->order);
+    free(warp);
+}
+
+void nv21_slice_warp_reset(NV21SliceWarp* warp)
+{
+    warp->next      = 0;
+    warp->rows_done = 0;
+}
+
+int nv21_slice_warp_feed(NV21SliceWarp* warp, int rows_ready, NV21SliceRowsFn on_rows, void* ctx)
+{
+    PERF_SCOPE_BEGIN(scope, "slice_warp");
+    while (warp->next < warp->pairs && warp->need[warp->order[warp->next]] <= rows_ready) {
+        // 把目标行号连续的行对合并成一段, 一次并行处理
+        int first = warp->order[warp->next++];
+        int last  = first;
+        while (warp->next < warp->pairs && warp->need[warp->order[warp->next]] <= rows_ready &&
+               warp->order[warp->next] == last + 1) {
+            last = warp->order[warp->next++];
+        }
+
+        int y_begin = first * 2;
+        int y_end   = (last + 1) * 2 < warp->dst->height ? (last + 1) * 2 : warp->dst->height;
+        affine_transform_range(warp->dst, warp->src, warp->mat, y_begin, y_end);
+        warp->rows_done += y_end - y_begin;
+        if (on_rows) on_rows(ctx, y_begin, y_end);
+    }
+    PERF_SCOPE_END(scope);
+    return warp->rows_done;
+}
+
+int nv21_slice_warp_rows_needed(const NV21SliceWarp* warp, int y)
+{
+    return warp->need[y / 2];
+}
@@ -0,0 +1,40 @@
+#ifndef NV21_SLICE_WARP_H
+#define NV21_SLICE_WARP_H
+
+#include "nv21_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 分段(slice)仿射变换: 源图按行带陆续到达(卷帘读出、按行解码), 每到一段就输出所有
+// 只依赖已到达行的目标行, 不必等整帧.
+//
+// 创建时由反向矩阵算出每对目标行(偶数行 + 下一行, 共用一行 VU)最多用到的源行数,
+// 按这个数从小到大排好顺序; feed 时沿顺序输出所有已满足的行对. 结果与
+// affine_transform 逐字节一致. 源行数按每行两端的采样位置保守估计(多算一行余量).
+typedef struct NV21SliceWarp NV21SliceWarp;
+
+// 每输出一段连续的目标行 [y_begin, y_end) 回调一次
+typedef void (*NV21SliceRowsFn)(void* ctx, int y_begin, int y_end);
+
+// dst 和 src 的尺寸、缓冲区在整个使用期间不变, src 的内容随后逐段写入.
+// mat 与 affine_transform 相同(目标坐标 -> 源坐标)
+NV21SliceWarp* nv21_slice_warp_create(NV21Image* dst, const NV21Image* src, AffineMatrix mat);
+void           nv21_slice_warp_destroy(NV21SliceWarp* warp);
+
+// 开始新的一帧(同一个矩阵)
+void nv21_slice_warp_reset(NV21SliceWarp* warp);
+
+// src 的前 rows_ready 行 Y(以及前 rows_ready / 2 行 VU)已经就绪, rows_ready 不减.
+// 输出新满足条件的目标行, 返回累计已输出的目标行数; rows_ready 为源图高度时全部输出
+int nv21_slice_warp_feed(NV21SliceWarp* warp, int rows_ready, NV21SliceRowsFn on_rows, void* ctx);
+
+// 目标第 y 行(所在行对)输出前需要就绪的源行数
+int nv21_slice_warp_rows_needed(const NV21SliceWarp* warp, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // NV21_SLICE_WARP_H
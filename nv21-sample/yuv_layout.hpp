@@ -0,0 +1,161 @@
+#ifndef YUV_LAYOUT_HPP
+#define YUV_LAYOUT_HPP
+
+#include "nv21_image.h"
+#include "thread_pool.h"
+#include "yuv_warp.h"
+
+// 像素布局的编译期描述. 内核按布局和(可选的)目标尺寸实例化, 平面地址、色度步长、
+// 下采样移位都是常量, 编译器可以据此展开和向量化每一个特化版本.
+//
+//   kPlanes      平面数
+//   kChromaStep  色度平面中相邻两个色度样本的字节距离(交错为 2, 平面为 1)
+//   kUPlane/kUOffset, kVPlane/kVOffset  U/V 所在平面及其在样本中的偏移
+//   kSubX/kSubY  色度水平/垂直下采样(log2)
+struct LayoutNV21
+{
+    static const int kPlanes     = 2;
+    static const int kChromaStep = 2;
+    static const int kUPlane     = 1;
+    static const int kUOffset    = 1;
+    static const int kVPlane     = 1;
+    static const int kVOffset    = 0;
+    static const int kSubX       = 1;
+    static const int kSubY       = 1;
+};
+
+struct LayoutNV12
+{
+    static const int kPlanes     = 2;
+    static const int kChromaStep = 2;
+    static const int kUPlane     = 1;
+    static const int kUOffset    = 0;
+    static const int kVPlane     = 1;
+    static const int kVOffset    = 1;
+    static const int kSubX       = 1;
+    static const int kSubY       = 1;
+};
+
+struct LayoutI420
+{
+    static const int kPlanes     = 3;
+    static const int kChromaStep = 1;
+    static const int kUPlane     = 1;
+    static const int kUOffset    = 0;
+    static const int kVPlane     = 2;
+    static const int kVOffset    = 0;
+    static const int kSubX       = 1;
+    static const int kSubY       = 1;
+};
+
+// 仿射变换(反向映射), 与 affine_transform 逐字节一致:
+// Y 为双线性(浮点, 与 bilinear_interpolate_y 相同的运算顺序), 色度取最近样本
+// (与 process_uv_component 相同), 采样点在源图外时 Y=0、色度=128.
+// kDstW/kDstH 为 0 时目标尺寸在运行时决定; 非 0 时列坐标项 a*x、d*x 预先算进栈上的表,
+// 循环次数是常量.
+template <class Layout, int kDstW = 0, int kDstH = 0>
+struct YuvWarp
+{
+    struct Band
+    {
+        YuvImage*        dst;
+        const YuvImage*  src;
+        AffineMatrix     mat;
+        const float*     ax;   // 固定尺寸时: ax[x] = a * x
+        const float*     dx;   // 固定尺寸时: dx[x] = d * x
+    };
+
+    static int width(const YuvImage* img) { return kDstW > 0 ? kDstW : img->width; }
+    static int height(const YuvImage* img) { return kDstH > 0 ? kDstH : img->height; }
+
+    static inline uint8_t luma(const YuvImage* src, float x, float y)
+    {
+        // 调用方保证 0 <= x < width, 0 <= y < height, 只有 x1/y1 需要钳位
+        int   x0 = (int)x, y0 = (int)y;
+        int   x1 = x0 + 1 < src->width ? x0 + 1 : src->width - 1;
+        int   y1 = y0 + 1 < src->height ? y0 + 1 : src->height - 1;
+        float fx = x - x0, fy = y - y0;
+
+        const uint8_t* row0 = src->plane[0] + (size_t)y0 * src->width;
+        const uint8_t* row1 = src->plane[0] + (size_t)y1 * src->width;
+        return (uint8_t)(row0[x0] * (1 - fx) * (1 - fy) + row0[x1] * fx * (1 - fy) +
+                         row1[x0] * (1 - fx) * fy + row1[x1] * fx * fy);
+    }
+
+    static void rows(void* arg, int y_begin, int y_end)
+    {
+        const Band*        band = (const Band*)arg;
+        YuvImage*          dst  = band->dst;
+        const YuvImage*    src  = band->src;
+        const AffineMatrix m    = band->mat;
+        const int          dw   = width(dst);
+        const float        sw   = (float)src->width;
+        const float        sh   = (float)src->height;
+
+        for (int y = y_begin; y < y_end; y++) {
+            uint8_t*    out = dst->plane[0] + (size_t)y * dw;
+            const float by  = m.b * y;
+            const float ey  = m.e * y;
+            for (int x = 0; x < dw; x++) {
+                float ax = kDstW > 0 ? band->ax[x] : m.a * x;
+                float dx = kDstW > 0 ? band->dx[x] : m.d * x;
+                float sx = ax + by + m.c;
+                float sy = dx + ey + m.f;
+                out[x]   = sx >= 0 && sx < sw && sy >= 0 && sy < sh ? luma(src, sx, sy) : 0;
+            }
+        }
+
+        // 本行带覆盖的色度行, 采样点取对应的左上角亮度像素
+        const int cw        = dw >> Layout::kSubX;
+        const int cstride   = cw * Layout::kChromaStep;
+        const int src_cw    = src->width >> Layout::kSubX;
+        const int src_ch    = src->height >> Layout::kSubY;
+        const int src_cstep = src_cw * Layout::kChromaStep;
+        const int cy_begin  = (y_begin + (1 << Layout::kSubY) - 1) >> Layout::kSubY;
+        const int cy_end    = (y_end + (1 << Layout::kSubY) - 1) >> Layout::kSubY;
+        for (int cy = cy_begin; cy < cy_end; cy++) {
+            int         y   = cy << Layout::kSubY;
+            uint8_t*    u   = dst->plane[Layout::kUPlane] + (size_t)cy * cstride + Layout::kUOffset;
+            uint8_t*    v   = dst->plane[Layout::kVPlane] + (size_t)cy * cstride + Layout::kVOffset;
+            const float by  = m.b * y;
+            const float ey  = m.e * y;
+            for (int cx = 0; cx < cw; cx++) {
+                int   x  = cx << Layout::kSubX;
+                float ax = kDstW > 0 ? band->ax[x] : m.a * x;
+                float dx = kDstW > 0 ? band->dx[x] : m.d * x;
+                float sx = ax + by + m.c;
+                float sy = dx + ey + m.f;
+                if (sx >= 0 && sx < sw && sy >= 0 && sy < sh) {
+                    int scx = CLAMP((int)(sx / (1 << Layout::kSubX) + 0.5f), 0, src_cw - 1);
+                    int scy = CLAMP((int)(sy / (1 << Layout::kSubY) + 0.5f), 0, src_ch - 1);
+                    size_t s = (size_t)scy * src_cstep + (size_t)scx * Layout::kChromaStep;
+                    u[cx * Layout::kChromaStep] = src->plane[Layout::kUPlane][s + Layout::kUOffset];
+                    v[cx * Layout::kChromaStep] = src->plane[Layout::kVPlane][s + Layout::kVOffset];
+                }
+                else {
+                    u[cx * Layout::kChromaStep] = 128;
+                    v[cx * Layout::kChromaStep] = 128;
+                }
+            }
+        }
+    }
+
+    static void run(YuvImage* dst, const YuvImage* src, AffineMatrix mat)
+    {
+        Band band = {dst, src, mat, NULL, NULL};
+        // 固定尺寸: 列坐标项只算一次(与逐像素计算的乘积相同, 加法顺序不变)
+        float ax[kDstW > 0 ? kDstW : 1];
+        float dx[kDstW > 0 ? kDstW : 1];
+        if (kDstW > 0) {
+            for (int x = 0; x < kDstW; x++) {
+                ax[x] = mat.a * x;
+                dx[x] = mat.d * x;
+            }
+            band.ax = ax;
+            band.dx = dx;
+        }
+        thread_pool_parallel_for(NULL, 0, height(dst), NV21_BAND_ROWS, rows, &band);
+    }
+};
+
+#endif   // YUV_LAYOUT_HPP
@@ -0,0 +1,72 @@
+#include "yuv_warp.h"
+
+#include "perf_regions.h"
+#include "yuv_layout.hpp"
+
+typedef void (*WarpFn)(YuvImage* dst, const YuvImage* src, AffineMatrix mat);
+
+// 预编译的固定尺寸版本, 覆盖部署中常用的输出尺寸
+typedef struct
+{
+    YuvLayout layout;
+    int       width;
+    int       height;
+    WarpFn    fn;
+} FixedWarp;
+
+static const FixedWarp kFixedWarps[] = {
+    {YUV_LAYOUT_NV21, 224, 224, YuvWarp<LayoutNV21, 224, 224>::run},
+    {YUV_LAYOUT_NV21, 112, 112, YuvWarp<LayoutNV21, 112, 112>::run},
+    {YUV_LAYOUT_NV12, 224, 224, YuvWarp<LayoutNV12, 224, 224>::run},
+    {YUV_LAYOUT_NV12, 112, 112, YuvWarp<LayoutNV12, 112, 112>::run},
+    {YUV_LAYOUT_I420, 224, 224, YuvWarp<LayoutI420, 224, 224>::run},
+    {YUV_LAYOUT_I420, 112, 112, YuvWarp<LayoutI420, 112, 112>::run},
+};
+
+static WarpFn generic_warp(YuvLayout layout)
+{
+    switch (layout) {
+    case YUV_LAYOUT_NV12: return YuvWarp<LayoutNV12>::run;
+    case YUV_LAYOUT_I420: return YuvWarp<LayoutI420>::run;
+    default: return YuvWarp<LayoutNV21>::run;
+    }
+}
+
+YuvImage yuv_image_from_nv21(const NV21Image* img)
+{
+    YuvImage yuv = {{img->y, img->vu, NULL}, img->width, img->height};
+    return yuv;
+}
+
+const char* yuv_layout_name(YuvLayout layout)
+{
+    switch (layout) {
+    case YUV_LAYOUT_NV21: return "NV21";
+    case YUV_LAYOUT_NV12: return "NV12";
+    case YUV_LAYOUT_I420: return "I420";
+    }
+    return "unknown";
+}
+
+int yuv_warp(YuvLayout layout, YuvImage* dst, const YuvImage* src, AffineMatrix mat)
+{
+    for (size_t i = 0; i < sizeof(kFixedWarps) / sizeof(kFixedWarps[0]); i++) {
+        const FixedWarp* fixed = &kFixedWarps[i];
+        if (fixed->layout == layout && fixed->width == dst->width &&
+            fixed->height == dst->height) {
+            PERF_SCOPE_BEGIN(scope, "yuv_warp(fixed)");
+            fixed->fn(dst, src, mat);
+            PERF_SCOPE_END(scope);
+            return 1;
+        }
+    }
+    yuv_warp_generic(layout, dst, src, mat);
+    return 0;
+}
+
+void yuv_warp_generic(YuvLayout layout, YuvImage* dst, const YuvImage* src, AffineMatrix mat)
+{
+    PERF_SCOPE_BEGIN(scope, "yuv_warp(generic)");
+    generic_warp(layout)(dst, src, mat);
+    PERF_SCOPE_END(scope);
+}
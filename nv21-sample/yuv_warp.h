@@ -0,0 +1,43 @@
+#ifndef YUV_WARP_H
+#define YUV_WARP_H
+
+#include <stdint.h>
+
+#include "nv21_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 像素布局, 均为 4:2:0
+typedef enum
+{
+    YUV_LAYOUT_NV21,   // Y + VU 交错
+    YUV_LAYOUT_NV12,   // Y + UV 交错
+    YUV_LAYOUT_I420,   // Y + U + V
+} YuvLayout;
+
+// 各平面紧密排列(行距等于平面宽度的字节数).
+// NV21/NV12: plane[1] 为交错色度平面, plane[2] 不用; I420: plane[1] = U, plane[2] = V
+typedef struct
+{
+    uint8_t* plane[3];
+    int      width;
+    int      height;
+} YuvImage;
+
+YuvImage    yuv_image_from_nv21(const NV21Image* img);
+const char* yuv_layout_name(YuvLayout layout);
+
+// 与 affine_transform 语义相同(反向映射, 越界 Y=0 / 色度=128, 结果逐字节一致), src 与 dst 布局相同.
+// 内核是按布局(平面数、色度顺序、下采样)和目标尺寸实例化的模板:
+// 目标尺寸有预编译的固定尺寸版本(224x224, 112x112)时走它并返回 1, 否则走该布局的通用版本返回 0
+int  yuv_warp(YuvLayout layout, YuvImage* dst, const YuvImage* src, AffineMatrix mat);
+// 总是使用通用(运行时尺寸)版本, 用于对比
+void yuv_warp_generic(YuvLayout layout, YuvImage* dst, const YuvImage* src, AffineMatrix mat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // YUV_WARP_H